@@ -0,0 +1,731 @@
+// nps_bench: microbenchmarks of the hot paths, one json object per line
+//
+//   {"bench": "vec_add", "iters": 4194304, "runs": 7, "ns_per_op": 3.1,
+//    "ns_per_op_min": 2.9, "ns_per_op_max": 3.4}
+//
+// every bench is calibrated to run at least BENCH_MIN_NS, then repeated
+// BENCH_RUNS times, ns_per_op is the median. inputs are fixed so runs are
+// comparable between builds. `nps_bench [filter]` only runs the benches
+// whose name contains `filter`.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <json-c/json.h>
+#include <zlib.h>
+
+#include <bool.h>
+#include <vec.h>
+#include <hmap.h>
+#include <cmd.h>
+#include <jwt.h>
+#include <proto.h>
+#include <content.h>
+#include <lines.h>
+#include <utf8.h>
+#include <diff.h>
+#include <arena.h>
+#include <pool.h>
+#include <snowflake.h>
+
+#define BENCH_MIN_NS 50000000lu // 50ms
+#define BENCH_RUNS   7
+
+#define BENCH_KEY "bench key"
+
+typedef void (*bench_fn_t)(size_t iters, long arg);
+
+struct bench {
+    const char *name;
+    bench_fn_t  fn;
+    long        arg;
+};
+
+// results are stored here so the compiler keeps the work
+static volatile uint64_t bench_sink;
+
+// bytes per op before and after, printed when a bench sets them
+static size_t bench_bytes_in, bench_bytes_out;
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// --- vec_t ---
+
+static void bench_vec_add(size_t iters, long arg) {
+    (void)arg;
+    vec_t *vec = vec_new_r(uint64_t, NULL, NULL, NULL);
+    for (uint64_t i = 0; i < iters; ++i) vec_add(vec, &i);
+    bench_sink = vec->len;
+    vec_drop(vec);
+}
+
+static void bench_vec_push_r(size_t iters, long arg) {
+    (void)arg;
+    vec_t *vec = vec_new_r(uint64_t, NULL, NULL, NULL);
+    for (uint64_t i = 0; i < iters; ++i) vec_push_r(uint64_t, vec, i);
+    bench_sink = vec->len;
+    vec_drop(vec);
+}
+
+static vec_t *bench_vec_filled(size_t len) {
+    vec_t *vec = vec_new_r(uint64_t, NULL, NULL, NULL);
+    for (uint64_t i = 0; i < len; ++i) vec_add(vec, &i);
+    return vec;
+}
+
+static void bench_vec_get(size_t iters, long len) {
+    vec_t   *vec = bench_vec_filled(len);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < iters; ++i) {
+        sum += vec_get_r(uint64_t, vec, i % len);
+    }
+    bench_sink = sum;
+    vec_drop(vec);
+}
+
+// linear search for the middle element, as done for file_infos and wsis
+static void bench_vec_index_of(size_t iters, long len) {
+    vec_t   *vec = bench_vec_filled(len);
+    uint64_t key = len / 2, sum = 0;
+    for (size_t i = 0; i < iters; ++i) sum += vec_index_of(vec, &key);
+    bench_sink = sum;
+    vec_drop(vec);
+}
+
+static void bench_vec_find_r(size_t iters, long len) {
+    vec_t   *vec = bench_vec_filled(len);
+    uint64_t key = len / 2, sum = 0;
+    for (size_t i = 0; i < iters; ++i) sum += vec_find_r(uint64_t, vec, key);
+    bench_sink = sum;
+    vec_drop(vec);
+}
+
+// unsubscribe one session and subscribe another, as done for file wsis
+static void bench_vec_swap_remove(size_t iters, long len) {
+    vec_t *vec = bench_vec_filled(len);
+    for (uint64_t i = 0; i < iters; ++i) {
+        vec_swap_remove(vec, i % len);
+        vec_push_r(uint64_t, vec, i);
+    }
+    bench_sink = vec->len;
+    vec_drop(vec);
+}
+
+// pop the head and push to the tail, as done for write queues
+static void bench_vec_remove_head(size_t iters, long len) {
+    vec_t *vec = bench_vec_filled(len);
+    for (uint64_t i = 0; i < iters; ++i) {
+        vec_remove(vec, 0);
+        vec_add(vec, &i);
+    }
+    bench_sink = vec->len;
+    vec_drop(vec);
+}
+
+// --- hmap ---
+
+// snowflake-like ids, as the file ids keying vhd->files
+static hmap_t *bench_hmap_filled(size_t len) {
+    hmap_t *map = hmap_new_r(uint64_t, uint64_t, NULL);
+    for (uint64_t i = 0; i < len; ++i) {
+        uint64_t key = 359874126549811200lu + (i << 22);
+        hmap_put_r(uint64_t, uint64_t, map, key, i);
+    }
+    return map;
+}
+
+static void bench_hmap_get(size_t iters, long len) {
+    hmap_t  *map = bench_hmap_filled(len);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < iters; ++i) {
+        uint64_t  key = 359874126549811200lu + ((i % len) << 22);
+        uint64_t *val = hmap_get_r(uint64_t, map, key);
+        sum += *val;
+    }
+    bench_sink = sum;
+    hmap_drop(map);
+}
+
+static void bench_hmap_miss(size_t iters, long len) {
+    hmap_t  *map = bench_hmap_filled(len);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < iters; ++i) {
+        sum += hmap_get_r(uint64_t, map, i) != NULL;
+    }
+    bench_sink = sum;
+    hmap_drop(map);
+}
+
+// open a file and close it again, as done when the last subscriber leaves
+static void bench_hmap_put_remove(size_t iters, long len) {
+    hmap_t *map = bench_hmap_filled(len);
+    for (uint64_t i = 0; i < iters; ++i) {
+        hmap_put_r(uint64_t, uint64_t, map, i, i);
+        hmap_remove_r(uint64_t, map, i);
+    }
+    bench_sink = map->len;
+    hmap_drop(map);
+}
+
+// --- cmd ---
+
+static const char *bench_insert_cmd =
+    "{\"type\":\"insert\",\"args\":[\"359874126549811200\","
+    "\"359874126549811201\",120,120,\"a\",{\"s\":1,\"t\":12345}]}";
+
+static void bench_cmd_from_string(size_t iters, long arg) {
+    (void)arg;
+    for (size_t i = 0; i < iters; ++i) {
+        cmd_t *cmd = cmd_from_string(bench_insert_cmd);
+        bench_sink = (uintptr_t)cmd;
+        cmd_destroy(cmd);
+    }
+}
+
+static void bench_cmd_validate(size_t iters, long arg) {
+    (void)arg;
+    cmd_t *cmd = cmd_from_string(bench_insert_cmd);
+    for (size_t i = 0; i < iters; ++i) bench_sink = cmd_validate(cmd);
+    cmd_destroy(cmd);
+}
+
+// --- jwt ---
+
+static void bench_jwt_encode(size_t iters, long arg) {
+    (void)arg;
+    for (size_t i = 0; i < iters; ++i) {
+        char *token = jwt_encode(359874126549811200lu + i, BENCH_KEY);
+        bench_sink  = token[0];
+        free(token);
+    }
+}
+
+static void bench_jwt_decode(size_t iters, long arg) {
+    (void)arg;
+    char    *token = jwt_encode(359874126549811200lu, BENCH_KEY);
+    uint64_t uid   = 0;
+    for (size_t i = 0; i < iters; ++i) {
+        bench_sink = jwt_decode(token, BENCH_KEY, &uid);
+    }
+    free(token);
+}
+
+// --- snowflake, `arg` threads share one generator ---
+
+struct bench_snf_arg {
+    snowflake_t *snf;
+    size_t       iters;
+};
+
+static void *bench_snf_worker(void *p) {
+    struct bench_snf_arg *a = p;
+    uint64_t              x = 0;
+    for (size_t i = 0; i < a->iters; ++i) x ^= snowflake_lock_id(a->snf);
+    bench_sink = x;
+    return NULL;
+}
+
+static void bench_snowflake_lock_id(size_t iters, long threads) {
+    pthread_mutex_t mut = PTHREAD_MUTEX_INITIALIZER;
+    snowflake_t     snf = {.worker = 1, .process = 1, .pmutex = &mut};
+
+    pthread_t            tids[threads];
+    struct bench_snf_arg arg = {&snf, iters / threads};
+
+    for (long t = 0; t < threads; ++t) {
+        pthread_create(&tids[t], NULL, bench_snf_worker, &arg);
+    }
+    for (long t = 0; t < threads; ++t) pthread_join(tids[t], NULL);
+}
+
+// --- content splice, `arg` bytes of content ---
+
+static char *bench_content(size_t len) {
+    char *content = malloc(len + 1);
+    for (size_t i = 0; i < len; ++i) content[i] = 'a' + i % 26;
+    content[len] = '\0';
+    return content;
+}
+
+// type one char at a pseudo random offset, as the insert path does
+static void bench_splice_insert(size_t iters, long len) {
+    char  *content = bench_content(len);
+    size_t clen    = len;
+    for (size_t i = 0; i < iters; ++i) {
+        size_t from = (i * 2654435761u) % (clen + 1), to = from;
+        char  *next = content_splice(content, clen, &from, &to, "x", 1);
+        free(content);
+        content = next;
+        ++clen;
+
+        // keep the size stable
+        if (clen > (size_t)len * 2) {
+            free(content);
+            content = bench_content(len);
+            clen    = len;
+        }
+    }
+    bench_sink = clen;
+    free(content);
+}
+
+static void bench_splice_remove(size_t iters, long len) {
+    char  *content = bench_content(len);
+    size_t clen    = len;
+    for (size_t i = 0; i < iters; ++i) {
+        if (clen < (size_t)len / 2) {
+            free(content);
+            content = bench_content(len);
+            clen    = len;
+        }
+
+        size_t from = (i * 2654435761u) % clen, to = from;
+        char  *next = content_splice(content, clen, &from, &to, NULL, 0);
+        free(content);
+        content = next;
+        --clen;
+    }
+    bench_sink = clen;
+    free(content);
+}
+
+// --- line index, `arg` bytes of content in 40 byte rows ---
+
+static char *bench_lines_content(size_t len) {
+    char *content = bench_content(len);
+    for (size_t i = 39; i < len; i += 40) content[i] = '\n';
+    return content;
+}
+
+static void bench_lines_count(size_t iters, long len) {
+    char  *content = bench_lines_content(len);
+    size_t sum     = 0;
+    for (size_t i = 0; i < iters; ++i) sum += lines_count(content, len);
+    bench_sink = sum;
+    free(content);
+}
+
+static void bench_lines_position(size_t iters, long len) {
+    char    *content = bench_lines_content(len);
+    lines_t *lines   = lines_new(content, len);
+    size_t   sum     = 0, row, col;
+    for (size_t i = 0; i < iters; ++i) {
+        lines_position(lines, (i * 2654435761u) % len, &row, &col);
+        sum += row + col;
+    }
+    bench_sink = sum;
+    lines_drop(lines);
+    free(content);
+}
+
+// type one char at a pseudo random offset, as the insert path does
+static void bench_lines_splice(size_t iters, long len) {
+    char    *content = bench_lines_content(len);
+    lines_t *lines   = lines_new(content, len);
+    for (size_t i = 0; i < iters; ++i) {
+        size_t pos = (i * 2654435761u) % (lines->len + 1);
+        lines_splice(lines, pos, 0, "x", 1);
+        if (lines->len > (size_t)len * 2) {
+            lines_drop(lines);
+            lines = lines_new(content, len);
+        }
+    }
+    bench_sink = lines->rows;
+    lines_drop(lines);
+    free(content);
+}
+
+// --- utf-8, `arg` bytes of content, one in 8 characters is 2 or 3 bytes ---
+
+static char *bench_utf8_content(size_t len) {
+    char *content = bench_content(len);
+    for (size_t i = 0; i + 3 <= len; i += 24) {
+        if (i % 48) {
+            memcpy(content + i, "\xc3\xa9", 2);
+        } else {
+            memcpy(content + i, "\xe2\x82\xac", 3);
+        }
+    }
+    return content;
+}
+
+static void bench_utf8_valid_ascii(size_t iters, long len) {
+    char  *content = bench_content(len);
+    size_t sum     = 0;
+    for (size_t i = 0; i < iters; ++i) sum += utf8_valid(content, len);
+    bench_sink = sum;
+    free(content);
+}
+
+static void bench_utf8_valid(size_t iters, long len) {
+    char  *content = bench_utf8_content(len);
+    size_t sum     = 0;
+    for (size_t i = 0; i < iters; ++i) sum += utf8_valid(content, len);
+    bench_sink = sum;
+    free(content);
+}
+
+// utf-16 offset of a client to bytes, after an edit invalidated the index
+// from a pseudo random offset
+static void bench_utf8_to_byte(size_t iters, long len) {
+    char         *content = bench_utf8_content(len);
+    utf8_index_t *idx     = utf8_index_new(content, len);
+    size_t        units   = utf8_count(content, len, UTF8_UTF16);
+    size_t        sum     = 0;
+    for (size_t i = 0; i < iters; ++i) {
+        size_t n = (i * 2654435761u) % units;
+        utf8_index_splice(idx, utf8_index_to_byte(idx, content, UTF8_UTF16,
+                                   n > 64 ? n - 64 : 0),
+            NULL, 0, NULL, 0);
+        sum += utf8_index_to_byte(idx, content, UTF8_UTF16, n);
+    }
+    bench_sink = sum;
+    utf8_index_drop(idx);
+    free(content);
+}
+
+// --- diff, `arg` bytes of content against a copy with `edits` changes ---
+
+static char *bench_diff_edited(const char *content, size_t len, int edits) {
+    char *edited = strdup(content);
+    for (int i = 0; i < edits; ++i) {
+        edited[(i * 2654435761u + len / 2) % len] = '#';
+    }
+    return edited;
+}
+
+static void bench_diff(size_t iters, long len, int edits) {
+    char  *content = bench_lines_content(len);
+    char  *edited  = bench_diff_edited(content, len, edits);
+    size_t sum     = 0;
+    for (size_t i = 0; i < iters; ++i) {
+        vec_t *hunks = diff_hunks(content, len, edited, len);
+        sum += hunks->len;
+        vec_drop(hunks);
+    }
+    bench_sink = sum;
+    free(edited);
+    free(content);
+}
+
+// one change, all but a few bytes are a common prefix or suffix
+static void bench_diff_one(size_t iters, long len) {
+    bench_diff(iters, len, 1);
+}
+
+static void bench_diff_scattered(size_t iters, long len) {
+    bench_diff(iters, len, 16);
+}
+
+// nothing in common, given up on at DIFF_MAX_D
+static void bench_diff_rewrite(size_t iters, long len) {
+    char  *content = bench_content(len);
+    char  *other   = bench_content(len);
+    size_t sum     = 0;
+    for (long i = 0; i < len; ++i) other[i] = 'A' + i % 26;
+    for (size_t i = 0; i < iters; ++i) {
+        vec_t *hunks = diff_hunks(content, len, other, len);
+        sum += hunks->len;
+        vec_drop(hunks);
+    }
+    bench_sink = sum;
+    free(other);
+    free(content);
+}
+
+// --- per-message allocations, `arg` small blocks then freed ---
+
+static void bench_msg_malloc(size_t iters, long arg) {
+    void *ptrs[64] = {NULL};
+    for (size_t i = 0; i < iters; ++i) {
+        for (long j = 0; j < arg; ++j) ptrs[j] = malloc(16 + j * 8);
+        bench_sink = (uintptr_t)ptrs[arg - 1];
+        for (long j = 0; j < arg; ++j) free(ptrs[j]);
+    }
+}
+
+static void bench_msg_arena(size_t iters, long arg) {
+    arena_t *arena = arena_new(ARENA_CHUNK_SIZE);
+    for (size_t i = 0; i < iters; ++i) {
+        void *ptr = NULL;
+        for (long j = 0; j < arg; ++j) ptr = arena_alloc(arena, 16 + j * 8);
+        bench_sink = (uintptr_t)ptr;
+        arena_reset(arena);
+    }
+    arena_drop(arena);
+}
+
+// --- write queue chunks, `arg` bytes queued then written ---
+
+static void bench_chunk_malloc(size_t iters, long len) {
+    void *ptrs[16];
+    for (size_t i = 0; i < iters; ++i) {
+        for (int j = 0; j < 16; ++j) ptrs[j] = malloc(len + j);
+        bench_sink = (uintptr_t)ptrs[15];
+        for (int j = 0; j < 16; ++j) free(ptrs[j]);
+    }
+}
+
+static void bench_chunk_pool(size_t iters, long len) {
+    void *ptrs[16];
+    for (size_t i = 0; i < iters; ++i) {
+        for (int j = 0; j < 16; ++j) ptrs[j] = pool_alloc(len + j);
+        bench_sink = (uintptr_t)ptrs[15];
+        for (int j = 0; j < 16; ++j) pool_free(ptrs[j]);
+    }
+}
+
+// --- response serialization ---
+
+// the broadcast built by ws_broadcast_edit for a one char insert
+static struct json_object *bench_edit_res() {
+    struct json_object *res = json_object_new_object();
+    struct json_object *ver = json_object_new_object();
+    struct json_object *evt = json_object_new_object();
+
+    json_object_object_add(
+        ver, "file_id", json_object_new_string("359874126549811200"));
+    json_object_object_add(
+        ver, "ver_id", json_object_new_string("359874126549811202"));
+    json_object_object_add(
+        ver, "update_by", json_object_new_string("359874126549811201"));
+    json_object_object_add(ver, "from", json_object_new_int(120));
+    json_object_object_add(ver, "to", json_object_new_int(120));
+    json_object_object_add(ver, "string", json_object_new_string("a"));
+
+    json_object_object_add(evt, "s", json_object_new_int(1));
+    json_object_object_add(evt, "t", json_object_new_int64(12345));
+
+    json_object_object_add(res, "event", evt);
+    json_object_object_add(res, "insert", ver);
+    return res;
+}
+
+static void bench_res_build_json(size_t iters, long arg) {
+    (void)arg;
+    for (size_t i = 0; i < iters; ++i) {
+        struct json_object *res = bench_edit_res();
+        bench_sink =
+            strlen(json_object_to_json_string_ext(res, JSON_C_TO_STRING_PLAIN));
+        json_object_put(res);
+    }
+}
+
+static void bench_res_serialize_json(size_t iters, long arg) {
+    (void)arg;
+    struct json_object *res = bench_edit_res();
+    for (size_t i = 0; i < iters; ++i) {
+        bench_sink =
+            strlen(json_object_to_json_string_ext(res, JSON_C_TO_STRING_PLAIN));
+    }
+    json_object_put(res);
+}
+
+static void bench_res_encode_bin(size_t iters, long arg) {
+    (void)arg;
+    proto_op_t op = {
+        .op         = PROTO_OP_INSERT,
+        .file_id    = 359874126549811200lu,
+        .ver_id     = 359874126549811202lu,
+        .user_id    = 359874126549811201lu,
+        .from       = 120,
+        .to         = 120,
+        .string     = "a",
+        .string_len = 1,
+    };
+    uint8_t buf[128];
+    for (size_t i = 0; i < iters; ++i) {
+        bench_sink = proto_encode(&op, buf, sizeof(buf));
+    }
+}
+
+// --- permessage-deflate as lws runs it: raw deflate at level 1, one stream
+// per session kept across messages, each message sync flushed. `msgs` are
+// sent in turn, `reset` drops the history between messages ---
+
+static void bench_deflate(
+    size_t iters, char **msgs, size_t nmsgs, size_t cap, bool reset) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    deflateInit2(&z, 1, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+
+    cap = deflateBound(&z, cap) + 64;
+    Bytef *out = malloc(cap);
+    size_t in_total = 0, out_total = 0;
+    for (size_t i = 0; i < iters; ++i) {
+        const char *msg = msgs[i % nmsgs];
+        if (reset) deflateReset(&z);
+
+        z.next_in   = (Bytef *)msg;
+        z.avail_in  = strlen(msg);
+        z.next_out  = out;
+        z.avail_out = cap;
+        in_total += z.avail_in;
+        deflate(&z, Z_SYNC_FLUSH);
+        out_total += cap - z.avail_out;
+    }
+    bench_bytes_in  = in_total / iters;
+    bench_bytes_out = out_total / iters;
+    bench_sink      = z.total_out;
+
+    deflateEnd(&z);
+    free(out);
+}
+
+// keystroke broadcasts, the bulk of the frames of a session: one char typed
+// after the other, each frame differs from the last in its offset, char and
+// trace time
+static void bench_deflate_insert(size_t iters, long arg) {
+    (void)arg;
+    char *msgs[64];
+    for (int i = 0; i < 64; ++i) {
+        struct json_object *res = bench_edit_res(), *ins, *evt;
+        json_object_object_get_ex(res, "insert", &ins);
+        json_object_object_get_ex(res, "event", &evt);
+
+        char s[2] = {'a' + i % 26, '\0'};
+        json_object_object_add(ins, "from", json_object_new_int(120 + i));
+        json_object_object_add(ins, "to", json_object_new_int(120 + i));
+        json_object_object_add(ins, "string", json_object_new_string(s));
+        json_object_object_add(evt, "t", json_object_new_int64(12345 + 97 * i));
+
+        msgs[i] = strdup(
+            json_object_to_json_string_ext(res, JSON_C_TO_STRING_PLAIN));
+        json_object_put(res);
+    }
+
+    bench_deflate(iters, msgs, 64, 256, false);
+    for (int i = 0; i < 64; ++i) free(msgs[i]);
+}
+
+// a whole content of `arg` bytes, as get or a save broadcast carries it:
+// words of a fixed vocabulary in 60 byte rows
+static void bench_deflate_content(size_t iters, long len) {
+    static const char *words[] = {"int", "return", "if", "for", "const",
+        "char", "size_t", "struct", "file", "->", "(", ")", "{", "}", "=",
+        "0", "len", "i", "+", "data", "==", "NULL", "*", ";"};
+    size_t nwords = sizeof(words) / sizeof(words[0]);
+
+    char  *msg = malloc(len + 32);
+    size_t n = 0, row = 0;
+    for (uint64_t i = 1; n < (size_t)len; ++i) {
+        const char *w = words[(i * 2654435761u >> 8) % nwords];
+        n += sprintf(msg + n, "%s ", w);
+        if (n - row >= 60) {
+            msg[n - 1] = '\n';
+            row        = n;
+        }
+    }
+    msg[len] = '\0';
+
+    // far apart in practice, the history holds nothing of the last one
+    bench_deflate(iters, &msg, 1, len, true);
+    free(msg);
+}
+
+static const struct bench benches[] = {
+    {"vec_add",                   bench_vec_add,            0    },
+    {"vec_push_r",                bench_vec_push_r,         0    },
+    {"vec_get_1k",                bench_vec_get,            1024 },
+    {"vec_index_of_64",           bench_vec_index_of,       64   },
+    {"vec_index_of_1k",           bench_vec_index_of,       1024 },
+    {"vec_find_r_64",             bench_vec_find_r,         64   },
+    {"vec_find_r_1k",             bench_vec_find_r,         1024 },
+    {"vec_swap_remove_1k",        bench_vec_swap_remove,    1024 },
+    {"vec_remove_head_64",        bench_vec_remove_head,    64   },
+    {"vec_remove_head_1k",        bench_vec_remove_head,    1024 },
+    {"hmap_get_u64_64",           bench_hmap_get,           64   },
+    {"hmap_get_u64_1k",           bench_hmap_get,           1024 },
+    {"hmap_miss_u64_1k",          bench_hmap_miss,          1024 },
+    {"hmap_put_remove_1k",        bench_hmap_put_remove,    1024 },
+    {"cmd_from_string_insert",    bench_cmd_from_string,    0    },
+    {"cmd_validate_insert",       bench_cmd_validate,       0    },
+    {"jwt_encode",                bench_jwt_encode,         0    },
+    {"jwt_decode",                bench_jwt_decode,         0    },
+    {"snowflake_lock_id_1t",      bench_snowflake_lock_id,  1    },
+    {"snowflake_lock_id_4t",      bench_snowflake_lock_id,  4    },
+    {"snowflake_lock_id_16t",     bench_snowflake_lock_id,  16   },
+    {"content_splice_insert_4k",  bench_splice_insert,      4096 },
+    {"content_splice_insert_64k", bench_splice_insert,      65536},
+    {"content_splice_remove_4k",  bench_splice_remove,      4096 },
+    {"lines_count_64k",           bench_lines_count,        65536},
+    {"lines_position_64k",        bench_lines_position,     65536},
+    {"lines_splice_64k",          bench_lines_splice,       65536},
+    {"utf8_valid_ascii_64k",      bench_utf8_valid_ascii,   65536},
+    {"utf8_valid_64k",            bench_utf8_valid,         65536},
+    {"utf8_to_byte_64k",          bench_utf8_to_byte,       65536},
+    {"diff_one_64k",              bench_diff_one,           65536},
+    {"diff_scattered_64k",        bench_diff_scattered,     65536},
+    {"diff_rewrite_4k",           bench_diff_rewrite,       4096 },
+    {"msg_malloc_32",             bench_msg_malloc,         32   },
+    {"msg_arena_32",              bench_msg_arena,          32   },
+    {"chunk_malloc_200",          bench_chunk_malloc,       200  },
+    {"chunk_pool_200",            bench_chunk_pool,         200  },
+    {"chunk_malloc_16k",          bench_chunk_malloc,       16384},
+    {"chunk_pool_16k",            bench_chunk_pool,         16384},
+    {"res_build_json_insert",     bench_res_build_json,     0    },
+    {"res_serialize_json_insert", bench_res_serialize_json, 0    },
+    {"res_encode_bin_insert",     bench_res_encode_bin,     0    },
+    {"deflate_insert_json",       bench_deflate_insert,     0    },
+    {"deflate_content_16k",       bench_deflate_content,    16384},
+};
+
+static int bench_cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_run(const struct bench *b) {
+    size_t   iters = 1;
+    uint64_t dt    = 0;
+
+    // double the iterations until a run is long enough to time
+    for (;;) {
+        uint64_t start = bench_now_ns();
+        b->fn(iters, b->arg);
+        dt = bench_now_ns() - start;
+
+        if (dt >= BENCH_MIN_NS) break;
+        iters *= dt < BENCH_MIN_NS / 16 ? 8 : 2;
+    }
+
+    bench_bytes_in = bench_bytes_out = 0;
+
+    double ns[BENCH_RUNS];
+    for (int r = 0; r < BENCH_RUNS; ++r) {
+        uint64_t start = bench_now_ns();
+        b->fn(iters, b->arg);
+        ns[r] = (double)(bench_now_ns() - start) / iters;
+    }
+    qsort(ns, BENCH_RUNS, sizeof(double), bench_cmp);
+
+    printf("{\"bench\": \"%s\", \"iters\": %lu, \"runs\": %d, "
+           "\"ns_per_op\": %.3f, \"ns_per_op_min\": %.3f, "
+           "\"ns_per_op_max\": %.3f",
+        b->name, iters, BENCH_RUNS, ns[BENCH_RUNS / 2], ns[0],
+        ns[BENCH_RUNS - 1]);
+    if (bench_bytes_in) {
+        printf(", \"bytes_in\": %lu, \"bytes_out\": %lu", bench_bytes_in,
+            bench_bytes_out);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+int main(int argc, const char **argv) {
+    const char *filter = argc > 1 ? argv[1] : NULL;
+
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+        if (filter && !strstr(benches[i].name, filter)) continue;
+        bench_run(&benches[i]);
+    }
+
+    return 0;
+}
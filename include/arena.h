@@ -0,0 +1,46 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bool.h>
+
+// bump allocator for data living until the end of a message: allocations
+// are never freed one by one, arena_reset releases all of them at once.
+// after a reset that needed more than one chunk, the next first chunk is
+// sized to the peak (up to ARENA_KEEP_MAX) so the steady state is a single
+// chunk and no malloc.
+
+#define ARENA_ALIGN      16
+#define ARENA_CHUNK_SIZE (16 * 1024)
+#define ARENA_KEEP_MAX   (1024 * 1024)
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t              cap;
+    size_t              used;
+    char                data[] __attribute__((aligned(ARENA_ALIGN)));
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t *head; // current chunk, older ones linked by next
+    size_t         chunk_size;
+    size_t         used; // bytes handed out since the last reset
+    size_t         peak; // max of used over all resets
+} arena_t;
+
+arena_t *arena_new(size_t chunk_size);
+void    *arena_alloc(arena_t *arena, size_t size);
+// copy `len` bytes of `str` and a null terminator
+char    *arena_strndup(arena_t *arena, const char *str, size_t len);
+void     arena_reset(arena_t *arena);
+void     arena_drop(arena_t *arena);
+
+// arena of the calling thread for the message being handled, reset by the
+// websocket layer once onmessage returns
+arena_t *arena_msg();
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bool.h>
+#include <error.h>
+#include <proto.h>
+#include <metrics.h>
+
+// websocket traffic capture, replayed by nps_replay
+//
+// the file starts with CAPTURE_MAGIC, then one record per event:
+//   u8 type, varint session, varint dt (us since the previous record)
+//   CAPTURE_OPEN:  varint len, <len bytes> request uri with its query
+//   CAPTURE_FRAME: u8 flags (CAPTURE_BIN), varint len, <len bytes> message
+//   CAPTURE_CLOSE: nothing
+//
+// varints are LEB128 as in proto.h. frames are stored verbatim, so a
+// capture holds tokens and document contents, keep it private
+
+#define CAPTURE_MAGIC     "NPSCAP1\n"
+#define CAPTURE_MAGIC_LEN 8
+
+#define CAPTURE_BIN 0x1
+
+typedef enum {
+    CAPTURE_OPEN  = 1,
+    CAPTURE_FRAME = 2,
+    CAPTURE_CLOSE = 3,
+} capture_type_t;
+
+typedef struct {
+    uint8_t  type;
+    uint32_t session;
+    uint64_t ts_us; // since the first record
+    bool     is_bin;
+
+    char  *data; // uri or message, null-terminated, owned by the reader
+    size_t len;
+} capture_record_t;
+
+// [E]: start capturing to `path`, all functions below are no-op until then,
+// they must be called from the lws service thread
+bool     capture_open(const char *path);
+void     capture_close();
+// new session id, 0 if not capturing
+uint32_t capture_session_open(const char *uri);
+void capture_frame(uint32_t session, bool is_bin, const void *msg, size_t len);
+void capture_session_close(uint32_t session);
+
+typedef struct {
+    FILE    *fp;
+    uint64_t ts_us;
+    char    *buf;
+    size_t   cap;
+} capture_reader_t;
+
+// [E]: open a capture file for reading
+capture_reader_t *capture_reader_open(const char *path);
+// [E]: read the next record, return 1 if read, 0 at the end, -1 if failed.
+// rec->data is valid until the next call
+int  capture_read(capture_reader_t *reader, capture_record_t *rec);
+void capture_reader_close(capture_reader_t *reader);
+
+#endif
@@ -35,8 +35,17 @@ static const char cmd_types[][50] = {
     "delete-file, %s",
 
     "set-user-pointer, %s %ld %ld",
+
+    "insert-at, %s %s %ld %ld %s",
+    "remove-at, %s %s %ld %ld %ld %ld",
+
+    "get-history, %s %s %ld",
+    "get-version, %s %s",
+    "diff, %s %s %s",
 };
 
+#define CMD_TYPES_LEN (sizeof(cmd_types) / sizeof(cmd_types[0]))
+
 #define CMD_INSERT         "insert"
 #define CMD_REMOVE         "remove"
 #define CMD_SAVE           "save"
@@ -57,6 +66,17 @@ static const char cmd_types[][50] = {
 
 #define CMD_SET_USER_POINTER "set-user-pointer"
 
+// insert/remove addressed by row and column, see lines.h
+#define CMD_INSERT_AT "insert-at"
+#define CMD_REMOVE_AT "remove-at"
+
+// version listing by pages and one version with its content
+#define CMD_GET_HISTORY "get-history"
+#define CMD_GET_VERSION "get-version"
+
+// edit script between two versions
+#define CMD_DIFF "diff"
+
 #define CMD_ARG_IS_KIND_OF(kind, of) (strcmp(kind, of) == 0)
 
 #define CMD_ARG_INT    "%ld"
@@ -83,6 +103,11 @@ void   cmd_show(const cmd_t *cmd);
 // [E]: return true if ok, raise error if failed
 bool cmd_validate(const cmd_t *cmd);
 
+// return index of type in cmd_types, -1 if not found
+int cmd_type_index(const char *type);
+// copy the name of cmd_types[idx] to `out`, return `out`
+char *cmd_type_name(int idx, char *out);
+
 // [E]: create new cmd_args with kind and value
 json_object *cmd_args_new(const char *fmt, va_list ap);
 
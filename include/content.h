@@ -0,0 +1,14 @@
+#ifndef __CONTENT_H__
+#define __CONTENT_H__
+
+#include <stdlib.h>
+#include <string.h>
+
+// insert `string` at `from` (string != NULL) or remove [from, to] from
+// `content` of `len` bytes, return the new content, the caller frees both
+//
+// offsets past the end are clamped, the applied ones are written back
+char *content_splice(const char *content, size_t len, size_t *pfrom,
+    size_t *pto, const char *string, size_t string_len);
+
+#endif
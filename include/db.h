@@ -2,12 +2,14 @@
 #define __DB_H__
 
 #include <stdint.h>
-#include <libpq-fe.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <jwt.h>
 #include <bool.h>
 #include <error.h>
 #include <snowflake.h>
+#include <metrics.h>
 
 typedef struct {
     uint64_t id;
@@ -23,7 +25,7 @@ typedef struct db_content_version {
     uint64_t id;
     uint64_t file_id;
     uint64_t update_by;
-    char    *content;
+    char    *content; // NULL in history listings
 
     struct db_content_version *prev;
 } db_content_version_t;
@@ -60,45 +62,118 @@ typedef struct {
 
 void db_file_pers_drop(db_file_pers_t *pers);
 
+// id/name rows of the static tables (file types, permissions)
+typedef struct db_named {
+    int   id;
+    char *name;
+
+    struct db_named *next;
+} db_named_t;
+
+void db_named_drop(db_named_t *named);
+
+// storage backend, every db_* function below dispatches to `ops` of the
+// backend it was opened with. a backend embeds db_t as its first member
+typedef struct db db_t;
+
+struct db_ops {
+    const char *name;
+
+    void (*close)(db_t *db);
+
+    db_named_t *(*get_file_types)(db_t *db);
+    db_named_t *(*get_permissions)(db_t *db);
+
+    db_file_t *(*file_create)(db_t *db, uint64_t owner, uint16_t everyone_can,
+        const char *content, int type_id);
+    db_file_t *(*file_get)(db_t *db, uint64_t file_id, bool get_all_history);
+    db_content_version_t *(*content_version_get)(
+        db_t *db, uint64_t file_id, uint64_t ver_id);
+    bool (*file_history)(db_t *db, uint64_t file_id, uint64_t before,
+        size_t limit, db_content_version_t **phistory);
+    uint64_t (*file_update)(db_t *db, uint64_t file_id, uint64_t update_by,
+        size_t from, size_t to, const char *string);
+    uint64_t (*file_save)(
+        db_t *db, uint64_t file_id, uint64_t user_id, const char *content);
+    bool (*file_delete)(db_t *db, uint64_t file_id);
+    bool (*file_set_per)(db_t *db, uint64_t file_id, int per_id);
+    bool (*file_set_user_per)(
+        db_t *db, uint64_t file_id, uint64_t user_id, int per_id);
+
+    db_file_pers_t *(*file_get_pers)(db_t *db, uint64_t file_id);
+    db_user_pers_t *(*file_get_user_per)(db_t *db, uint64_t user_id);
+    int (*get_user_per_on_file)(db_t *db, uint64_t user_id, uint64_t file_id);
+
+    db_user_t *(*user_add)(db_t *db, const char *username,
+        const char *hash_passwd, const char *email, const char *avatar_url);
+    db_user_t *(*user_get)(db_t *db, uint64_t user_id, const char *username);
+};
+
+struct db {
+    const struct db_ops *ops;
+};
+
+// [E]: postgres backend, `url` is a libpq connection string
+db_t *db_pg_connect(const char *url);
+// in-memory backend, nothing is persisted, see db_mem.c
+db_t *db_mem_new();
+void  db_close(db_t *db);
+
 void db_set_id_gen(snowflake_t *snf);
+// [E]: next id from the generator, 0 if none was set
+uint64_t db_new_id(const char *func);
+
+// key of jwt tokens and password hashes, set by the server at startup
+extern const char *secret_key;
 
-PGresult *db_get_file_types(PGconn *conn);
-PGresult *db_get_permissions(PGconn *conn);
+db_named_t *db_get_file_types(db_t *db);
+db_named_t *db_get_permissions(db_t *db);
 
 // [E]: create file on db
-db_file_t *db_file_create(PGconn *conn, uint64_t owner, uint16_t everyone_can,
+db_file_t *db_file_create(db_t *db, uint64_t owner, uint16_t everyone_can,
     const char *content, int type_id);
 // [E]: get file from db
-db_file_t *db_file_get(PGconn *conn, uint64_t file_id, bool get_all_history);
+db_file_t *db_file_get(db_t *db, uint64_t file_id, bool get_all_history);
+
+// [E]: get one content version of a file from db
+db_content_version_t *db_content_version_get(
+    db_t *db, uint64_t file_id, uint64_t ver_id);
+
+#define DB_HISTORY_PAGE_MAX 100
+
+// [E]: a page of the versions of a file older than version `before` (0:
+// from the newest) to `*phistory`, newest first and without their content.
+// `limit` is capped to DB_HISTORY_PAGE_MAX, 0: the max. false if failed
+bool db_file_history(db_t *db, uint64_t file_id, uint64_t before,
+    size_t limit, db_content_version_t **phistory);
 
 // [E]: insert/remove content in a file from db, return new version id, 0 if
 // failed
-uint64_t db_file_update(PGconn *conn, uint64_t file_id, uint64_t update_by,
+uint64_t db_file_update(db_t *db, uint64_t file_id, uint64_t update_by,
     size_t from, size_t to, const char *string);
 
 // [E]: save file to db, return 0 if failed otherwise return new version id
-uint64_t db_file_save(PGconn *conn, uint64_t file_id, const uint64_t user_id,
-    const char *content);
+uint64_t db_file_save(
+    db_t *db, uint64_t file_id, const uint64_t user_id, const char *content);
 
 // [E]: delete file from db
-bool db_file_delete(PGconn *conn, uint64_t file_id);
+bool db_file_delete(db_t *db, uint64_t file_id);
 // [E]: set file permissions
-bool db_file_set_per(PGconn *conn, uint64_t file_id, int per_id);
+bool db_file_set_per(db_t *db, uint64_t file_id, int per_id);
 // [E]: set file permissions for an user
 bool db_file_set_user_per(
-    PGconn *conn, uint64_t file_id, uint64_t user_id, int per_id);
+    db_t *db, uint64_t file_id, uint64_t user_id, int per_id);
 
-db_file_pers_t *db_file_get_pers(PGconn *conn, uint64_t file_id);
-db_user_pers_t *db_file_get_user_per(PGconn *conn, uint64_t user_id);
-int  db_get_user_per_on_file(PGconn *conn, uint64_t user_id, uint64_t file_id);
+db_file_pers_t *db_file_get_pers(db_t *db, uint64_t file_id);
+db_user_pers_t *db_file_get_user_per(db_t *db, uint64_t user_id);
+int  db_get_user_per_on_file(db_t *db, uint64_t user_id, uint64_t file_id);
 bool db_user_has_per_on_file(
-    PGconn *conn, uint64_t user_id, uint64_t file_id, int permission_type);
+    db_t *db, uint64_t user_id, uint64_t file_id, int permission_type);
 
 // [E]: create new user
-db_user_t *db_user_add(PGconn *conn, const char *username, const char *passwd,
+db_user_t *db_user_add(db_t *db, const char *username, const char *passwd,
     const char *email, const char *avatar_url);
-db_user_t *db_user_get(PGconn *conn, uint64_t user_id, const char *username);
-db_user_t *db_user_login(
-    PGconn *conn, const char *username, const char *passwd);
+db_user_t *db_user_get(db_t *db, uint64_t user_id, const char *username);
+db_user_t *db_user_login(db_t *db, const char *username, const char *passwd);
 
 #endif
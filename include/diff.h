@@ -0,0 +1,39 @@
+#ifndef __DIFF_H__
+#define __DIFF_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vec.h>
+
+// edit script between two contents, to send the bytes that changed instead
+// of a whole version.
+//
+// the common prefix and suffix are trimmed first (16 bytes per step with
+// SSE2), what is left is diffed with Myers' linear space bisection, trimming
+// again around every split and comparing the snakes with the same SIMD
+// loop. a region needing more than DIFF_MAX_D edits is split after the
+// furthest path found, or replaced as a whole if that path is mostly edits:
+// the script stays correct but is no longer minimal there.
+
+#define DIFF_MAX_D 256
+
+typedef struct {
+    size_t from;     // offset in the old content
+    size_t removed;  // bytes of the old content removed at `from`
+    size_t at;       // offset in the new content, the hunks before applied
+    size_t inserted; // bytes of the new content inserted at `at`
+} diff_hunk_t;
+
+// bytes equal at the start / at the end of `a` and `b`
+size_t diff_prefix(const char *a, size_t alen, const char *b, size_t blen);
+size_t diff_suffix(const char *a, size_t alen, const char *b, size_t blen);
+
+// Vec<diff_hunk_t> turning `a` into `b`, applied in order: remove `removed`
+// bytes at `at`, then insert b[at, at + inserted) there. hunks are apart
+// and start and end on character boundaries of both contents if they are
+// utf-8. the caller drops it
+vec_t *diff_hunks(const char *a, size_t alen, const char *b, size_t blen);
+
+#endif
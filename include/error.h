@@ -6,16 +6,25 @@
 #include <string.h>
 #include <stdarg.h>
 
+// errors live in a per-thread ring of ERROR_RING_SIZE slots, raising and
+// reading never allocate. unread errors older than ERROR_RING_SIZE raises are
+// overwritten, messages are truncated to ERROR_MSG_MAX - 1 bytes
+#define ERROR_RING_SIZE 8
+#define ERROR_MSG_MAX   512
+
 typedef struct error {
     int           code;
     char         *message;
     struct error *prev;
 } error_t;
 
+// last unread error of the calling thread, NULL if none. it stays valid until
+// ERROR_RING_SIZE more errors are raised on the same thread
 error_t *get_error();
 
 void raise_error(int code, const char *message, ...)
     __attribute__((format(printf, 2, 3)));
+// nothing to free, kept so callers do not depend on the storage
 void destroy_error(error_t *err);
 
 #endif
@@ -0,0 +1,126 @@
+// clang-format off
+#ifndef __HMAP_H__
+#define __HMAP_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bool.h>
+
+// open addressing hash map, swiss table layout: one control byte per slot
+// holds 7 bits of the hash (or EMPTY/DELETED) and lookups scan
+// HMAP_GROUP control bytes at once, with SSE2 when available. slots store
+// the key then the value inline, a map with val_size 0 is a set.
+//
+// value pointers returned by hmap_get/hmap_put are valid until the next
+// insertion or removal.
+
+#define HMAP_GROUP 16
+
+typedef uint64_t (*hmap_hash_t)(const void *key);
+typedef int (*hmap_cmp_t)(const void *, const void *); // 0 if equal
+typedef void (*hmap_val_drop_t)(void *val);
+
+typedef struct {
+    size_t key_size;
+    size_t val_size;
+    size_t val_off;   // offset of the value in a slot
+    size_t slot_size;
+
+    size_t   len;
+    size_t   cap;         // slots, power of two, multiple of HMAP_GROUP
+    size_t   growth_left; // insertions into EMPTY slots before a rehash
+    uint8_t *ctrl;
+    void    *slots;
+
+    hmap_hash_t     hash;     // NULL: 8-byte keys mixed, others hashed bytes
+    hmap_cmp_t      cmp;      // NULL: memcmp
+    hmap_val_drop_t val_drop; // NULL: nothing to drop
+} hmap_t;
+
+hmap_t *hmap_new(
+    size_t          key_size,
+    size_t          val_size,
+    hmap_hash_t     hash,
+    hmap_cmp_t      cmp,
+    hmap_val_drop_t val_drop
+);
+// value of `key`, NULL if absent
+void  *hmap_get(hmap_t *map, const void *key);
+// insert or replace (the old value is dropped), return the stored value
+void  *hmap_put(hmap_t *map, const void *key, const void *val);
+// value slot of `key`, inserted uninitialized if absent (`*found` false)
+void  *hmap_entry(hmap_t *map, const void *key, bool *found);
+// remove and drop the value, false if absent
+bool   hmap_remove(hmap_t *map, const void *key);
+// room for `n` elements in total without rehashing
+bool   hmap_reserve(hmap_t *map, size_t n);
+void   hmap_clear(hmap_t *map);
+void   hmap_drop(hmap_t *map);
+// iterate from *pos = 0, false once every element was visited. `key`/`val`
+// may be NULL. the map must not be modified while iterating
+bool   hmap_next(hmap_t *map, size_t *pos, void **key, void **val);
+
+uint64_t hmap_hash_u64(uint64_t key);
+uint64_t hmap_hash_bytes(const void *data, size_t len);
+
+// uint64_t and pointer keys, hashed with hmap_hash_u64
+#define hmap_new_u64(val_size, val_drop)                                       \
+    hmap_new(sizeof(uint64_t), val_size, NULL, NULL, val_drop)
+#define hmap_new_ptr(val_size, val_drop)                                       \
+    hmap_new(sizeof(void *), val_size, NULL, NULL, val_drop)
+
+#define hmap_new_r(ktype, vtype, val_drop)                                     \
+    hmap_new(sizeof(ktype), sizeof(vtype), NULL, NULL, val_drop)
+
+// typed wrappers taking the key by value
+
+#define hmap_get_r(ktype, map, key)                                            \
+    ({                                                                         \
+        ktype _key = key;                                                      \
+        hmap_get(map, &_key);                                                  \
+    })
+
+#define hmap_put_r(ktype, vtype, map, key, val)                                \
+    ({                                                                         \
+        ktype _key = key;                                                      \
+        vtype _val = val;                                                      \
+        (vtype *)hmap_put(map, &_key, &_val);                                  \
+    })
+
+#define hmap_entry_r(ktype, vtype, map, key, found)                            \
+    ({                                                                         \
+        ktype _key = key;                                                      \
+        (vtype *)hmap_entry(map, &_key, found);                                \
+    })
+
+#define hmap_remove_r(ktype, map, key)                                         \
+    ({                                                                         \
+        ktype _key = key;                                                      \
+        hmap_remove(map, &_key);                                               \
+    })
+
+// for (key, val) in map, `kptr`/`vptr` are pointer variables declared by the
+// caller; the map must not be modified in the body
+#define hmap_foreach(map, kptr, vptr)                                          \
+    for (size_t _pos = 0;                                                      \
+         hmap_next(map, &_pos, (void **)&(kptr), (void **)&(vptr));)
+
+// sets
+
+#define hset_new_u64() hmap_new(sizeof(uint64_t), 0, NULL, NULL, NULL)
+#define hset_new_ptr() hmap_new(sizeof(void *), 0, NULL, NULL, NULL)
+
+// add `key`, false if it was already in the set
+#define hset_add_r(ktype, set, key)                                            \
+    ({                                                                         \
+        bool _found;                                                           \
+        hmap_entry_r(ktype, char, set, key, &_found);                          \
+        !_found;                                                               \
+    })
+#define hset_has_r(ktype, set, key)    (hmap_get_r(ktype, set, key) != NULL)
+#define hset_remove_r(ktype, set, key) hmap_remove_r(ktype, set, key)
+
+#endif
+// clang-format on
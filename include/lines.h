@@ -0,0 +1,42 @@
+#ifndef __LINES_H__
+#define __LINES_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bool.h>
+
+// line-start index of a content, kept up to date with lines_splice so rows
+// and columns convert to byte offsets without rescanning the text. rows and
+// columns count from 0, columns in bytes, a row ends before its '\n'.
+//
+// row -> offset is a lookup, offset -> row a binary search over the starts.
+// a splice scans the inserted string and shifts the starts of the rows
+// after it.
+
+typedef struct {
+    size_t *starts; // starts[row]: offset of its first byte, starts[0] = 0
+    size_t  rows;   // >= 1, an empty content has one empty row
+    size_t  cap;
+    size_t  len; // bytes of the content
+} lines_t;
+
+lines_t *lines_new(const char *content, size_t len);
+void     lines_drop(lines_t *lines);
+
+// '\n' in the `len` bytes at `data`
+size_t lines_count(const char *data, size_t len);
+
+// offset of (row, col): a row past the last one is the end of the content,
+// a column past the end of its row the end of the row
+size_t lines_offset(const lines_t *lines, size_t row, size_t col);
+// row and column of `offset`, clamped to the content
+void lines_position(
+    const lines_t *lines, size_t offset, size_t *prow, size_t *pcol);
+
+// [pos, pos + removed) of the content was replaced by `string`
+void lines_splice(lines_t *lines, size_t pos, size_t removed,
+    const char *string, size_t string_len);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <bool.h>
+#include <error.h>
+#include <metrics.h>
+
+// structured logger: log_emit copies a fixed-size record into a ring owned
+// by the calling thread, a background thread formats and writes it. a full
+// ring drops the record (counted in nps_log_dropped_total), it never blocks.
+//
+//   2026-10-19T08:00:00.123456Z info ws_open wsi=94237 user=alice
+//
+// `event` and the field keys must outlive the process (string literals),
+// only `str` is copied, truncated to LOG_STR_MAX - 1 bytes.
+
+#define LOG_FIELDS_MAX 4
+#define LOG_STR_MAX    48
+#define LOG_RING_SIZE  4096 // records per thread, power of two
+#define LOG_FLUSH_MS   10
+
+typedef enum {
+    LOG_ERR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG,
+    LOG_LEVELS,
+} log_level_t;
+
+typedef struct {
+    uint64_t    ts; // us, wall clock
+    const char *event;
+    const char *keys[LOG_FIELDS_MAX];
+    uint64_t    vals[LOG_FIELDS_MAX];
+    const char *str_key;
+    char        str[LOG_STR_MAX];
+    uint8_t     level;
+    uint8_t     n;
+} log_record_t;
+
+extern log_level_t log_level;
+
+// [E]: start the writer thread, records go to `path` (appended) or stdout if
+// NULL. 1 of every `sample` log_sampled calls passes (0 or 1: all)
+bool log_init(log_level_t level, unsigned sample, const char *path);
+// write what is left and stop the writer thread
+void log_close();
+
+// "err", "warn", "info", "debug", `def` if NULL or unknown
+log_level_t log_level_parse(const char *s, log_level_t def);
+
+#define log_on(level) ((level) <= log_level)
+
+// per thread 1 in `sample` counter, for per-message events
+bool log_sampled();
+
+// `n` pairs of (const char *key, uint64_t val) follow, `str_key`/`str` is an
+// optional string field (str_key NULL: none)
+void log_emit(log_level_t level, const char *event, const char *str_key,
+    const char *str, int n, ...);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <bool.h>
+#include <cmd.h>
+
+// log-linear (hdr style) buckets: values below 2^METRICS_MIN_EXP ns share
+// bucket 0, then every power of two is split into METRICS_SUB_BUCKETS
+#define METRICS_MIN_EXP     10 // ~1us
+#define METRICS_MAX_EXP     37 // ~137s
+#define METRICS_SUB_BITS    2
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_BUCKETS                                                        \
+    ((METRICS_MAX_EXP - METRICS_MIN_EXP) * METRICS_SUB_BUCKETS + 2)
+
+// one series per cmd_types entry, the last one counts unparsable messages
+#define METRICS_CMD_INVALID CMD_TYPES_LEN
+#define METRICS_CMD_MAX     (CMD_TYPES_LEN + 1)
+#define METRICS_DB_MAX      64
+
+typedef enum {
+    METRICS_WS_OPENED,
+    METRICS_WS_CLOSED,
+    METRICS_WS_MESSAGES,
+    METRICS_WS_BYTES_IN,
+    METRICS_HTTP_REQUESTS,
+    METRICS_LOG_DROPPED,
+    METRICS_OT_REBASED,
+    METRICS_OT_STALE,
+    METRICS_EDITS_COALESCED,
+    METRICS_WS_BATCHED,
+    METRICS_SAVES_DELTA,
+    METRICS_COUNTER_MAX,
+} metrics_counter_t;
+
+typedef struct {
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t count;
+    uint64_t sum; // ns
+} metrics_hist_t;
+
+// monotonic clock in nanoseconds
+uint64_t metrics_now_ns();
+
+// recording is lock-free, every thread only writes to its own counters
+void metrics_inc(metrics_counter_t counter, uint64_t val);
+void metrics_cmd_observe(int cmd_idx, uint64_t nsec);
+// `stmt` must outlive the process, it is used as key by address
+void metrics_db_observe(const char *stmt, uint64_t nsec);
+void metrics_loop_lag_observe(uint64_t nsec);
+
+// write all counters and histograms in prometheus text format
+void metrics_render(FILE *fp);
+void metrics_render_gauge(
+    FILE *fp, const char *name, const char *help, double val);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __OT_H__
+#define __OT_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bool.h>
+#include <error.h>
+#include <vec.h>
+#include <hmap.h>
+#include <utf8.h>
+
+// operational transform of byte-offset edits, the server side of a
+// jupiter-style protocol: every applied edit bumps the revision of the
+// file, a client tags its edits with the last revision it has seen (its
+// base) and keeps sending while they are unacknowledged.
+//
+// per sender the log keeps the edits of others applied after its base, in
+// the sender's context: each incoming edit is transformed over them and
+// they over it, as the sender does with the broadcasts it receives while
+// its own edits are in flight. both sides use ot_transform, with the edit
+// applied first by the server winning the ties:
+//   - an insert at the position of a concurrent one goes after it
+//   - an insert at the start or end of a concurrent removal survives
+//   - an insert strictly inside a concurrent removal is removed with it
+//
+// a sender counts its offsets in one utf8_unit_t, every op is kept in all
+// of them so the ones queued for it are in its unit too.
+
+#define OT_HISTORY 512 // ops kept per open file, power of two
+
+typedef struct {
+    uint64_t rev; // revision this op produced
+    uint64_t src; // sender, see ot_peer_t
+    size_t   pos;
+    size_t   len; // bytes inserted or removed, 0: no-op
+    bool     insert;
+} ot_op_t;
+
+typedef struct {
+    uint64_t    seen;  // last revision looked at for `queue`
+    vec_t      *queue; // Vec<ot_op_t>, ops of others after the sender's base
+    utf8_unit_t unit;  // of the sender's offsets and of `queue`
+} ot_peer_t;
+
+typedef struct {
+    uint64_t rev;   // revision of the content, starts at 1
+    uint64_t floor; // oldest base revision an op can be rebased from
+    // ops[rev % OT_HISTORY][unit] for rev in (floor, rev]
+    ot_op_t ops[OT_HISTORY][UTF8_UNITS];
+    hmap_t *peers; // HashMap<uint64_t src, ot_peer_t>
+} ot_log_t;
+
+ot_log_t *ot_log_new();
+void      ot_log_drop(ot_log_t *log);
+
+// transform `op` so it applies after `by`, both made on the same content.
+// `op_first`: `op` was applied first by the server and wins the ties
+void ot_transform(ot_op_t *op, const ot_op_t *by, bool op_first);
+
+// [E]: transform `op` of op->src, counted in `unit` and made at revision
+// `base` after the sender's unacknowledged ops, to apply on the current
+// content. false if `base` is older than the history or newer than the log
+bool ot_log_rebase(
+    ot_log_t *log, uint64_t base, utf8_unit_t unit, ot_op_t *op);
+// [E]: true if every op applied after `base` is one of src's own, the
+// content of the sender is then the current one
+bool ot_log_synced(ot_log_t *log, uint64_t base, uint64_t src);
+// record an applied op counted in each unit, return the revision it produced
+uint64_t ot_log_push(ot_log_t *log, ot_op_t ops[UTF8_UNITS]);
+// the content was replaced as a whole, ops made before can't be rebased
+uint64_t ot_log_reset(ot_log_t *log);
+// drop what is kept for a sender that left
+void ot_log_forget(ot_log_t *log, uint64_t src);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <bool.h>
+#include <vec.h>
+
+// size-classed slab pool for message buffers: class i holds blocks of
+// POOL_MIN_SIZE << i bytes, freed blocks are kept in a per-thread list of the
+// class (up to POOL_KEEP_BYTES) and handed out again before calling malloc.
+// bigger requests go straight to malloc. a block may be freed by any thread,
+// it joins the list of that thread.
+
+#define POOL_MIN_SHIFT  6 // 64 bytes
+#define POOL_MIN_SIZE   (1lu << POOL_MIN_SHIFT)
+#define POOL_CLASSES    11 // up to 64 KiB
+#define POOL_KEEP_BYTES (512 * 1024)
+#define POOL_VECS_MAX   256 // recycled vecs per thread
+
+typedef struct {
+    uint64_t hits;     // served from the free list
+    uint64_t misses;   // malloc'd
+    uint64_t releases; // freed back to malloc, the list was full
+} pool_stats_t;
+
+void *pool_alloc(size_t size);
+void  pool_free(void *ptr);
+
+// empty vec, recycled from a previous pool_vec_free when possible. the
+// element type is fixed per thread list by `elm_size`
+vec_t *pool_vec_new(size_t elm_size, vec_elm_drop_t drop);
+// drop the elements, keep the vec and its storage for pool_vec_new
+void   pool_vec_free(vec_t *vec);
+
+// stats of all threads, `cls` POOL_CLASSES is the oversized requests,
+// POOL_CLASSES + 1 is the vecs
+void pool_stats(size_t cls, pool_stats_t *stats);
+// write the stats in prometheus text format
+void pool_render(FILE *fp);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef __PROTO_H__
+#define __PROTO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <bool.h>
+#include <error.h>
+
+// binary protocol, negotiated with `?proto=bin` on connect
+//
+// every frame is a sequence of LEB128 varints, the first one is the op code:
+//   insert: op file_id ver_id user_id from to len <len bytes> [rev]
+//   remove: op file_id ver_id user_id from to [rev]
+//   cursor: op file_id user_id ws_id row column
+//   ack:    op file_id ver_id rev
+//   batch:  op count, then count times: len <frame of len bytes>
+//
+// clients send ver_id/ws_id as 0, the server fills them in broadcasts.
+// `rev` of an edit is the base revision it was made at when sent by a client
+// (absent or 0: applied as is, see ot.h) and the revision it produced in
+// broadcasts. an edit sent with a base revision is answered with an ack
+// carrying its own revision. batches are only sent by the server, to
+// sessions connected with `?batch=1`
+
+#define PROTO_NAME "bin"
+
+#define PROTO_VARINT_MAX 10
+
+typedef enum {
+    PROTO_OP_INSERT = 1,
+    PROTO_OP_REMOVE = 2,
+    PROTO_OP_CURSOR = 3,
+    PROTO_OP_ACK    = 4,
+    PROTO_OP_BATCH  = 5,
+} proto_op_type_t;
+
+typedef struct {
+    uint8_t  op;
+    uint64_t file_id;
+    uint64_t ver_id;
+    uint64_t user_id;
+    uint64_t ws_id;
+    uint64_t from; // row for cursor
+    uint64_t to;   // column for cursor
+    uint64_t rev;
+
+    const char *string; // insert only, NOT null-terminated
+    size_t      string_len;
+} proto_op_t;
+
+size_t proto_varint_encode(uint64_t val, uint8_t *out);
+// return number of bytes read, 0 if failed
+size_t proto_varint_decode(const uint8_t *in, size_t len, uint64_t *val);
+
+// upper bound of the encoded length of op
+size_t proto_encoded_len(const proto_op_t *op);
+// return number of bytes written, 0 if `cap` is too small
+size_t proto_encode(const proto_op_t *op, uint8_t *out, size_t cap);
+
+// [E]: decode a frame, op->string points into `in`
+bool proto_decode(const uint8_t *in, size_t len, proto_op_t *op);
+
+// op and count of a batch, each frame follows as its varint length and
+// bytes. return number of bytes written, at most 2 * PROTO_VARINT_MAX
+size_t proto_batch_header(uint64_t count, uint8_t *out);
+// [E]: read the header of a batch frame, return the offset of its first
+// frame, 0 if failed
+size_t proto_batch_begin(const uint8_t *in, size_t len, uint64_t *pcount);
+// [E]: the frame at `*ppos` of a batch, `*ppos` is moved past it. false if
+// truncated
+bool proto_batch_next(const uint8_t *in, size_t len, size_t *ppos,
+    const uint8_t **pframe, size_t *pframe_len);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __ROUTE_H__
+#define __ROUTE_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bool.h>
+
+#define ROUTE_MAX_PARAMS 4
+#define ROUTE_NAME_MAX   32
+#define ROUTE_VALUE_MAX  128
+
+typedef struct {
+    int  len;
+    char names[ROUTE_MAX_PARAMS][ROUTE_NAME_MAX];
+    char values[ROUTE_MAX_PARAMS][ROUTE_VALUE_MAX];
+} route_params_t;
+
+// match `path` against `pattern`, `{name}` segments are captured into params
+// e.g. "/files/{id}" matches "/files/42" with id = "42"
+bool route_match(
+    const char *pattern, const char *path, route_params_t *params);
+
+// return NULL if not found
+const char *route_param(const route_params_t *params, const char *name);
+// return false if not found or not an unsigned integer
+bool route_param_u64(
+    const route_params_t *params, const char *name, uint64_t *val);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/time.h>
+
+#include <bool.h>
+#include <cmd.h>
+#include <metrics.h>
+
+// per-op latency traces for insert/remove, all functions must be called from
+// the lws service thread
+
+#define TRACE_ID_MAX     40
+#define TRACE_ACTIVE_MAX 256
+#define TRACE_RING_MAX   1024
+
+typedef enum {
+    TRACE_RECV,     // last fragment received
+    TRACE_VALIDATE, // command parsed and checked
+    TRACE_DB,       // db write done
+    TRACE_ENQUEUE,  // broadcast queued to every subscriber
+    TRACE_WRITE,    // first broadcast frame handed to lws_write
+    TRACE_PHASES,
+} trace_phase_t;
+
+typedef struct {
+    char     id[TRACE_ID_MAX];
+    int      cmd;
+    uint64_t file_id;
+    uint64_t client_ts; // ms, client clock, 0 if not sent
+    uint64_t server_ts; // ms, wall clock at TRACE_RECV
+
+    uint64_t ts[TRACE_PHASES]; // ns, monotonic
+    uint64_t write_last;       // ns, last broadcast frame written
+    uint32_t writes;           // frames written
+    uint32_t pending;          // frames still queued
+
+    uint32_t gen;
+    bool     active;
+    bool     ended; // trace_end called
+} trace_t;
+
+// sample 1 of every `sample` ops without a client trace id (0: none),
+// completed traces are also appended to `path` as json lines if not NULL
+void trace_init(unsigned sample, const char *path);
+
+// start a trace if `id` is given or the op is sampled, NULL otherwise
+trace_t *trace_begin(const char *id, uint64_t client_ts, uint64_t recv_ns,
+    int cmd, uint64_t file_id);
+void     trace_mark(trace_t *trace, trace_phase_t phase);
+// frames queued by my_ws_send while `trace` is current are attached to it
+void     trace_set_current(trace_t *trace);
+// done queueing, the trace is emitted once its frames are written
+void     trace_end(trace_t *trace);
+
+// handle of the current trace for a queued frame, 0 if none
+uint64_t trace_ref();
+// the frame holding `ref` was written (or dropped if !written)
+void     trace_release(uint64_t ref, bool written);
+
+// completed traces, oldest first, as a json array
+void trace_dump(FILE *fp);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef __UTF8_H__
+#define __UTF8_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bool.h>
+
+// offsets counted in code points or UTF-16 units, as clients written in
+// languages with such strings do, instead of the bytes stored.
+//
+// utf8_index_t counts the code points and UTF-16 units before every
+// UTF8_BLOCK bytes of a content. a splice only invalidates the blocks after
+// it, they are counted again (16 bytes per step with SSE2) by the next
+// conversion past them. a conversion is then a binary search over the
+// blocks and a scan of at most one block, and a no-op while the content is
+// all ASCII.
+
+#define UTF8_BLOCK 256
+
+typedef enum {
+    UTF8_BYTES,
+    UTF8_CODE_POINTS,
+    UTF8_UTF16,
+    UTF8_UNITS,
+} utf8_unit_t;
+
+typedef struct {
+    size_t *cps;   // code points before block k, cps[0] = 0
+    size_t *u16s;  // UTF-16 units before block k
+    size_t  valid; // blocks whose counts are up to date, >= 1
+    size_t  cap;
+    size_t  len;  // bytes of the content
+    size_t  wide; // bytes >= 0x80 in the content, 0: every unit is a byte
+} utf8_index_t;
+
+// well-formed utf-8: no overlong forms, surrogates or code points past
+// U+10FFFF
+bool utf8_valid(const char *s, size_t len);
+// `offset` is not inside a character of the `len` bytes at `s`
+bool utf8_boundary(const char *s, size_t len, size_t offset);
+// `unit`s in the `len` bytes at `data`
+size_t utf8_count(const char *data, size_t len, utf8_unit_t unit);
+
+// "bytes", "cp", "utf16", `def` if NULL or unknown
+utf8_unit_t utf8_unit_parse(const char *s, utf8_unit_t def);
+const char *utf8_unit_name(utf8_unit_t unit);
+
+utf8_index_t *utf8_index_new(const char *content, size_t len);
+void          utf8_index_drop(utf8_index_t *idx);
+
+// byte offset of the `n`th `unit` of `content`, clamped to the content. an
+// offset between the two UTF-16 units of a character is its start
+size_t utf8_index_to_byte(
+    utf8_index_t *idx, const char *content, utf8_unit_t unit, size_t n);
+// `unit`s before byte `offset` of `content`
+size_t utf8_index_from_byte(
+    utf8_index_t *idx, const char *content, utf8_unit_t unit, size_t offset);
+
+// the `removed_len` bytes at `pos` of the content were replaced by `string`
+void utf8_index_splice(utf8_index_t *idx, size_t pos, const char *removed,
+    size_t removed_len, const char *string, size_t string_len);
+
+#endif
@@ -15,9 +15,9 @@ typedef struct {
     size_t cap;
     void  *arr;
 
-    vec_elm_cpy_t  elm_cpy;
-    vec_elm_cmp_t  elm_cmp;
-    vec_elm_drop_t elm_drop;
+    vec_elm_cpy_t  elm_cpy;  // NULL: memcpy
+    vec_elm_cmp_t  elm_cmp;  // NULL: memcmp
+    vec_elm_drop_t elm_drop; // NULL: nothing to drop
 } vec_t;
 
 vec_t *vec_new(
@@ -27,12 +27,23 @@ vec_t *vec_new(
     vec_elm_drop_t  elm_drop
 );
 int    vec_add(vec_t *vec, void *elm);
+// append `n` elements stored contiguously at `elms`
+int    vec_extend(vec_t *vec, const void *elms, size_t n);
+// room for at least `n` more elements without growing
+int    vec_reserve(vec_t *vec, size_t n);
+// remove keeping the order, the tail is shifted
 int    vec_remove(vec_t *vec, size_t idx);
+// remove moving the last element to `idx`, O(1) but the order changes
+int    vec_swap_remove(vec_t *vec, size_t idx);
+// drop every element, the storage is kept
+void   vec_clear(vec_t *vec);
 size_t vec_index_of(vec_t *vec, void *elm);
 void  *vec_get(vec_t *vec, size_t idx);
 void   vec_drop(vec_t *vec);
 
 #define vec_remove_by(vec, elm) vec_remove(vec, vec_index_of(vec, elm))
+#define vec_swap_remove_by(vec, elm)                                           \
+    vec_swap_remove(vec, vec_index_of(vec, elm))
 
 #define vec_new_r(type, ...) vec_new(sizeof(type), __VA_ARGS__)
 
@@ -56,5 +67,40 @@ void   vec_drop(vec_t *vec);
         vec_remove_by(vec, &tmp);                                              \
     })
 
+// typed inline access for vecs without elm_cpy/elm_cmp, no bounds check and
+// no callback: `type` must match the element type of `vec`
+
+#define vec_at_r(type, vec, idx) (((type *)(vec)->arr)[idx])
+
+#define vec_push_r(type, vec, elm)                                             \
+    ({                                                                         \
+        vec_t *_v   = (vec);                                                   \
+        type   _elm = elm;                                                     \
+        _v->len < _v->cap                                                      \
+            ? (((type *)_v->arr)[_v->len++] = _elm, 1)                         \
+            : vec_add(_v, &_elm);                                              \
+    })
+
+// index of the first element == `elm`, -1lu if none, for scalars/pointers
+#define vec_find_r(type, vec, elm)                                             \
+    ({                                                                         \
+        vec_t *_v   = (vec);                                                   \
+        type   _elm = elm;                                                     \
+        size_t _idx = -1lu;                                                    \
+        for (size_t _i = 0; _i < _v->len; ++_i) {                              \
+            if (((type *)_v->arr)[_i] == _elm) {                               \
+                _idx = _i;                                                     \
+                break;                                                         \
+            }                                                                  \
+        }                                                                      \
+        _idx;                                                                  \
+    })
+
+#define vec_swap_remove_by_r(type, vec, elm)                                   \
+    ({                                                                         \
+        vec_t *_vs = (vec);                                                    \
+        vec_swap_remove(_vs, vec_find_r(type, _vs, elm));                      \
+    })
+
 #endif
 // clang-format on
@@ -6,14 +6,23 @@
 
 #include <bool.h>
 #include <vec.h>
+#include <hmap.h>
 #include <db.h>
+#include <ot.h>
+#include <lines.h>
 
 #define MY_RING_DEPTH 4096
 #define MY_PSS_SIZE   2048
+#define MY_FRAG_MAX   (256 * 1024)
+#define MY_BATCH_MAX  (64 * 1024) // bytes of messages merged into one frame
+
+#define MY_WS_PROTOCOL_NAME "cce"
 
 struct my_msg {
     void  *payload;
     size_t len;
+    size_t   sent;  // bytes already handed to lws_write
+    uint64_t trace; // trace handle, see trace.h
     bool   is_first : 1;
     bool   is_last  : 1;
     bool   is_bin   : 1;
@@ -24,39 +33,75 @@ struct my_per_session_data {
 
     vec_t     *v_read;  // Vec<struct my_msg>
     vec_t     *v_write; // Vec<struct my_msg>
+    size_t     frag_size;
+    uint64_t   recv_ns; // first fragment of the current message
     db_user_t *user;
     db_file_t *file;
+    bool       bin_proto;  // edits/cursors as binary frames, see proto.h
+    bool       batch;      // `?batch=1`, queued messages merged per write
+    uint8_t    unit;       // utf8_unit_t of edit offsets, `?unit=`
+    uint32_t   capture_id; // 0 if not captured, see capture.h
 };
 
 struct my_http_ss {
-    char  *path;
-    vec_t *v_read;  // Vec<struct my_msg>
-    vec_t *v_write; // Vec<struct my_msg>
+    char       *path;
+    const char *method;  // until the request is handed to onrequest
+    vec_t      *v_read;  // Vec<struct my_msg>
+    vec_t      *v_write; // Vec<struct my_msg>
+    size_t      frag_size;
+};
+
+// consecutive edits of one user, applied to the cached content and written
+// to db as a single version when the run ends
+struct file_run {
+    lws_sorted_usec_list_t sul; // ends the run after the coalesce window
+    db_file_t             *file;
+    uint64_t               user_id;
+    size_t                 cursor; // offset right after the last edit
+    size_t                 edits;  // 0: no run
 };
 
 struct file_info {
-    db_file_t *file;
-    vec_t     *wsis; // Vec<struct lws*>
+    db_file_t       *file;
+    vec_t           *wsis;  // Vec<struct lws*>
+    ot_log_t        *ot;    // edits applied since the file was opened
+    lines_t         *lines; // line starts of the cached content
+    utf8_index_t    *utf8;  // unit offsets of the cached content
+    struct file_run *run;   // allocated apart, the timer must not move
 };
 
 struct my_per_vhost_data {
     vec_t *pss_list; // Vec<struct my_per_session_data*>
-    vec_t *files;    // Vec<struct file_info>
+    hmap_t *files;    // HashMap<uint64_t file id, struct file_info>
 };
 
 typedef void (*onopen_t)(struct lws *wsi);
 typedef void (*onclose_t)(struct lws *wsi);
 typedef void (*onmessage_t)(
     struct lws *wsi, const void *msg, size_t len, bool is_bin);
-typedef void (*onrequest_t)(
-    struct lws *wsi, const char *path, const char *body, size_t len);
+typedef void (*onrequest_t)(struct lws *wsi, const char *method,
+    const char *path, const char *body, size_t len);
+typedef void (*ondestroy_t)(struct my_per_vhost_data *vhd);
 
 struct my_ws {
     onopen_t    onopen;
     onclose_t   onclose;
     onmessage_t onmessage;
+    ondestroy_t ondestroy; // before the vhost data is freed
+
+    int  deflate_level; // permessage-deflate level, -1 to keep lws default
+    bool deflate_bin;   // also compress sessions negotiating `?proto=bin`
+    bool deflate_json;  // also compress json sessions
 };
 
+#define MY_WS_EXTENSIONS                                                       \
+    {                                                                          \
+        {"permessage-deflate", lws_extension_callback_pm_deflate,              \
+            "permessage-deflate; client_no_context_takeover; "                 \
+            "client_max_window_bits"},                                         \
+        {NULL, NULL, NULL},                                                    \
+    }
+
 int my_ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
     void *user, void *in, size_t len);
 int my_http_callback(struct lws *wsi, enum lws_callback_reasons reason,
@@ -68,12 +113,16 @@ size_t my_ws_send_all(struct lws *wsi, struct lws *except, const void *msg,
 
 size_t my_http_send(
     struct lws *wsi, int stt, const char *headers, const char *body);
-size_t my_http_send_json(struct lws *wsi, int stt, struct json_object *json);
+size_t my_http_send_json(
+    struct lws *wsi, int stt, const char *headers, struct json_object *json);
+
+// vhost data of the websocket protocol, reachable from any wsi of the vhost
+struct my_per_vhost_data *my_ws_vhd(struct lws *wsi);
 
 #define MY_WS_PROTOCOL(ws)                                                     \
     {                                                                          \
-        "cce", my_ws_callback, sizeof(struct my_per_session_data),             \
-            MY_PSS_SIZE, 0, &ws, 0                                             \
+        MY_WS_PROTOCOL_NAME, my_ws_callback,                                   \
+            sizeof(struct my_per_session_data), MY_PSS_SIZE, 0, &ws, 0         \
     }
 
 #define MY_HTTP_PROTOCOL(on_request)                                           \
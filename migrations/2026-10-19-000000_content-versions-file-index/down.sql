@@ -0,0 +1,3 @@
+-- This file should undo anything in `up.sql`
+
+drop index content_versions_file_id_id;
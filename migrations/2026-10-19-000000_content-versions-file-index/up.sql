@@ -0,0 +1,4 @@
+-- Your SQL goes here
+
+-- versions of a file newest first, for the paginated history
+create index content_versions_file_id_id on content_versions (file_id, id desc);
@@ -0,0 +1,83 @@
+#include <arena.h>
+
+static __thread arena_t *__arena_msg = NULL;
+
+static arena_chunk_t *arena_chunk_new(size_t cap, arena_chunk_t *next) {
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + cap);
+    chunk->next          = next;
+    chunk->cap           = cap;
+    chunk->used          = 0;
+    return chunk;
+}
+
+arena_t *arena_new(size_t chunk_size) {
+    arena_t *arena    = malloc(sizeof(arena_t));
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+    arena->head       = arena_chunk_new(arena->chunk_size, NULL);
+    arena->used       = 0;
+    arena->peak       = 0;
+    return arena;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    arena_chunk_t *chunk = arena->head;
+    if (chunk->cap - chunk->used < size) {
+        size_t cap = size > arena->chunk_size ? size : arena->chunk_size;
+        chunk = arena->head = arena_chunk_new(cap, chunk);
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->used += size;
+    return ptr;
+}
+
+char *arena_strndup(arena_t *arena, const char *str, size_t len) {
+    char *dup = arena_alloc(arena, len + 1);
+    memcpy(dup, str, len);
+    dup[len] = '\0';
+    return dup;
+}
+
+void arena_reset(arena_t *arena) {
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    arena->used = 0;
+
+    arena_chunk_t *chunk = arena->head;
+    if (!chunk->next) {
+        chunk->used = 0;
+        return;
+    }
+
+    // outgrown, replace every chunk by one holding the peak
+    while (chunk) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    if (arena->peak > arena->chunk_size) {
+        arena->chunk_size =
+            arena->peak < ARENA_KEEP_MAX ? arena->peak : ARENA_KEEP_MAX;
+    }
+    arena->head = arena_chunk_new(arena->chunk_size, NULL);
+}
+
+void arena_drop(arena_t *arena) {
+    if (!arena) return;
+
+    arena_chunk_t *chunk = arena->head;
+    while (chunk) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+arena_t *arena_msg() {
+    if (!__arena_msg) __arena_msg = arena_new(ARENA_CHUNK_SIZE);
+    return __arena_msg;
+}
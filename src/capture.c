@@ -0,0 +1,171 @@
+#include <capture.h>
+
+static FILE    *__cap_fp      = NULL;
+static uint32_t __cap_session = 0;
+static uint64_t __cap_last_ns = 0;
+
+// record header: type, session, us since the previous record
+static void capture_header(uint8_t type, uint32_t session) {
+    uint8_t  buf[1 + 2 * PROTO_VARINT_MAX];
+    uint64_t now = metrics_now_ns();
+
+    size_t n = 0;
+    buf[n++] = type;
+    n += proto_varint_encode(session, buf + n);
+    n += proto_varint_encode((now - __cap_last_ns) / 1000, buf + n);
+    fwrite(buf, 1, n, __cap_fp);
+
+    // keep the sub-microsecond rest so deltas do not drift
+    __cap_last_ns = now - (now - __cap_last_ns) % 1000;
+}
+
+static void capture_bytes(const void *data, size_t len) {
+    uint8_t buf[PROTO_VARINT_MAX];
+    fwrite(buf, 1, proto_varint_encode(len, buf), __cap_fp);
+    fwrite(data, 1, len, __cap_fp);
+}
+
+bool capture_open(const char *path) {
+    __cap_fp = fopen(path, "wb");
+    if (!__cap_fp) {
+        raise_error(140, "%s: cannot open %s", __func__, path);
+        return false;
+    }
+
+    setvbuf(__cap_fp, NULL, _IOFBF, 1 << 16);
+    fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_LEN, __cap_fp);
+    __cap_last_ns = metrics_now_ns();
+    return true;
+}
+
+void capture_close() {
+    if (!__cap_fp) return;
+    fclose(__cap_fp);
+    __cap_fp = NULL;
+}
+
+uint32_t capture_session_open(const char *uri) {
+    if (!__cap_fp) return 0;
+
+    uint32_t session = ++__cap_session;
+    capture_header(CAPTURE_OPEN, session);
+    capture_bytes(uri, strlen(uri));
+    return session;
+}
+
+void capture_frame(uint32_t session, bool is_bin, const void *msg, size_t len) {
+    if (!__cap_fp || !session) return;
+
+    capture_header(CAPTURE_FRAME, session);
+    fputc(is_bin ? CAPTURE_BIN : 0, __cap_fp);
+    capture_bytes(msg, len);
+}
+
+void capture_session_close(uint32_t session) {
+    if (!__cap_fp || !session) return;
+
+    capture_header(CAPTURE_CLOSE, session);
+    fflush(__cap_fp);
+}
+
+capture_reader_t *capture_reader_open(const char *path) {
+    char  magic[CAPTURE_MAGIC_LEN];
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        raise_error(140, "%s: cannot open %s", __func__, path);
+        return NULL;
+    }
+
+    if (fread(magic, 1, CAPTURE_MAGIC_LEN, fp) != CAPTURE_MAGIC_LEN ||
+        memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0) {
+        raise_error(141, "%s: %s is not a capture file", __func__, path);
+        fclose(fp);
+        return NULL;
+    }
+
+    capture_reader_t *reader = calloc(1, sizeof(capture_reader_t));
+    reader->fp               = fp;
+    return reader;
+}
+
+// read a varint byte by byte, false at eof
+static bool capture_read_varint(FILE *fp, uint64_t *val) {
+    uint8_t buf[PROTO_VARINT_MAX];
+
+    for (size_t i = 0; i < PROTO_VARINT_MAX; ++i) {
+        int c = fgetc(fp);
+        if (c == EOF) return false;
+
+        buf[i] = c;
+        if (!(c & 0x80)) return proto_varint_decode(buf, i + 1, val) != 0;
+    }
+
+    return false;
+}
+
+int capture_read(capture_reader_t *reader, capture_record_t *rec) {
+    uint64_t session, dt, len;
+
+    int type = fgetc(reader->fp);
+    if (type == EOF) return 0;
+
+    if (!capture_read_varint(reader->fp, &session) ||
+        !capture_read_varint(reader->fp, &dt)) {
+        goto __capture_truncated;
+    }
+
+    reader->ts_us += dt;
+
+    rec->type    = type;
+    rec->session = session;
+    rec->ts_us   = reader->ts_us;
+    rec->is_bin  = false;
+    rec->data    = NULL;
+    rec->len     = 0;
+
+    switch (type) {
+        case CAPTURE_CLOSE:
+            return 1;
+
+        case CAPTURE_FRAME: {
+            int flags = fgetc(reader->fp);
+            if (flags == EOF) goto __capture_truncated;
+            rec->is_bin = flags & CAPTURE_BIN;
+        } // fall through
+
+        case CAPTURE_OPEN:
+            if (!capture_read_varint(reader->fp, &len)) {
+                goto __capture_truncated;
+            }
+
+            if (len + 1 > reader->cap) {
+                reader->cap = len + 1;
+                free(reader->buf);
+                reader->buf = malloc(reader->cap);
+            }
+
+            if (fread(reader->buf, 1, len, reader->fp) != len) {
+                goto __capture_truncated;
+            }
+            reader->buf[len] = '\0';
+
+            rec->data = reader->buf;
+            rec->len  = len;
+            return 1;
+
+        default:
+            raise_error(142, "%s: unknown record type %d", __func__, type);
+            return -1;
+    }
+
+__capture_truncated:
+    raise_error(143, "%s: truncated record", __func__);
+    return -1;
+}
+
+void capture_reader_close(capture_reader_t *reader) {
+    if (!reader) return;
+    fclose(reader->fp);
+    free(reader->buf);
+    free(reader);
+}
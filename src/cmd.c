@@ -154,20 +154,32 @@ json_object *cmd_args_new(const char *fmt, va_list ap) {
     return _args;
 }
 
+int cmd_type_index(const char *type) {
+    size_t len = strlen(type);
+
+    for (size_t i = 0; i < CMD_TYPES_LEN; ++i) {
+        if (!strncmp(cmd_types[i], type, len) && cmd_types[i][len] == ',') {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+char *cmd_type_name(int idx, char *out) {
+    size_t len = strchr(cmd_types[idx], ',') - cmd_types[idx];
+    memcpy(out, cmd_types[idx], len);
+    out[len] = '\0';
+    return out;
+}
+
 // [E]: return true if ok, raise error if failed
 bool cmd_validate(const cmd_t *cmd) {
     const char *type = json_object_get_string(cmd->type);
     size_t      len  = strlen(type);
 
-    int i             = 0;
-    int cmd_types_len = sizeof(cmd_types) / sizeof(cmd_types[0]);
-    for (i = 0; i < cmd_types_len; ++i) {
-        if (!strncmp(cmd_types[i], type, len)) {
-            break;
-        }
-    }
-
-    if (i >= cmd_types_len) {
+    int i = cmd_type_index(type);
+    if (i < 0) {
         raise_error(103, "%s: not found command of type %s", __func__, type);
         return false;
     }
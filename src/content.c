@@ -0,0 +1,30 @@
+#include <content.h>
+
+char *content_splice(const char *content, size_t len, size_t *pfrom,
+    size_t *pto, const char *string, size_t string_len) {
+    size_t from = *pfrom;
+    size_t to   = *pto;
+
+    if (from > len) {
+        from = len;
+        to   = from;
+    }
+
+    if (to >= len) {
+        to = len;
+    }
+
+    // first byte kept after the edited range
+    size_t tail = string ? from : (to < len ? to + 1 : len);
+    size_t mid  = string ? string_len : 0;
+
+    char *out = malloc(from + mid + (len - tail) + 1);
+    memcpy(out, content, from);
+    if (string) memcpy(out + from, string, string_len);
+    memcpy(out + from + mid, content + tail, len - tail);
+    out[from + mid + len - tail] = '\0';
+
+    *pfrom = from;
+    *pto   = to;
+    return out;
+}
@@ -0,0 +1,511 @@
+#include <db.h>
+#include <vec.h>
+#include <content.h>
+
+// in-memory backend: same semantics and error codes as the postgres one, but
+// nothing is persisted. only the last DB_MEM_HISTORY versions of a file are
+// kept. like a PGconn it must only be used from one thread
+
+#define DB_MEM_HISTORY 1000
+
+struct mem_version {
+    uint64_t id;
+    uint64_t update_by;
+    char    *content;
+};
+
+struct mem_file {
+    uint64_t id;
+    uint16_t type_id;
+    uint64_t owner;
+    uint16_t everyone_can;
+    vec_t   *versions; // Vec<struct mem_version>, oldest first
+};
+
+struct mem_user_per {
+    uint64_t user_id;
+    uint64_t file_id;
+    int      per_id;
+};
+
+struct db_mem {
+    db_t   base;
+    vec_t *users;     // Vec<db_user_t>
+    vec_t *files;     // Vec<struct mem_file>
+    vec_t *user_pers; // Vec<struct mem_user_per>
+};
+
+#define DB_MEM(db) ((struct db_mem *)(db))
+
+static const char *mem_file_types[] = {"plaintext", "c", "cpp", "python",
+    "javascript", "typescript", "csharp", "ruby", "rust", "go", "java", "sql",
+    "php", "dart"};
+
+static const char *mem_permissions[] = {
+    "nothing", "viewer", "commenter", "editor"};
+
+static char *mem_strdup(const char *str) {
+    if (!str) return NULL;
+
+    char *dup = malloc(strlen(str) + 1);
+    strcpy(dup, str);
+    return dup;
+}
+
+static void mem_version_drop(void *a) {
+    struct mem_version *ver = a;
+    free(ver->content);
+}
+
+static void mem_file_drop(void *a) {
+    struct mem_file *file = a;
+    vec_drop(file->versions);
+}
+
+static void mem_user_drop(void *a) {
+    db_user_t *user = a;
+    free(user->username);
+    free(user->hash_passwd);
+    free(user->email);
+    free(user->avatar_url);
+}
+
+static struct mem_file *mem_file_find(db_t *db, uint64_t file_id) {
+    vec_t *files = DB_MEM(db)->files;
+
+    for (size_t i = 0; i < files->len; ++i) {
+        struct mem_file *file = vec_get(files, i);
+        if (file->id == file_id) return file;
+    }
+
+    return NULL;
+}
+
+static struct mem_version *mem_file_current(struct mem_file *file) {
+    return vec_get(file->versions, file->versions->len - 1);
+}
+
+static uint64_t mem_file_push(
+    struct mem_file *file, uint64_t ver_id, uint64_t update_by, char *content) {
+    struct mem_version ver = {ver_id, update_by, content};
+    vec_add(file->versions, &ver);
+
+    if (file->versions->len > DB_MEM_HISTORY) vec_remove(file->versions, 0);
+    return ver_id;
+}
+
+static db_content_version_t *mem_version_copy(
+    struct mem_file *file, struct mem_version *ver) {
+    db_content_version_t *contents = malloc(sizeof(db_content_version_t));
+
+    contents->id        = ver->id;
+    contents->file_id   = file->id;
+    contents->update_by = ver->update_by;
+    contents->content   = mem_strdup(ver->content);
+    contents->prev      = NULL;
+    return contents;
+}
+
+static db_named_t *mem_get_named(const char **names, size_t len) {
+    db_named_t *named = NULL;
+
+    for (size_t i = len; i-- > 0;) {
+        db_named_t *row = malloc(sizeof(db_named_t));
+
+        row->id   = i;
+        row->name = mem_strdup(names[i]);
+        row->next = named;
+        named     = row;
+    }
+
+    return named;
+}
+
+static db_named_t *mem_get_file_types(db_t *db) {
+    (void)db;
+    return mem_get_named(mem_file_types,
+        sizeof(mem_file_types) / sizeof(mem_file_types[0]));
+}
+
+static db_named_t *mem_get_permissions(db_t *db) {
+    (void)db;
+    return mem_get_named(mem_permissions,
+        sizeof(mem_permissions) / sizeof(mem_permissions[0]));
+}
+
+static db_file_t *mem_file_create(db_t *db, uint64_t owner,
+    uint16_t everyone_can, const char *content, int type_id) {
+    uint64_t file_id = db_new_id(__func__);
+    uint64_t ver_id  = db_new_id(__func__);
+    if (!file_id || !ver_id) return NULL;
+
+    if (owner == 0) {
+        everyone_can = 3;
+    }
+
+    struct mem_file file = {
+        .id           = file_id,
+        .type_id      = type_id,
+        .owner        = owner,
+        .everyone_can = everyone_can,
+        .versions =
+            vec_new_r(struct mem_version, NULL, NULL, mem_version_drop),
+    };
+    mem_file_push(&file, ver_id, owner, mem_strdup(content));
+    vec_add(DB_MEM(db)->files, &file);
+
+    db_file_t *res       = malloc(sizeof(db_file_t));
+    res->id              = file_id;
+    res->owner           = owner;
+    res->everyone_can    = everyone_can;
+    res->type_id         = type_id;
+    res->current_version = ver_id;
+    res->contents        = mem_version_copy(&file, mem_file_current(&file));
+
+    return res;
+}
+
+static db_file_t *mem_file_get(
+    db_t *db, uint64_t file_id, bool get_all_history) {
+    struct mem_file *file = mem_file_find(db, file_id);
+    if (!file) {
+        raise_error(304, "%s: file not found", __func__);
+        return NULL;
+    }
+
+    db_file_t *res       = malloc(sizeof(db_file_t));
+    res->id              = file->id;
+    res->type_id         = file->type_id;
+    res->owner           = file->owner;
+    res->everyone_can    = file->everyone_can;
+    res->current_version = mem_file_current(file)->id;
+    res->contents        = NULL;
+
+    // newest first, as `order by id desc`
+    db_content_version_t **ctns = &res->contents;
+
+    size_t len   = file->versions->len;
+    size_t limit = get_all_history ? DB_MEM_HISTORY : 1;
+    for (size_t i = len; i-- > 0 && len - i <= limit;) {
+        *ctns = mem_version_copy(file, vec_get(file->versions, i));
+        ctns  = &(*ctns)->prev;
+    }
+
+    return res;
+}
+
+static db_content_version_t *mem_content_version_get(
+    db_t *db, uint64_t file_id, uint64_t ver_id) {
+    struct mem_file *file = mem_file_find(db, file_id);
+
+    for (size_t i = 0; file && i < file->versions->len; ++i) {
+        struct mem_version *ver = vec_get(file->versions, i);
+        if (ver->id == ver_id) return mem_version_copy(file, ver);
+    }
+
+    raise_error(312, "%s: version not found", __func__);
+    return NULL;
+}
+
+static bool mem_file_history(db_t *db, uint64_t file_id, uint64_t before,
+    size_t limit, db_content_version_t **phistory) {
+    struct mem_file *file = mem_file_find(db, file_id);
+
+    db_content_version_t **pprev = phistory;
+    *phistory                    = NULL;
+    if (!file) return true;
+
+    // ids grow with the versions, the page ends right before `before`
+    size_t lo = 0, hi = file->versions->len;
+    while (before && lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (((struct mem_version *)vec_get(file->versions, mid))->id < before) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (size_t i = hi; i-- > 0 && limit--;) {
+        struct mem_version   *ver  = vec_get(file->versions, i);
+        db_content_version_t *meta = malloc(sizeof(db_content_version_t));
+
+        meta->id        = ver->id;
+        meta->file_id   = file->id;
+        meta->update_by = ver->update_by;
+        meta->content   = NULL;
+        meta->prev      = NULL;
+
+        *pprev = meta;
+        pprev  = &meta->prev;
+    }
+
+    return true;
+}
+
+static uint64_t mem_file_update(db_t *db, uint64_t file_id, uint64_t update_by,
+    size_t from, size_t to, const char *string) {
+    uint64_t ver_id = db_new_id(__func__);
+    if (!ver_id) return 0;
+
+    // check user permission
+    if (db_user_has_per_on_file(db, update_by, file_id, 3) == false) {
+        raise_error(330, "%s: user %ld permission denied", __func__, update_by);
+        return 0;
+    }
+
+    struct mem_file *file = mem_file_find(db, file_id);
+    if (!file) {
+        raise_error(331, "%s: file %ld not exist", __func__, file_id);
+        return 0;
+    }
+
+    const char *old_content = mem_file_current(file)->content;
+    char       *new_content = content_splice(old_content, strlen(old_content),
+              &from, &to, string, string ? strlen(string) : 0);
+
+    return mem_file_push(file, ver_id, update_by, new_content);
+}
+
+static uint64_t mem_file_save(
+    db_t *db, uint64_t file_id, uint64_t user_id, const char *content) {
+    uint64_t ver_id = db_new_id(__func__);
+    if (!ver_id) return 0;
+
+    struct mem_file *file = mem_file_find(db, file_id);
+    if (!file) {
+        raise_error(306, "%s: file %ld not exist", __func__, file_id);
+        return 0;
+    }
+
+    return mem_file_push(file, ver_id, user_id, mem_strdup(content));
+}
+
+static bool mem_file_delete(db_t *db, uint64_t file_id) {
+    struct db_mem   *mem  = DB_MEM(db);
+    struct mem_file *file = mem_file_find(db, file_id);
+    if (!file) {
+        raise_error(309, "%s: file %ld not exist", __func__, file_id);
+        return false;
+    }
+
+    vec_remove(mem->files, file - (struct mem_file *)mem->files->arr);
+
+    // on delete cascade
+    for (size_t i = mem->user_pers->len; i-- > 0;) {
+        struct mem_user_per *per = vec_get(mem->user_pers, i);
+        if (per->file_id == file_id) vec_remove(mem->user_pers, i);
+    }
+
+    return true;
+}
+
+static bool mem_file_set_per(db_t *db, uint64_t file_id, int per_id) {
+    struct mem_file *file = mem_file_find(db, file_id);
+    if (file) file->everyone_can = per_id;
+    return true;
+}
+
+static struct mem_user_per *mem_user_per_find(
+    db_t *db, uint64_t file_id, uint64_t user_id) {
+    vec_t *user_pers = DB_MEM(db)->user_pers;
+
+    for (size_t i = 0; i < user_pers->len; ++i) {
+        struct mem_user_per *per = vec_get(user_pers, i);
+        if (per->file_id == file_id && per->user_id == user_id) return per;
+    }
+
+    return NULL;
+}
+
+static bool mem_file_set_user_per(
+    db_t *db, uint64_t file_id, uint64_t user_id, int per_id) {
+    if (!mem_file_find(db, file_id)) {
+        raise_error(310, "%s: file %ld not exist", __func__, file_id);
+        return false;
+    }
+
+    struct mem_user_per *per = mem_user_per_find(db, file_id, user_id);
+    if (per) {
+        per->per_id = per_id;
+    } else {
+        struct mem_user_per new_per = {user_id, file_id, per_id};
+        vec_add(DB_MEM(db)->user_pers, &new_per);
+    }
+
+    return true;
+}
+
+static db_user_pers_t *mem_user_pers_new(
+    uint64_t user_id, uint64_t file_id, int per_id, bool is_owner) {
+    db_user_pers_t *u_pers = malloc(sizeof(db_user_pers_t));
+
+    u_pers->user_id  = user_id;
+    u_pers->file_id  = file_id;
+    u_pers->per_id   = per_id;
+    u_pers->is_owner = is_owner;
+    u_pers->next     = NULL;
+    return u_pers;
+}
+
+static db_file_pers_t *mem_file_get_pers(db_t *db, uint64_t file_id) {
+    struct mem_file *file = mem_file_find(db, file_id);
+    if (!file) {
+        raise_error(304, "%s: file not found", __func__);
+        return NULL;
+    }
+
+    db_file_pers_t *pers = malloc(sizeof(db_file_pers_t));
+    pers->everyone_can   = file->everyone_can;
+    pers->user_pers      = mem_user_pers_new(file->owner, file_id, 3, true);
+
+    vec_t *user_pers = DB_MEM(db)->user_pers;
+    for (size_t i = 0; i < user_pers->len; ++i) {
+        struct mem_user_per *per = vec_get(user_pers, i);
+        if (per->file_id != file_id) continue;
+
+        db_user_pers_t *u_pers = mem_user_pers_new(per->user_id, file_id,
+            per->per_id, per->user_id == file->owner);
+
+        u_pers->next    = pers->user_pers;
+        pers->user_pers = u_pers;
+    }
+
+    return pers;
+}
+
+static db_user_pers_t *mem_file_get_user_per(db_t *db, uint64_t user_id) {
+    db_user_pers_t *pers = NULL;
+
+    vec_t *user_pers = DB_MEM(db)->user_pers;
+    for (size_t i = 0; i < user_pers->len; ++i) {
+        struct mem_user_per *per = vec_get(user_pers, i);
+        if (per->user_id != user_id) continue;
+
+        struct mem_file *file   = mem_file_find(db, per->file_id);
+        db_user_pers_t  *u_pers = mem_user_pers_new(user_id, per->file_id,
+             per->per_id, file && file->owner == user_id);
+
+        u_pers->next = pers;
+        pers         = u_pers;
+    }
+
+    vec_t *files = DB_MEM(db)->files;
+    for (size_t i = 0; i < files->len; ++i) {
+        struct mem_file *file = vec_get(files, i);
+        if (file->owner != user_id) continue;
+
+        db_user_pers_t *u_pers = mem_user_pers_new(user_id, file->id, 3, true);
+
+        u_pers->next = pers;
+        pers         = u_pers;
+    }
+
+    return pers;
+}
+
+static int mem_get_user_per_on_file(
+    db_t *db, uint64_t user_id, uint64_t file_id) {
+    struct mem_file *file = mem_file_find(db, file_id);
+    if (!file) return 0;
+
+    // if user is file owner -> permission = 3
+    if (user_id && file->owner == user_id) return 3;
+
+    // if else user has per in user_file_permissions
+    struct mem_user_per *per = mem_user_per_find(db, file_id, user_id);
+    if (per) return per->per_id;
+
+    // else everyone_can
+    return file->everyone_can;
+}
+
+static db_user_t *mem_user_copy(const db_user_t *user) {
+    db_user_t *res   = malloc(sizeof(db_user_t));
+    res->id          = user->id;
+    res->username    = mem_strdup(user->username);
+    res->hash_passwd = mem_strdup(user->hash_passwd);
+    res->email       = mem_strdup(user->email);
+    res->avatar_url  = mem_strdup(user->avatar_url);
+    return res;
+}
+
+static db_user_t *mem_user_get(
+    db_t *db, uint64_t user_id, const char *username) {
+    vec_t *users = DB_MEM(db)->users;
+
+    for (size_t i = 0; i < users->len; ++i) {
+        db_user_t *user = vec_get(users, i);
+        if (user->id == user_id ||
+            (username && strcmp(user->username, username) == 0)) {
+            return mem_user_copy(user);
+        }
+    }
+
+    return NULL;
+}
+
+static db_user_t *mem_user_add(db_t *db, const char *username,
+    const char *hash_passwd, const char *email, const char *avatar_url) {
+    db_user_t *dup = mem_user_get(db, 0, username);
+    if (dup) {
+        db_user_drop(dup);
+        raise_error(321, "%s: username %s already exists", __func__, username);
+        return NULL;
+    }
+
+    uint64_t id = db_new_id(__func__);
+    if (!id) return NULL;
+
+    db_user_t user = {
+        .id          = id,
+        .username    = mem_strdup(username),
+        .hash_passwd = mem_strdup(hash_passwd),
+        .email       = mem_strdup(email),
+        .avatar_url  = mem_strdup(avatar_url),
+    };
+    vec_add(DB_MEM(db)->users, &user);
+
+    return mem_user_copy(&user);
+}
+
+static void mem_close(db_t *db) {
+    struct db_mem *mem = DB_MEM(db);
+
+    vec_drop(mem->users);
+    vec_drop(mem->files);
+    vec_drop(mem->user_pers);
+    free(mem);
+}
+
+static const struct db_ops mem_ops = {
+    .name                 = "memory",
+    .close                = mem_close,
+    .get_file_types       = mem_get_file_types,
+    .get_permissions      = mem_get_permissions,
+    .file_create          = mem_file_create,
+    .file_get             = mem_file_get,
+    .content_version_get  = mem_content_version_get,
+    .file_history         = mem_file_history,
+    .file_update          = mem_file_update,
+    .file_save            = mem_file_save,
+    .file_delete          = mem_file_delete,
+    .file_set_per         = mem_file_set_per,
+    .file_set_user_per    = mem_file_set_user_per,
+    .file_get_pers        = mem_file_get_pers,
+    .file_get_user_per    = mem_file_get_user_per,
+    .get_user_per_on_file = mem_get_user_per_on_file,
+    .user_add             = mem_user_add,
+    .user_get             = mem_user_get,
+};
+
+db_t *db_mem_new() {
+    struct db_mem *mem = malloc(sizeof(struct db_mem));
+
+    mem->base.ops  = &mem_ops;
+    mem->users     = vec_new_r(db_user_t, NULL, NULL, mem_user_drop);
+    mem->files     = vec_new_r(struct mem_file, NULL, NULL, mem_file_drop);
+    mem->user_pers = vec_new_r(struct mem_user_per, NULL, NULL, NULL);
+
+    return &mem->base;
+}
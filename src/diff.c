@@ -0,0 +1,256 @@
+#include <diff.h>
+#include <utf8.h>
+
+#include <sys/types.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+size_t diff_prefix(const char *a, size_t alen, const char *b, size_t blen) {
+    size_t len = alen < blen ? alen : blen, i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16) {
+        __m128i  x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i  y = _mm_loadu_si128((const __m128i *)(b + i));
+        uint32_t m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+        if (m) return i + __builtin_ctz(m);
+    }
+#endif
+    while (i < len && a[i] == b[i]) ++i;
+
+    return i;
+}
+
+size_t diff_suffix(const char *a, size_t alen, const char *b, size_t blen) {
+    size_t len = alen < blen ? alen : blen, i = 0;
+
+    a += alen;
+    b += blen;
+
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16) {
+        __m128i  x = _mm_loadu_si128((const __m128i *)(a - i - 16));
+        __m128i  y = _mm_loadu_si128((const __m128i *)(b - i - 16));
+        uint32_t m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+        // lanes above the highest differing one are equal
+        if (m) return i + __builtin_clz(m) - 16;
+    }
+#endif
+    while (i < len && a[-1 - (ssize_t)i] == b[-1 - (ssize_t)i]) ++i;
+
+    return i;
+}
+
+typedef struct {
+    const char *a, *b;
+    vec_t      *hunks; // Vec<diff_hunk_t>
+} diff_ctx_t;
+
+// replace a[a0, a1) by b[b0, b1), joined to the hunk before if they touch
+static void diff_push(
+    diff_ctx_t *d, size_t a0, size_t a1, size_t b0, size_t b1) {
+    if (a0 == a1 && b0 == b1) return;
+
+    size_t n = d->hunks->len;
+    if (n) {
+        diff_hunk_t *last = &vec_at_r(diff_hunk_t, d->hunks, n - 1);
+        if (last->from + last->removed == a0 &&
+            last->at + last->inserted == b0) {
+            last->removed += a1 - a0;
+            last->inserted += b1 - b0;
+            return;
+        }
+    }
+
+    diff_hunk_t hunk = {a0, a1 - a0, b0, b1 - b0};
+    vec_push_r(diff_hunk_t, d->hunks, hunk);
+}
+
+static void diff_range(
+    diff_ctx_t *d, size_t a0, size_t a1, size_t b0, size_t b1);
+
+// Myers' middle snake of a[a0, a1) and b[b0, b1), both non empty without a
+// common prefix or suffix. the forward and backward searches meet on it,
+// each side of it is diffed on its own
+static void diff_bisect(
+    diff_ctx_t *d, size_t a0, size_t a1, size_t b0, size_t b1) {
+    const char *s1 = d->a + a0, *s2 = d->b + b0;
+    ssize_t     n1 = a1 - a0, n2 = b1 - b0;
+
+    ssize_t max_d = (n1 + n2 + 1) / 2;
+    if (max_d > DIFF_MAX_D) max_d = DIFF_MAX_D;
+
+    // furthest x reached on each diagonal k, from the start (v1) and from the
+    // end (v2), -1 if not reached yet
+    ssize_t  off = max_d, len = 2 * max_d + 2;
+    ssize_t *v1  = malloc(2 * len * sizeof(ssize_t)), *v2 = v1 + len;
+    for (ssize_t i = 0; i < 2 * len; ++i) v1[i] = -1;
+    v1[off + 1] = 0;
+    v2[off + 1] = 0;
+
+    // the fronts meet on the forward pass if the length difference is odd
+    ssize_t delta = n1 - n2;
+    bool    front = delta % 2 != 0;
+    ssize_t k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+    for (ssize_t e = 0; e < max_d; ++e) {
+        for (ssize_t k1 = -e + k1start; k1 <= e - k1end; k1 += 2) {
+            ssize_t x1;
+            if (k1 == -e || (k1 != e && v1[off + k1 - 1] < v1[off + k1 + 1])) {
+                x1 = v1[off + k1 + 1];
+            } else {
+                x1 = v1[off + k1 - 1] + 1;
+            }
+            ssize_t y1 = x1 - k1;
+            if (x1 < n1 && y1 < n2) {
+                ssize_t n = diff_prefix(s1 + x1, n1 - x1, s2 + y1, n2 - y1);
+                x1 += n;
+                y1 += n;
+            }
+            v1[off + k1] = x1;
+
+            if (x1 > n1) {
+                k1end += 2; // ran off the right
+            } else if (y1 > n2) {
+                k1start += 2; // ran off the bottom
+            } else if (front) {
+                ssize_t k2 = off + delta - k1;
+                if (k2 >= 0 && k2 < len && v2[k2] != -1 && x1 >= n1 - v2[k2]) {
+                    free(v1);
+                    diff_range(d, a0, a0 + x1, b0, b0 + y1);
+                    diff_range(d, a0 + x1, a1, b0 + y1, b1);
+                    return;
+                }
+            }
+        }
+
+        for (ssize_t k2 = -e + k2start; k2 <= e - k2end; k2 += 2) {
+            ssize_t x2;
+            if (k2 == -e || (k2 != e && v2[off + k2 - 1] < v2[off + k2 + 1])) {
+                x2 = v2[off + k2 + 1];
+            } else {
+                x2 = v2[off + k2 - 1] + 1;
+            }
+            ssize_t y2 = x2 - k2;
+            if (x2 < n1 && y2 < n2) {
+                ssize_t n = diff_suffix(s1, n1 - x2, s2, n2 - y2);
+                x2 += n;
+                y2 += n;
+            }
+            v2[off + k2] = x2;
+
+            if (x2 > n1) {
+                k2end += 2;
+            } else if (y2 > n2) {
+                k2start += 2;
+            } else if (!front) {
+                ssize_t k1 = off + delta - k2;
+                if (k1 >= 0 && k1 < len && v1[k1] != -1) {
+                    ssize_t x1 = v1[k1], y1 = off + x1 - k1;
+                    if (x1 >= n1 - x2) {
+                        free(v1);
+                        diff_range(d, a0, a0 + x1, b0, b0 + y1);
+                        diff_range(d, a0 + x1, a1, b0 + y1, b1);
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+    // too many edits to find the fewest. split after the forward path that
+    // got the furthest, unless it is mostly edits: the contents have little
+    // in common there and are replaced as a whole
+    ssize_t best_x = 0, best_y = 0;
+    for (ssize_t k1 = -max_d + 1; k1 < max_d; ++k1) {
+        ssize_t x1 = v1[off + k1], y1 = x1 - k1;
+        if (x1 < 0 || x1 > n1 || y1 < 0 || y1 > n2) continue;
+        if (x1 + y1 > best_x + best_y) {
+            best_x = x1;
+            best_y = y1;
+        }
+    }
+    free(v1);
+
+    // the path took max_d - 1 edits at most, the rest of its steps are equal
+    // bytes. a split at either end would not get any further
+    ssize_t reach = best_x + best_y;
+    if (reach <= 3 * (max_d - 1) || reach == n1 + n2) {
+        diff_push(d, a0, a1, b0, b1);
+    } else {
+        diff_range(d, a0, a0 + best_x, b0, b0 + best_y);
+        diff_range(d, a0 + best_x, a1, b0 + best_y, b1);
+    }
+}
+
+static void diff_range(
+    diff_ctx_t *d, size_t a0, size_t a1, size_t b0, size_t b1) {
+    size_t n = diff_prefix(d->a + a0, a1 - a0, d->b + b0, b1 - b0);
+    a0 += n;
+    b0 += n;
+
+    n = diff_suffix(d->a + a0, a1 - a0, d->b + b0, b1 - b0);
+    a1 -= n;
+    b1 -= n;
+
+    if (a0 == a1 || b0 == b1) {
+        diff_push(d, a0, a1, b0, b1);
+    } else {
+        diff_bisect(d, a0, a1, b0, b1);
+    }
+}
+
+// widen the hunks to character boundaries over the equal bytes around them,
+// joining the ones that meet
+static void diff_snap(
+    vec_t *hunks, const char *a, size_t alen, const char *b, size_t blen) {
+    size_t w = 0;
+
+    for (size_t r = 0; r < hunks->len; ++r) {
+        diff_hunk_t h     = vec_at_r(diff_hunk_t, hunks, r);
+        size_t      a_end = h.from + h.removed, b_end = h.at + h.inserted;
+
+        // the equal bytes end at the hunks around
+        diff_hunk_t *last = w ? &vec_at_r(diff_hunk_t, hunks, w - 1) : NULL;
+        size_t       lo   = last ? last->from + last->removed : 0;
+        size_t       hi   = r + 1 < hunks->len
+                                ? vec_at_r(diff_hunk_t, hunks, r + 1).from
+                                : alen;
+
+        while (h.from > lo && (!utf8_boundary(a, alen, h.from) ||
+                                  !utf8_boundary(b, blen, h.at))) {
+            --h.from;
+            --h.at;
+        }
+        while (a_end < hi && (!utf8_boundary(a, alen, a_end) ||
+                                 !utf8_boundary(b, blen, b_end))) {
+            ++a_end;
+            ++b_end;
+        }
+
+        if (last && h.from == lo) {
+            last->removed  = a_end - last->from;
+            last->inserted = b_end - last->at;
+        } else {
+            h.removed                        = a_end - h.from;
+            h.inserted                       = b_end - h.at;
+            vec_at_r(diff_hunk_t, hunks, w++) = h;
+        }
+    }
+
+    hunks->len = w;
+}
+
+vec_t *diff_hunks(const char *a, size_t alen, const char *b, size_t blen) {
+    diff_ctx_t d = {
+        .a     = a,
+        .b     = b,
+        .hunks = vec_new_r(diff_hunk_t, NULL, NULL, NULL),
+    };
+
+    diff_range(&d, 0, alen, 0, blen);
+    diff_snap(d.hunks, a, alen, b, blen);
+    return d.hunks;
+}
@@ -1,37 +1,50 @@
 #include <error.h>
 
-static error_t *__err_buff = NULL;
+struct error_ring {
+    error_t  errs[ERROR_RING_SIZE];
+    char     msgs[ERROR_RING_SIZE][ERROR_MSG_MAX];
+    error_t *top; // last unread error, linked by prev
+    unsigned seq; // slots written
+};
+
+static __thread struct error_ring __err_ring;
 
 void raise_error(int code, const char *message, ...) {
-    char buff[2048];
+    struct error_ring *ring = &__err_ring;
+
+    size_t   slot = ring->seq++ % ERROR_RING_SIZE;
+    error_t *err  = &ring->errs[slot];
+
+    // the slot may still be the oldest unread error, unlink it
+    if (ring->top == err) ring->top = NULL;
+    for (size_t i = 0; i < ERROR_RING_SIZE; ++i) {
+        if (ring->errs[i].prev == err) ring->errs[i].prev = NULL;
+    }
+
+    err->code    = code;
+    err->message = ring->msgs[slot];
 
     va_list ap;
     va_start(ap, message);
-    vsprintf(buff, message, ap);
+    vsnprintf(err->message, ERROR_MSG_MAX, message, ap);
     va_end(ap);
 
-    error_t *err = malloc(sizeof(error_t));
-    err->code    = code;
-    err->message = malloc(strlen(buff) + 1);
-    strcpy(err->message, buff);
-
-    err->prev  = __err_buff;
-    __err_buff = err;
+    err->prev = ring->top;
+    ring->top = err;
 }
 
 error_t *get_error() {
-    error_t *err = __err_buff;
+    struct error_ring *ring = &__err_ring;
+    error_t           *err  = ring->top;
 
     if (err) {
-        __err_buff = err->prev;
+        ring->top = err->prev;
+        err->prev = NULL;
     }
 
     return err;
 }
 
 void destroy_error(error_t *err) {
-    if (err) {
-        free(err->message);
-        free(err);
-    }
+    (void)err;
 }
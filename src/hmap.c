@@ -0,0 +1,271 @@
+// clang-format off
+#include <hmap.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define HMAP_EMPTY   0x80
+#define HMAP_DELETED 0xfe
+
+#define HMAP_ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+#define HMAP_SLOT(map, idx) ((uint8_t *)(map)->slots + (idx) * (map)->slot_size)
+
+// bit i set if ctrl[i] == b, for the HMAP_GROUP bytes of a group
+static inline uint32_t hmap_group_match(const uint8_t *ctrl, uint8_t b) {
+#ifdef __SSE2__
+    __m128i group = _mm_load_si128((const __m128i *)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(b)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < HMAP_GROUP; ++i) mask |= (uint32_t)(ctrl[i] == b) << i;
+    return mask;
+#endif
+}
+
+// bit i set if ctrl[i] is EMPTY or DELETED, both have the top bit set
+static inline uint32_t hmap_group_free(const uint8_t *ctrl) {
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_load_si128((const __m128i *)ctrl));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < HMAP_GROUP; ++i) mask |= (uint32_t)(ctrl[i] >> 7) << i;
+    return mask;
+#endif
+}
+
+uint64_t hmap_hash_u64(uint64_t key) {
+    // murmur3 finalizer
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdlu;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53lu;
+    key ^= key >> 33;
+    return key;
+}
+
+uint64_t hmap_hash_bytes(const void *data, size_t len) {
+    // fnv-1a, finalized so the low and high bits are both usable
+    const uint8_t *p    = data;
+    uint64_t       hash = 0xcbf29ce484222325lu;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3lu;
+    }
+    return hmap_hash_u64(hash);
+}
+
+static uint64_t hmap_hash(hmap_t *map, const void *key) {
+    if (map->hash) return map->hash(key);
+
+    if (map->key_size == sizeof(uint64_t)) {
+        uint64_t k;
+        memcpy(&k, key, sizeof(k));
+        return hmap_hash_u64(k);
+    }
+    return hmap_hash_bytes(key, map->key_size);
+}
+
+static inline bool hmap_key_eq(hmap_t *map, const void *a, const void *b) {
+    if (map->cmp) return map->cmp(a, b) == 0;
+
+    if (map->key_size == sizeof(uint64_t)) {
+        uint64_t x, y;
+        memcpy(&x, a, sizeof(x));
+        memcpy(&y, b, sizeof(y));
+        return x == y;
+    }
+    return memcmp(a, b, map->key_size) == 0;
+}
+
+hmap_t *hmap_new(
+    size_t          key_size,
+    size_t          val_size,
+    hmap_hash_t     hash,
+    hmap_cmp_t      cmp,
+    hmap_val_drop_t val_drop
+) {
+    hmap_t *map = calloc(1, sizeof(hmap_t));
+
+    map->key_size  = key_size;
+    map->val_size  = val_size;
+    map->val_off   = HMAP_ALIGN8(key_size);
+    map->slot_size = map->val_off + HMAP_ALIGN8(val_size);
+    map->hash      = hash;
+    map->cmp       = cmp;
+    map->val_drop  = val_drop;
+
+    return map;
+}
+
+// slot index of `key`, -1lu if absent
+static size_t hmap_find(hmap_t *map, const void *key, uint64_t hash) {
+    if (!map->cap) return -1lu;
+
+    size_t  groups = map->cap / HMAP_GROUP;
+    size_t  g      = (hash >> 7) & (groups - 1);
+    uint8_t h2     = hash & 0x7f;
+
+    // triangular probing visits every group once
+    for (size_t step = 1; step <= groups; ++step) {
+        const uint8_t *ctrl = map->ctrl + g * HMAP_GROUP;
+
+        for (uint32_t m = hmap_group_match(ctrl, h2); m; m &= m - 1) {
+            size_t idx = g * HMAP_GROUP + __builtin_ctz(m);
+            if (hmap_key_eq(map, HMAP_SLOT(map, idx), key)) return idx;
+        }
+        if (hmap_group_match(ctrl, HMAP_EMPTY)) return -1lu;
+
+        g = (g + step) & (groups - 1);
+    }
+
+    return -1lu;
+}
+
+// first EMPTY or DELETED slot on the probe sequence of `hash`
+static size_t hmap_find_free(hmap_t *map, uint64_t hash) {
+    size_t groups = map->cap / HMAP_GROUP;
+    size_t g      = (hash >> 7) & (groups - 1);
+
+    for (size_t step = 1;; ++step) {
+        uint32_t m = hmap_group_free(map->ctrl + g * HMAP_GROUP);
+        if (m) return g * HMAP_GROUP + __builtin_ctz(m);
+
+        g = (g + step) & (groups - 1);
+    }
+}
+
+static bool hmap_rehash(hmap_t *map, size_t cap) {
+    uint8_t *ctrl  = aligned_alloc(HMAP_GROUP, cap);
+    void    *slots = malloc(cap * map->slot_size);
+    if (!ctrl || !slots) {
+        free(ctrl);
+        free(slots);
+        return false;
+    }
+    memset(ctrl, HMAP_EMPTY, cap);
+
+    hmap_t old = *map;
+    map->ctrl  = ctrl;
+    map->slots = slots;
+    map->cap   = cap;
+
+    for (size_t i = 0; i < old.cap; ++i) {
+        if (old.ctrl[i] & 0x80) continue;
+
+        void    *slot = HMAP_SLOT(&old, i);
+        uint64_t hash = hmap_hash(map, slot);
+        size_t   idx  = hmap_find_free(map, hash);
+
+        map->ctrl[idx] = hash & 0x7f;
+        memcpy(HMAP_SLOT(map, idx), slot, map->slot_size);
+    }
+    map->growth_left = cap / 8 * 7 - map->len;
+
+    free(old.ctrl);
+    free(old.slots);
+    return true;
+}
+
+bool hmap_reserve(hmap_t *map, size_t n) {
+    size_t cap = map->cap ? map->cap : HMAP_GROUP;
+    while (cap / 8 * 7 < n) cap *= 2;
+
+    if (cap == map->cap) return true;
+    return hmap_rehash(map, cap);
+}
+
+void *hmap_get(hmap_t *map, const void *key) {
+    size_t idx = hmap_find(map, key, hmap_hash(map, key));
+    return idx == -1lu ? NULL : HMAP_SLOT(map, idx) + map->val_off;
+}
+
+void *hmap_entry(hmap_t *map, const void *key, bool *found) {
+    uint64_t hash = hmap_hash(map, key);
+    size_t   idx  = hmap_find(map, key, hash);
+
+    if (found) *found = idx != -1lu;
+    if (idx != -1lu) return HMAP_SLOT(map, idx) + map->val_off;
+
+    if (!map->cap && !hmap_rehash(map, HMAP_GROUP)) return NULL;
+
+    idx = hmap_find_free(map, hash);
+    if (map->ctrl[idx] == HMAP_EMPTY && !map->growth_left) {
+        // full of live slots: grow, mostly tombstones: clean up in place
+        size_t cap = map->len >= map->cap / 16 * 7 ? map->cap * 2 : map->cap;
+        if (!hmap_rehash(map, cap)) return NULL;
+        idx = hmap_find_free(map, hash);
+    }
+
+    if (map->ctrl[idx] == HMAP_EMPTY) --map->growth_left;
+    map->ctrl[idx] = hash & 0x7f;
+    ++map->len;
+
+    uint8_t *slot = HMAP_SLOT(map, idx);
+    memcpy(slot, key, map->key_size);
+    return slot + map->val_off;
+}
+
+void *hmap_put(hmap_t *map, const void *key, const void *val) {
+    bool  found;
+    void *slot_val = hmap_entry(map, key, &found);
+    if (!slot_val) return NULL;
+
+    if (found && map->val_drop) map->val_drop(slot_val);
+    memcpy(slot_val, val, map->val_size);
+    return slot_val;
+}
+
+bool hmap_remove(hmap_t *map, const void *key) {
+    size_t idx = hmap_find(map, key, hmap_hash(map, key));
+    if (idx == -1lu) return false;
+
+    if (map->val_drop) map->val_drop(HMAP_SLOT(map, idx) + map->val_off);
+
+    // probes stop at a group with an EMPTY slot, so if the group already
+    // has one no probe sequence goes through it and the slot can be EMPTY
+    const uint8_t *group = map->ctrl + idx / HMAP_GROUP * HMAP_GROUP;
+    if (hmap_group_match(group, HMAP_EMPTY)) {
+        map->ctrl[idx] = HMAP_EMPTY;
+        ++map->growth_left;
+    } else {
+        map->ctrl[idx] = HMAP_DELETED;
+    }
+    --map->len;
+
+    return true;
+}
+
+void hmap_clear(hmap_t *map) {
+    for (size_t i = 0; i < map->cap; ++i) {
+        if (map->ctrl[i] & 0x80) continue;
+        if (map->val_drop) map->val_drop(HMAP_SLOT(map, i) + map->val_off);
+    }
+
+    if (map->cap) memset(map->ctrl, HMAP_EMPTY, map->cap);
+    map->len         = 0;
+    map->growth_left = map->cap / 8 * 7;
+}
+
+void hmap_drop(hmap_t *map) {
+    if (!map) return;
+    hmap_clear(map);
+    free(map->ctrl);
+    free(map->slots);
+    free(map);
+}
+
+bool hmap_next(hmap_t *map, size_t *pos, void **key, void **val) {
+    for (; *pos < map->cap; ++*pos) {
+        if (map->ctrl[*pos] & 0x80) continue;
+
+        uint8_t *slot = HMAP_SLOT(map, *pos);
+        if (key) *key = slot;
+        if (val) *val = slot + map->val_off;
+        ++*pos;
+        return true;
+    }
+    return false;
+}
+// clang-format on
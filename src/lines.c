@@ -0,0 +1,131 @@
+#include <lines.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+size_t lines_count(const char *data, size_t len) {
+    size_t n = 0, i = 0;
+
+#ifdef __SSE2__
+    // matches are -1 per byte lane, subtracted into 8-bit counters that are
+    // summed every 255 chunks before they can wrap
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (i + 16 <= len) {
+        __m128i counts = _mm_setzero_si128();
+        size_t  end    = len - i < 255 * 16 ? len - 15 : i + 255 * 16;
+
+        for (; i < end; i += 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(chunk, nl));
+        }
+
+        __m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+        n += _mm_cvtsi128_si32(sums) +
+             _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+    }
+#endif
+    for (; i < len; ++i) n += data[i] == '\n';
+
+    return n;
+}
+
+// write base + offset + 1 of every '\n' of `data` to `out`
+static void lines_collect(
+    size_t *out, const char *data, size_t len, size_t base) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 16 <= len; i += 16) {
+        __m128i  chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        uint32_t m     = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl));
+        for (; m; m &= m - 1) *out++ = base + i + __builtin_ctz(m) + 1;
+    }
+#endif
+    for (; i < len; ++i) {
+        if (data[i] == '\n') *out++ = base + i + 1;
+    }
+}
+
+static void lines_reserve(lines_t *lines, size_t rows) {
+    if (rows <= lines->cap) return;
+
+    size_t cap = lines->cap ? lines->cap : 16;
+    while (cap < rows) cap *= 2;
+
+    lines->starts = realloc(lines->starts, cap * sizeof(size_t));
+    lines->cap    = cap;
+}
+
+lines_t *lines_new(const char *content, size_t len) {
+    lines_t *lines = calloc(1, sizeof(lines_t));
+    lines->rows    = 1 + lines_count(content, len);
+    lines->len     = len;
+
+    lines_reserve(lines, lines->rows);
+    lines->starts[0] = 0;
+    lines_collect(lines->starts + 1, content, len, 0);
+
+    return lines;
+}
+
+void lines_drop(lines_t *lines) {
+    if (!lines) return;
+    free(lines->starts);
+    free(lines);
+}
+
+// first row starting after `offset`, lines->rows if none
+static size_t lines_after(const lines_t *lines, size_t offset) {
+    size_t lo = 0, hi = lines->rows;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (lines->starts[mid] <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t lines_offset(const lines_t *lines, size_t row, size_t col) {
+    if (row >= lines->rows) return lines->len;
+
+    size_t start = lines->starts[row];
+    size_t end   = row + 1 < lines->rows ? lines->starts[row + 1] - 1
+                                         : lines->len;
+    return col < end - start ? start + col : end;
+}
+
+void lines_position(
+    const lines_t *lines, size_t offset, size_t *prow, size_t *pcol) {
+    if (offset > lines->len) offset = lines->len;
+
+    size_t row = lines_after(lines, offset) - 1;
+    *prow      = row;
+    *pcol      = offset - lines->starts[row];
+}
+
+void lines_splice(lines_t *lines, size_t pos, size_t removed,
+    const char *string, size_t string_len) {
+    // rows starting in (pos, pos + removed] had their '\n' removed, the ones
+    // after move by the length difference
+    size_t lo    = lines_after(lines, pos);
+    size_t hi    = lines_after(lines, pos + removed);
+    size_t added = string ? lines_count(string, string_len) : 0;
+    size_t rows  = lines->rows - (hi - lo) + added;
+
+    lines_reserve(lines, rows);
+    memmove(lines->starts + lo + added, lines->starts + hi,
+        (lines->rows - hi) * sizeof(size_t));
+
+    for (size_t i = lo + added; i < rows; ++i) {
+        lines->starts[i] = lines->starts[i] - removed + string_len;
+    }
+    if (added) lines_collect(lines->starts + lo, string, string_len, pos);
+
+    lines->rows = rows;
+    lines->len  = lines->len - removed + string_len;
+}
@@ -0,0 +1,186 @@
+#include <log.h>
+#include <stdarg.h>
+
+// single producer (the owning thread), single consumer (the writer thread)
+struct log_ring {
+    log_record_t records[LOG_RING_SIZE];
+    uint64_t     head; // next slot written by the owner
+    uint64_t     tail; // next slot read by the writer
+
+    struct log_ring *next;
+};
+
+static const char *log_level_names[LOG_LEVELS] = {
+    "err", "warn", "info", "debug"};
+
+log_level_t log_level = LOG_INFO;
+
+static pthread_mutex_t  __log_mut     = PTHREAD_MUTEX_INITIALIZER;
+static struct log_ring *__log_rings   = NULL;
+static pthread_t        __log_thread;
+static bool             __log_running = false;
+static bool             __log_stop    = false;
+static FILE            *__log_fp      = NULL;
+static unsigned         __log_sample  = 1;
+
+static __thread struct log_ring *__log_ring = NULL;
+static __thread unsigned         __log_seen = 0;
+
+static struct log_ring *log_ring() {
+    if (__log_ring) return __log_ring;
+
+    __log_ring = calloc(1, sizeof(struct log_ring));
+
+    pthread_mutex_lock(&__log_mut);
+    __log_ring->next = __log_rings;
+    __atomic_store_n(&__log_rings, __log_ring, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&__log_mut);
+
+    return __log_ring;
+}
+
+static void log_write(const log_record_t *rec) {
+    time_t    secs = rec->ts / 1000000;
+    struct tm tm;
+    char      date[24];
+
+    gmtime_r(&secs, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    fprintf(__log_fp, "%s.%06luZ %s %s", date, rec->ts % 1000000,
+        log_level_names[rec->level], rec->event);
+    for (int i = 0; i < rec->n; ++i) {
+        fprintf(__log_fp, " %s=%lu", rec->keys[i], rec->vals[i]);
+    }
+    if (rec->str_key) fprintf(__log_fp, " %s=%s", rec->str_key, rec->str);
+    fputc('\n', __log_fp);
+}
+
+// write every record queued so far, return the number written
+static size_t log_drain() {
+    struct log_ring *rings = __atomic_load_n(&__log_rings, __ATOMIC_ACQUIRE);
+    size_t           count = 0;
+
+    for (struct log_ring *ring = rings; ring; ring = ring->next) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = ring->tail;
+
+        for (; tail < head; ++tail, ++count) {
+            log_write(&ring->records[tail & (LOG_RING_SIZE - 1)]);
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if (count) fflush(__log_fp);
+    return count;
+}
+
+static void *log_writer(void *arg) {
+    (void)arg;
+    struct timespec delay = {0, LOG_FLUSH_MS * 1000000};
+
+    while (!__atomic_load_n(&__log_stop, __ATOMIC_ACQUIRE)) {
+        if (!log_drain()) nanosleep(&delay, NULL);
+    }
+    log_drain();
+
+    return NULL;
+}
+
+// [E]:
+bool log_init(log_level_t level, unsigned sample, const char *path) {
+    if (__log_running) return true;
+
+    __log_fp = path ? fopen(path, "a") : stdout;
+    if (!__log_fp) {
+        raise_error(150, "%s: cannot open %s", __func__, path);
+        return false;
+    }
+
+    log_level    = level;
+    __log_sample = sample ? sample : 1;
+    __log_stop   = false;
+
+    if (pthread_create(&__log_thread, NULL, log_writer, NULL)) {
+        raise_error(151, "%s: cannot start the writer thread", __func__);
+        if (path) fclose(__log_fp);
+        __log_fp = NULL;
+        return false;
+    }
+
+    __atomic_store_n(&__log_running, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+void log_close() {
+    if (!__log_running) return;
+
+    __atomic_store_n(&__log_running, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&__log_stop, true, __ATOMIC_RELEASE);
+    pthread_join(__log_thread, NULL);
+
+    if (__log_fp != stdout) fclose(__log_fp);
+    __log_fp = NULL;
+
+    pthread_mutex_lock(&__log_mut);
+    while (__log_rings) {
+        struct log_ring *next = __log_rings->next;
+        free(__log_rings);
+        __log_rings = next;
+    }
+    pthread_mutex_unlock(&__log_mut);
+    __log_ring = NULL;
+}
+
+log_level_t log_level_parse(const char *s, log_level_t def) {
+    for (int l = 0; s && l < LOG_LEVELS; ++l) {
+        if (strcmp(s, log_level_names[l]) == 0) return l;
+    }
+    return def;
+}
+
+bool log_sampled() {
+    return ++__log_seen % __log_sample == 0;
+}
+
+void log_emit(log_level_t level, const char *event, const char *str_key,
+    const char *str, int n, ...) {
+    if (!log_on(level) || !__atomic_load_n(&__log_running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    struct log_ring *ring = log_ring();
+    uint64_t         head = ring->head;
+
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >=
+        LOG_RING_SIZE) {
+        metrics_inc(METRICS_LOG_DROPPED, 1);
+        return;
+    }
+
+    log_record_t   *rec = &ring->records[head & (LOG_RING_SIZE - 1)];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    rec->ts    = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    rec->event = event;
+    rec->level = level;
+    rec->n     = n < LOG_FIELDS_MAX ? n : LOG_FIELDS_MAX;
+
+    va_list ap;
+    va_start(ap, n);
+    for (int i = 0; i < rec->n; ++i) {
+        rec->keys[i] = va_arg(ap, const char *);
+        rec->vals[i] = va_arg(ap, uint64_t);
+    }
+    va_end(ap);
+
+    rec->str_key = str_key;
+    if (str_key) {
+        size_t len = str ? strnlen(str, LOG_STR_MAX - 1) : 1;
+        memcpy(rec->str, str ? str : "-", len);
+        rec->str[len] = '\0';
+    }
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
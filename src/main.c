@@ -4,14 +4,26 @@
 
 #include <ws.h>
 #include <cmd.h>
+#include <content.h>
+#include <diff.h>
+#include <proto.h>
+#include <route.h>
 #include <error.h>
+#include <metrics.h>
+#include <trace.h>
+#include <capture.h>
+#include <log.h>
+#include <arena.h>
+#include <pool.h>
 #include <dotenv.h>
 
 void onopen(struct lws *wsi);
 void onclose(struct lws *wsi);
 void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin);
-void onrequest(struct lws *wsi, const char *path, const char *body, size_t len);
-struct my_ws ws = {onopen, onclose, onmessage};
+void onrequest(struct lws *wsi, const char *method, const char *path,
+    const char *body, size_t len);
+void ondestroy(struct my_per_vhost_data *vhd);
+struct my_ws ws = {onopen, onclose, onmessage, ondestroy, -1, false, false};
 
 static struct lws_protocols protocols[] = {
     MY_HTTP_PROTOCOL(onrequest),
@@ -19,6 +31,8 @@ static struct lws_protocols protocols[] = {
     LWS_PROTOCOL_LIST_TERM,
 };
 
+static const struct lws_extension extensions[] = MY_WS_EXTENSIONS;
+
 struct lws_protocol_vhost_options pvo_opt = {NULL, NULL, "default", ""};
 
 static struct lws_protocol_vhost_options pvo = {NULL, &pvo_opt, "cce", ""};
@@ -33,8 +47,37 @@ void sigint_handler() {
     interrupted = 1;
 }
 
-PGconn     *conn       = NULL;
-const char *secret_key = NULL;
+// a timer due every LOOP_LAG_INTERVAL, how late it fires is the loop lag
+#define LOOP_LAG_INTERVAL (100 * LWS_US_PER_MS)
+
+struct loop_lag {
+    lws_sorted_usec_list_t sul;
+    struct lws_context    *context;
+    lws_usec_t             due;
+};
+
+void loop_lag_cb(lws_sorted_usec_list_t *sul) {
+    struct loop_lag *ll  = lws_container_of(sul, struct loop_lag, sul);
+    lws_usec_t       now = lws_now_usecs();
+
+    if (now > ll->due) metrics_loop_lag_observe((now - ll->due) * 1000);
+
+    ll->due = now + LOOP_LAG_INTERVAL;
+    lws_sul_schedule(ll->context, 0, &ll->sul, loop_lag_cb, LOOP_LAG_INTERVAL);
+}
+
+db_t *db = NULL;
+
+// window in which the edits of a user typing are merged into one version,
+// 0 (default) writes every edit
+lws_usec_t coalesce_us = 0;
+
+// a save is broadcast as the edits it makes while they weigh at most this
+// percentage of the content, as a whole content otherwise
+int save_delta_pct = 50;
+
+// bytes a broadcast edit weighs besides its string
+#define SAVE_OP_BYTES 64
 
 int main(int argc, const char **argv) {
     pthread_mutex_t snf_mut = PTHREAD_MUTEX_INITIALIZER;
@@ -45,16 +88,24 @@ int main(int argc, const char **argv) {
 
     secret_key = getenv("SECRET_KEY");
 
-    const char *db_url = getenv("DB_URL");
-    if (!db_url) {
-        fprintf(stderr, "missing env DB_URL\n");
-        exit(1);
-    }
+    // DB_BACKEND=memory runs without postgres, nothing is persisted
+    const char *db_backend = getenv("DB_BACKEND");
+    if (db_backend && strcmp(db_backend, "memory") == 0) {
+        db = db_mem_new();
+    } else {
+        const char *db_url = getenv("DB_URL");
+        if (!db_url) {
+            fprintf(stderr, "missing env DB_URL\n");
+            exit(1);
+        }
 
-    conn = PQconnectdb(db_url);
-    if (PQstatus(conn) != CONNECTION_OK) {
-        fprintf(stderr, "database connection refused\n");
-        exit(1);
+        db = db_pg_connect(db_url);
+        if (!db) {
+            error_t *err = get_error();
+            fprintf(stderr, "database connection refused: %s\n", err->message);
+            destroy_error(err);
+            exit(1);
+        }
     }
 
     int port = 8080;
@@ -69,6 +120,66 @@ int main(int argc, const char **argv) {
         port = atoi(port_s);
     }
 
+    // WS_DEFLATE=0 turns permessage-deflate off, WS_DEFLATE_LEVEL is the zlib
+    // level 1..9. only sessions opened with `?deflate=1` are compressed,
+    // WS_DEFLATE_BIN=1 / WS_DEFLATE_JSON=1 compress every binary / json one
+    const char *deflate_s = getenv("WS_DEFLATE");
+    bool        deflate   = !deflate_s || atoi(deflate_s) != 0;
+
+    deflate_s = getenv("WS_DEFLATE_LEVEL");
+    if (deflate_s) {
+        ws.deflate_level = atoi(deflate_s);
+    }
+
+    deflate_s = getenv("WS_DEFLATE_BIN");
+    if (deflate_s) {
+        ws.deflate_bin = atoi(deflate_s) != 0;
+    }
+
+    deflate_s = getenv("WS_DEFLATE_JSON");
+    if (deflate_s) {
+        ws.deflate_json = atoi(deflate_s) != 0;
+    }
+
+    // TRACE_SAMPLE=n traces 1 of every n edits without a client trace id,
+    // TRACE_FILE appends completed traces as json lines
+    const char *trace_s = getenv("TRACE_SAMPLE");
+    trace_init(trace_s ? atoi(trace_s) : 0, getenv("TRACE_FILE"));
+
+    // CAPTURE_FILE records every websocket frame for nps_replay
+    const char *capture_s = getenv("CAPTURE_FILE");
+    if (capture_s && !capture_open(capture_s)) {
+        error_t *err = get_error();
+        fprintf(stderr, "%s\n", err->message);
+        destroy_error(err);
+        exit(1);
+    }
+
+    // LOG_LEVEL=err|warn|info|debug, LOG_SAMPLE=n keeps 1 of every n
+    // per-message debug records, LOG_FILE is appended instead of stdout
+    const char *log_s = getenv("LOG_SAMPLE");
+    if (!log_init(log_level_parse(getenv("LOG_LEVEL"), LOG_INFO),
+            log_s ? atoi(log_s) : 1, getenv("LOG_FILE"))) {
+        error_t *err = get_error();
+        fprintf(stderr, "%s\n", err->message);
+        destroy_error(err);
+        exit(1);
+    }
+
+    // EDIT_COALESCE_MS=n writes the consecutive edits of a user as one
+    // version at most n ms after the first one, 0 (default) writes every edit
+    const char *coalesce_s = getenv("EDIT_COALESCE_MS");
+    if (coalesce_s) {
+        coalesce_us = atoi(coalesce_s) * LWS_US_PER_MS;
+    }
+
+    // SAVE_DELTA_MAX_PCT=n broadcasts a save as edits while they weigh at
+    // most n% of the content, 0 always sends the whole content
+    const char *save_delta_s = getenv("SAVE_DELTA_MAX_PCT");
+    if (save_delta_s) {
+        save_delta_pct = atoi(save_delta_s);
+    }
+
     struct lws_context              *context;
     struct lws_context_creation_info info;
 
@@ -82,8 +193,19 @@ int main(int argc, const char **argv) {
     info.port      = port;
     info.pvo       = &pvo;
     info.protocols = protocols;
+    if (deflate) {
+        info.extensions = extensions;
+    }
 
     info.retry_and_idle_policy = &retry;
+
+    // idle seconds before a kept-alive http connection is closed
+    info.keepalive_timeout = 5;
+
+    const char *keepalive_s = getenv("HTTP_KEEPALIVE_TIMEOUT");
+    if (keepalive_s) {
+        info.keepalive_timeout = atoi(keepalive_s);
+    }
     info.options =
         LWS_SERVER_OPTION_VALIDATE_UTF8 |
         LWS_SERVER_OPTION_HTTP_HEADERS_SECURITY_BEST_PRACTICES_ENFORCE;
@@ -94,7 +216,10 @@ int main(int argc, const char **argv) {
         return 1;
     }
 
-    lwsl_user("listening at port %d\n", port);
+    lwsl_user("listening at port %d, %s storage\n", port, db->ops->name);
+
+    struct loop_lag ll = {.context = context, .due = lws_now_usecs()};
+    loop_lag_cb(&ll.sul);
 
     int n = 0;
     while (n >= 0 && !interrupted) {
@@ -102,6 +227,9 @@ int main(int argc, const char **argv) {
     }
 
     lws_context_destroy(context);
+    capture_close();
+    log_close();
+    db_close(db);
 }
 
 size_t ws_send_res(struct lws *wsi, struct json_object *res) {
@@ -133,25 +261,657 @@ size_t ws_broadcast_res_with_file(
     return max;
 }
 
+// send `op` as a binary frame to sessions using the binary protocol and `res`
+// to the others
+size_t ws_broadcast_op_with_file(vec_t *wsis, struct lws *expect,
+    struct json_object *res, const proto_op_t *op) {
+
+    size_t   max     = 0;
+    size_t   bin_len = 0;
+    uint8_t *bin     = NULL;
+
+    for (size_t i = 0; i < wsis->len; ++i) {
+        struct lws **pwsi = vec_get(wsis, i);
+        if (*pwsi == expect) continue;
+
+        struct my_per_session_data *pss = lws_wsi_user(*pwsi);
+
+        size_t rs;
+        if (pss->bin_proto) {
+            if (!bin) {
+                bin_len = proto_encoded_len(op);
+                bin     = arena_alloc(arena_msg(), bin_len);
+                bin_len = proto_encode(op, bin, bin_len);
+            }
+            rs = my_ws_send(*pwsi, bin, bin_len, true);
+        } else {
+            rs = ws_send_res(*pwsi, res);
+        }
+
+        if (rs > max) {
+            max = rs;
+        }
+    }
+
+    return max;
+}
+
+// open `file` with the state kept for its sessions, the map owns it then
+// and file_info_drop frees it
+// file_infos: HashMap<uint64_t file id, struct file_info>
+struct file_info *file_info_new(hmap_t *file_infos, db_file_t *file) {
+    const char *content = file->contents->content;
+
+    struct file_info fi = {
+        .file  = file,
+        .wsis  = vec_new_r(struct lws *, NULL, NULL, NULL),
+        .ot    = ot_log_new(),
+        .lines = lines_new(content, strlen(content)),
+        .utf8  = utf8_index_new(content, strlen(content)),
+        .run   = calloc(1, sizeof(struct file_run)),
+    };
+    fi.run->file = file;
+    return hmap_put_r(uint64_t, struct file_info, file_infos, file->id, fi);
+}
+
+// [E]: find the opened file or load it from db, return NULL if failed
+// file_infos: HashMap<uint64_t file id, struct file_info>
+struct file_info *get_file_info(hmap_t *file_infos, uint64_t file_id) {
+    struct file_info *pfi = hmap_get_r(uint64_t, file_infos, file_id);
+    if (pfi) return pfi;
+
+    db_file_t *file = db_file_get(db, file_id, false);
+    if (!file) return NULL;
+
+    return file_info_new(file_infos, file);
+}
+
+// [E]: write the run of edits as one version of the cached content, false if
+// failed
+bool file_run_flush(struct file_run *run) {
+    if (!run->edits) return true;
+
+    lws_sul_cancel(&run->sul);
+    metrics_inc(METRICS_EDITS_COALESCED, run->edits - 1);
+    run->edits = 0;
+
+    uint64_t ver_id = db_file_save(
+        db, run->file->id, run->user_id, run->file->contents->content);
+    if (!ver_id) return false;
+
+    run->file->current_version = ver_id;
+    run->file->contents->id    = ver_id;
+    return true;
+}
+
+// end the run where nobody waits for the result, failures are only logged,
+// the next run writes the whole content again
+void file_run_end(struct file_run *run) {
+    if (file_run_flush(run)) return;
+
+    error_t *err = get_error();
+    log_emit(LOG_ERR, "edit_flush", "error", err->message, 2, "file",
+        run->file->id, "user", run->user_id);
+    destroy_error(err);
+}
+
+void file_run_cb(lws_sorted_usec_list_t *sul) {
+    file_run_end(lws_container_of(sul, struct file_run, sul));
+}
+
+// [E]: add an edit about to be applied to the run of the file, the run is
+// ended first if the edit doesn't continue it. false if the user can't edit
+bool file_run_add(struct file_info *pfi, struct lws *wsi, uint64_t user_id,
+    size_t from, size_t to, bool insert) {
+    struct file_run *run = pfi->run;
+
+    // typing, deleting forward or backspacing from where the last edit ended
+    bool extends = run->edits && run->user_id == user_id &&
+                   (from == run->cursor || (!insert && to + 1 == run->cursor));
+
+    if (!extends) {
+        file_run_end(run);
+
+        // checked once per run: db_file_update would check every edit, a
+        // permission revoked during a run applies from the next one
+        if (!db_user_has_per_on_file(db, user_id, pfi->file->id, 3)) {
+            raise_error(403, "%s: user %lu permission denied", __func__,
+                user_id);
+            return false;
+        }
+
+        run->user_id = user_id;
+        lws_sul_schedule(lws_get_context(wsi), 0, &run->sul, file_run_cb,
+            coalesce_us);
+    }
+
+    ++run->edits;
+    return true;
+}
+
+// subscribe `wsi` to the broadcasts of the file, at most once
+void file_info_subscribe(struct file_info *pfi, struct lws *wsi) {
+    if (vec_find_r(struct lws *, pfi->wsis, wsi) == -1lu) {
+        vec_push_r(struct lws *, pfi->wsis, wsi);
+    }
+}
+
+// an insert (string != NULL) or remove [from, to] made at revision `base`,
+// offsets counted in the unit of the sender's session
+struct file_edit {
+    uint64_t    user_id;
+    uint64_t    base; // 0: untracked client, applied as sent
+    int         from;
+    int         to;
+    const char *string;
+
+    // filled in by file_apply_edit and file_splice, byte offsets in from/to
+    uint64_t ver_id;
+    uint64_t rev;
+    bool     absorbed;         // undone by a concurrent edit, not applied
+    size_t   row, col;         // of `from`
+    size_t   end_row, end_col; // of the byte after a removal
+    size_t   cp[2], utf16[2];  // [start, end) in code points, UTF-16 units
+};
+
+// apply the insert of `edit->string` at `from` or the removal of bytes
+// [from, to] to the cached content, its indexes and the ot log as an op of
+// `src`. `edit` gets the offsets, positions and revision applied
+void file_splice(struct file_info *pfi, uint64_t src, struct file_edit *edit,
+    size_t from, size_t to) {
+    char  *old_content = pfi->file->contents->content;
+    size_t old_len     = strlen(old_content);
+    size_t string_len  = edit->string ? strlen(edit->string) : 0;
+
+    pfi->file->contents->content = content_splice(
+        old_content, old_len, &from, &to, edit->string, string_len);
+
+    // record what was applied, counted in every unit from the content
+    // before the edit
+    size_t  new_len = strlen(pfi->file->contents->content);
+    ot_op_t op      = {
+        .src    = src,
+        .pos    = from,
+        .len    = new_len > old_len ? new_len - old_len : old_len - new_len,
+        .insert = edit->string != NULL,
+    };
+
+    const char *changed = op.insert ? edit->string : old_content + from;
+    ot_op_t     ops[UTF8_UNITS];
+    for (int u = 0; u < UTF8_UNITS; ++u) {
+        ops[u]     = op;
+        ops[u].pos = utf8_index_from_byte(pfi->utf8, old_content, u, from);
+        ops[u].len = utf8_count(changed, op.len, u);
+    }
+
+    edit->cp[0]    = ops[UTF8_CODE_POINTS].pos;
+    edit->cp[1]    = ops[UTF8_CODE_POINTS].pos + ops[UTF8_CODE_POINTS].len;
+    edit->utf16[0] = ops[UTF8_UTF16].pos;
+    edit->utf16[1] = ops[UTF8_UTF16].pos + ops[UTF8_UTF16].len;
+
+    // positions on the content before the edit, for row/column clients
+    lines_position(pfi->lines, from, &edit->row, &edit->col);
+    if (op.insert) {
+        lines_splice(pfi->lines, from, 0, edit->string, string_len);
+        utf8_index_splice(pfi->utf8, from, NULL, 0, edit->string, string_len);
+    } else {
+        lines_position(
+            pfi->lines, from + op.len, &edit->end_row, &edit->end_col);
+        lines_splice(pfi->lines, from, op.len, NULL, 0);
+        utf8_index_splice(pfi->utf8, from, changed, op.len, NULL, 0);
+    }
+    free(old_content);
+
+    edit->from = from;
+    edit->to   = to;
+    edit->rev  = ot_log_push(pfi->ot, ops);
+}
+
+// [E]: rebase the edit of `wsi` over the ones it had not seen, then apply it
+// both in db and in the cached content, false if failed
+bool file_apply_edit(
+    struct file_info *pfi, struct lws *wsi, struct file_edit *edit) {
+    struct my_per_session_data *pss  = lws_wsi_user(wsi);
+    utf8_unit_t                 unit = pss->unit;
+
+    ot_op_t op = {
+        .src    = (uint64_t)wsi,
+        .pos    = edit->from,
+        .insert = edit->string != NULL,
+    };
+    size_t string_len = edit->string ? strlen(edit->string) : 0;
+
+    if (edit->string) {
+        if (!utf8_valid(edit->string, string_len)) {
+            raise_error(400, "%s: string is not valid utf-8", __func__);
+            return false;
+        }
+        op.len = utf8_count(edit->string, string_len, unit);
+    } else if (edit->to >= edit->from) {
+        op.len = edit->to - edit->from + 1;
+    }
+
+    if (edit->base) {
+        if (!ot_log_rebase(pfi->ot, edit->base, unit, &op)) {
+            metrics_inc(METRICS_OT_STALE, 1);
+            return false;
+        }
+        if (edit->base != pfi->ot->rev) metrics_inc(METRICS_OT_REBASED, 1);
+    }
+
+    edit->ver_id   = pfi->file->current_version;
+    edit->rev      = pfi->ot->rev;
+    edit->absorbed = op.len == 0;
+    if (edit->absorbed) return true;
+
+    char  *old_content = pfi->file->contents->content;
+    size_t old_len     = strlen(old_content);
+
+    // to bytes of the cached content, clamped to it
+    size_t from = utf8_index_to_byte(pfi->utf8, old_content, unit, op.pos);
+    size_t end  = op.insert ? from
+                            : utf8_index_to_byte(pfi->utf8, old_content, unit,
+                                  op.pos + op.len);
+
+    if (unit == UTF8_BYTES && pfi->utf8->wide &&
+        (!utf8_boundary(old_content, old_len, from) ||
+            !utf8_boundary(old_content, old_len, end))) {
+        raise_error(400, "%s: offset inside a character", __func__);
+        return false;
+    }
+
+    // a removal past the end of the content
+    edit->absorbed = !op.insert && end == from;
+    if (edit->absorbed) return true;
+
+    // inserts are sent with to == from
+    size_t to = op.insert ? from : end - 1;
+
+    // with coalescing the version is written when the run ends, broadcasts
+    // carry the last version written until then
+    uint64_t ver_id = pfi->file->current_version;
+
+    if (coalesce_us) {
+        if (!file_run_add(pfi, wsi, edit->user_id, from, to, op.insert)) {
+            return false;
+        }
+    } else {
+        ver_id = db_file_update(
+            db, pfi->file->id, edit->user_id, from, to, edit->string);
+        if (!ver_id) return false;
+
+        pfi->file->contents->id    = ver_id;
+        pfi->file->current_version = ver_id;
+    }
+    pfi->file->contents->update_by = edit->user_id;
+
+    file_splice(pfi, op.src, edit, from, to);
+
+    pfi->run->cursor = edit->from + (op.insert ? string_len : 0);
+    edit->ver_id     = ver_id;
+    return true;
+}
+
+// `unit`s before (row, col), the column counted in `unit` and clamped to
+// the row
+static size_t file_units_at(
+    struct file_info *pfi, utf8_unit_t unit, size_t row, size_t col) {
+    const char *content = pfi->file->contents->content;
+
+    size_t start = utf8_index_from_byte(
+        pfi->utf8, content, unit, lines_offset(pfi->lines, row, 0));
+    size_t end = utf8_index_from_byte(
+        pfi->utf8, content, unit, lines_offset(pfi->lines, row, -1lu));
+    return col < end - start ? start + col : end;
+}
+
+// [E]: turn the row and column of an insert-at/remove-at into the offsets of
+// `edit`, the end of a removal is excluded. they are read on the cached
+// content, so false if the sender had not seen all of it
+bool file_edit_at(struct file_info *pfi, struct lws *wsi,
+    struct file_edit *edit, size_t row, size_t col, size_t end_row,
+    size_t end_col) {
+    struct my_per_session_data *pss = lws_wsi_user(wsi);
+
+    if (edit->base && !ot_log_synced(pfi->ot, edit->base, (uint64_t)wsi)) {
+        metrics_inc(METRICS_OT_STALE, 1);
+        return false;
+    }
+
+    size_t from = file_units_at(pfi, pss->unit, row, col);
+    size_t to   = from;
+
+    if (!edit->string) {
+        size_t end = file_units_at(pfi, pss->unit, end_row, end_col);
+        if (end <= from) {
+            raise_error(400, "%s: invalid position", __func__);
+            return false;
+        }
+        to = end - 1;
+    }
+
+    edit->from = from;
+    edit->to   = to;
+    return true;
+}
+
+// broadcast an applied insert/remove to the other subscribers of the file
+void ws_broadcast_edit(struct file_info *pfi, struct lws *wsi,
+    struct json_object *res, const char *type, const struct file_edit *edit) {
+
+    struct json_object *new_version = json_object_new_object();
+    char                fid[21], uid[21], vid[21];
+
+    sprintf(fid, "%lu", pfi->file->id);
+    sprintf(vid, "%lu", edit->ver_id);
+    sprintf(uid, "%lu", edit->user_id);
+
+    json_object_object_add(new_version, "file_id", json_object_new_string(fid));
+    json_object_object_add(new_version, "ver_id", json_object_new_string(vid));
+    json_object_object_add(new_version, "update_by",
+        edit->user_id == 0 ? NULL : json_object_new_string(uid));
+    json_object_object_add(
+        new_version, "from", json_object_new_int(edit->from));
+    json_object_object_add(new_version, "to", json_object_new_int(edit->to));
+    json_object_object_add(
+        new_version, "rev", json_object_new_int64(edit->rev));
+
+    // [row, col] of `from`, then of the end of a removal
+    struct json_object *at = json_object_new_array();
+    json_object_array_add(at, json_object_new_int64(edit->row));
+    json_object_array_add(at, json_object_new_int64(edit->col));
+    if (!edit->string) {
+        json_object_array_add(at, json_object_new_int64(edit->end_row));
+        json_object_array_add(at, json_object_new_int64(edit->end_col));
+    }
+    json_object_object_add(new_version, "at", at);
+
+    struct json_object *cp    = json_object_new_array();
+    struct json_object *utf16 = json_object_new_array();
+    for (int i = 0; i < 2; ++i) {
+        json_object_array_add(cp, json_object_new_int64(edit->cp[i]));
+        json_object_array_add(utf16, json_object_new_int64(edit->utf16[i]));
+    }
+    json_object_object_add(new_version, "cp", cp);
+    json_object_object_add(new_version, "utf16", utf16);
+
+    if (edit->string) {
+        json_object_object_add(
+            new_version, "string", json_object_new_string(edit->string));
+    }
+
+    json_object_object_add(res, type, new_version);
+
+    proto_op_t op = {
+        .op         = edit->string ? PROTO_OP_INSERT : PROTO_OP_REMOVE,
+        .file_id    = pfi->file->id,
+        .ver_id     = edit->ver_id,
+        .user_id    = edit->user_id,
+        .from       = edit->from,
+        .to         = edit->to,
+        .rev        = edit->rev,
+        .string     = edit->string,
+        .string_len = edit->string ? strlen(edit->string) : 0,
+    };
+
+    ws_broadcast_op_with_file(pfi->wsis, wsi, res, &op);
+}
+
+// tell the sender of an edit made at a base revision which revision it
+// produced, `res` holds the event of the edit
+void ws_ack_edit(struct file_info *pfi, struct lws *wsi,
+    struct json_object *res, const struct file_edit *edit) {
+    struct my_per_session_data *pss = lws_wsi_user(wsi);
+
+    if (pss->bin_proto) {
+        proto_op_t op = {
+            .op      = PROTO_OP_ACK,
+            .file_id = pfi->file->id,
+            .ver_id  = edit->ver_id,
+            .rev     = edit->rev,
+        };
+
+        uint8_t bin[4 * PROTO_VARINT_MAX];
+        size_t  len = proto_encode(&op, bin, sizeof(bin));
+        my_ws_send(wsi, bin, len, true);
+        return;
+    }
+
+    struct json_object *ack = json_object_new_object();
+    struct json_object *event;
+    char                fid[21], vid[21];
+
+    sprintf(fid, "%lu", pfi->file->id);
+    sprintf(vid, "%lu", edit->ver_id);
+
+    json_object_object_add(ack, "file_id", json_object_new_string(fid));
+    json_object_object_add(ack, "ver_id", json_object_new_string(vid));
+    json_object_object_add(ack, "rev", json_object_new_int64(edit->rev));
+    json_object_object_add(
+        ack, "absorbed", json_object_new_boolean(edit->absorbed));
+
+    struct json_object *ack_res = json_object_new_object();
+    json_object_object_add(ack_res, "ack", ack);
+    if (json_object_object_get_ex(res, "event", &event)) {
+        json_object_object_add(ack_res, "event", json_object_get(event));
+    }
+
+    ws_send_res(wsi, ack_res);
+    json_object_put(ack_res);
+}
+
+// broadcast a save as the edits turning the cached content into `content`,
+// applied to it as ops of the sender so edits in flight are rebased over
+// them. false if they weigh more than save_delta_pct of the content, the
+// cache is left untouched then
+bool file_save_delta(struct file_info *pfi, struct lws *wsi,
+    struct json_object *res, uint64_t user_id, const char *content) {
+    const char *cached     = pfi->file->contents->content;
+    size_t      cached_len = strlen(cached), len = strlen(content);
+
+    vec_t *hunks = diff_hunks(cached, cached_len, content, len);
+
+    size_t weight = 0, ops = 0;
+    for (size_t i = 0; i < hunks->len; ++i) {
+        diff_hunk_t hunk = vec_at_r(diff_hunk_t, hunks, i);
+        size_t      n    = (hunk.removed > 0) + (hunk.inserted > 0);
+
+        weight += hunk.removed + hunk.inserted + n * SAVE_OP_BYTES;
+        ops += n;
+    }
+
+    // the ops must also leave room in the ot history for edits in flight
+    size_t size = cached_len > len ? cached_len : len;
+    if (save_delta_pct <= 0 || weight * 100 > save_delta_pct * size ||
+        ops > OT_HISTORY / 4) {
+        vec_drop(hunks);
+        return false;
+    }
+
+    struct file_edit edit = {
+        .user_id = user_id,
+        .ver_id  = pfi->file->current_version,
+        .rev     = pfi->ot->rev,
+    };
+
+    for (size_t i = 0; i < hunks->len; ++i) {
+        diff_hunk_t         hunk = vec_at_r(diff_hunk_t, hunks, i);
+        struct json_object *op_res;
+
+        if (hunk.removed) {
+            edit.string = NULL;
+            file_splice(pfi, (uint64_t)wsi, &edit, hunk.at,
+                hunk.at + hunk.removed - 1);
+
+            op_res = json_object_new_object();
+            ws_broadcast_edit(pfi, wsi, op_res, CMD_REMOVE, &edit);
+            json_object_put(op_res);
+        }
+        if (hunk.inserted) {
+            char *string = strndup(content + hunk.at, hunk.inserted);
+            edit.string  = string;
+            file_splice(pfi, (uint64_t)wsi, &edit, hunk.at, hunk.at);
+
+            op_res = json_object_new_object();
+            ws_broadcast_edit(pfi, wsi, op_res, CMD_INSERT, &edit);
+            json_object_put(op_res);
+            free(string);
+        }
+    }
+    vec_drop(hunks);
+
+    // the sender has the content, it only needs the revision
+    ws_ack_edit(pfi, wsi, res, &edit);
+    metrics_inc(METRICS_SAVES_DELTA, 1);
+    return true;
+}
+
+// broadcast the user pointer of `wsi` to the other subscribers of the file
+void ws_broadcast_cursor(struct file_info *pfi, struct lws *wsi,
+    struct json_object *res, int row, int column) {
+    struct my_per_session_data *pss = lws_wsi_user(wsi);
+
+    char wid[21];
+    sprintf(wid, "%lu", (uint64_t)wsi);
+
+    json_object *user_pointer = json_object_new_object();
+    json_object_object_add(user_pointer, "username",
+        pss->user ? json_object_new_string(pss->user->username) : NULL);
+    json_object_object_add(user_pointer, "ws_id", json_object_new_string(wid));
+    json_object_object_add(user_pointer, "row", json_object_new_int(row));
+    json_object_object_add(user_pointer, "column", json_object_new_int(column));
+
+    json_object_object_add(res, CMD_SET_USER_POINTER, user_pointer);
+
+    proto_op_t op = {
+        .op      = PROTO_OP_CURSOR,
+        .file_id = pfi->file->id,
+        .user_id = pss->user ? pss->user->id : 0,
+        .ws_id   = (uint64_t)wsi,
+        .from    = row,
+        .to      = column,
+    };
+
+    ws_broadcast_op_with_file(pfi->wsis, wsi, res, &op);
+}
+
+// ver_id, update_by and ts (unix ms) of a version, its content is fetched
+// apart
+struct json_object *version_meta_json(const db_content_version_t *ver) {
+    char vid[21], uid[21];
+    sprintf(vid, "%lu", ver->id);
+    sprintf(uid, "%lu", ver->update_by);
+
+    struct json_object *meta = json_object_new_object();
+    json_object_object_add(meta, "ver_id", json_object_new_string(vid));
+    json_object_object_add(meta, "update_by",
+        ver->update_by != 0 ? json_object_new_string(uid) : NULL);
+    json_object_object_add(
+        meta, "ts", json_object_new_int64(snowflake_id_to_msec(ver->id)));
+    return meta;
+}
+
+// a page of `limit` versions at most, "next" is the `before` of the page
+// after it, null once a page comes short
+struct json_object *history_json(
+    uint64_t file_id, const db_content_version_t *history, size_t limit) {
+    char fid[21], next[21];
+    sprintf(fid, "%lu", file_id);
+
+    struct json_object *page     = json_object_new_object();
+    struct json_object *versions = json_object_new_array();
+    size_t              count    = 0;
+
+    for (const db_content_version_t *ver = history; ver; ver = ver->prev) {
+        json_object_array_add(versions, version_meta_json(ver));
+        if (++count == limit) sprintf(next, "%lu", ver->id);
+    }
+
+    json_object_object_add(page, "file_id", json_object_new_string(fid));
+    json_object_object_add(page, "versions", versions);
+    json_object_object_add(page, "next",
+        count == limit ? json_object_new_string(next) : NULL);
+    return page;
+}
+
+// [E]: version `ver_id` of the file, the cached one if it is that version.
+// otherwise it is loaded to `*ploaded` as well, for the caller to drop
+const db_content_version_t *file_version(struct file_info *pfi,
+    const db_file_t *file, uint64_t ver_id, db_content_version_t **ploaded) {
+    *ploaded = NULL;
+
+    // the cached content is ahead of its version while a run is pending
+    if (file->contents->id == ver_id && !(pfi && pfi->run->edits)) {
+        return file->contents;
+    }
+    return *ploaded = db_content_version_get(db, file->id, ver_id);
+}
+
+// hunks turning `a` into `b` as [at, removed, string] in `unit`s, `at` is
+// counted in `b` and `removed` in `a`
+struct json_object *diff_ops_json(
+    const char *a, const char *b, const vec_t *hunks, utf8_unit_t unit) {
+    struct json_object *ops = json_object_new_array();
+    size_t              at = 0, units = 0;
+
+    for (size_t i = 0; i < hunks->len; ++i) {
+        diff_hunk_t hunk = vec_at_r(diff_hunk_t, hunks, i);
+
+        units += utf8_count(b + at, hunk.at - at, unit);
+        at = hunk.at;
+
+        struct json_object *op = json_object_new_array();
+        json_object_array_add(op, json_object_new_int64(units));
+        json_object_array_add(op,
+            json_object_new_int64(
+                utf8_count(a + hunk.from, hunk.removed, unit)));
+        json_object_array_add(op,
+            json_object_new_string_len(b + hunk.at, hunk.inserted));
+        json_object_array_add(ops, op);
+    }
+
+    return ops;
+}
+
+// [E]: the session may read the file, public files skip the db
+bool ws_can_read(struct lws *wsi, const db_file_t *file) {
+    struct my_per_session_data *pss = lws_wsi_user(wsi);
+
+    if (file->everyone_can >= 1) return true;
+    if (pss->user && db_user_has_per_on_file(db, pss->user->id, file->id, 1)) {
+        return true;
+    }
+
+    raise_error(403, "%s: permission denied", __func__);
+    return false;
+}
+
 void onopen(struct lws *wsi) {
     struct my_per_session_data *pss = lws_wsi_user(wsi);
 
-    char path[1024], token[1024];
-    path[0]  = '\0';
+    char token[1024], proto[16], unit[8];
     token[0] = '\0';
+    proto[0] = '\0';
+    unit[0]  = '\0';
 
-    lws_hdr_copy(wsi, path, 1023, WSI_TOKEN_GET_URI);
     lws_get_urlarg_by_name(wsi, "token", token, 1023);
+    lws_get_urlarg_by_name(wsi, "proto", proto, 15);
+    lws_get_urlarg_by_name(wsi, "unit", unit, 7);
+
+    pss->bin_proto = strcmp(proto, PROTO_NAME) == 0;
+    // binary frames count bytes, as their broadcasts do
+    pss->unit = pss->bin_proto ? UTF8_BYTES : utf8_unit_parse(unit, UTF8_BYTES);
 
     uint64_t uid = 0;
     if (jwt_decode(token, secret_key, &uid)) {
-        pss->user = db_user_get(conn, uid, NULL);
+        pss->user = db_user_get(db, uid, NULL);
     } else {
         pss->user = NULL;
     }
 
-    lwsl_warn("new connection: %p: user: %s: path: %s", wsi,
-        pss->user ? pss->user->username : NULL, path);
+    log_emit(LOG_INFO, "ws_open", "user",
+        pss->user ? pss->user->username : NULL, 2, "wsi", (uint64_t)wsi,
+        "bin", (uint64_t)pss->bin_proto);
 
     struct json_object *res  = json_object_new_object();
     struct json_object *acpt = json_object_new_object();
@@ -176,22 +936,24 @@ void onopen(struct lws *wsi) {
     sprintf(ws_id, "%lu", (uint64_t)wsi);
     json_object_object_add(acpt, "ws_id", json_object_new_string(ws_id));
     json_object_object_add(acpt, "user", user);
+    json_object_object_add(acpt, "proto",
+        json_object_new_string(pss->bin_proto ? PROTO_NAME : "json"));
+    json_object_object_add(acpt, "batch", json_object_new_boolean(pss->batch));
+    json_object_object_add(
+        acpt, "unit", json_object_new_string(utf8_unit_name(pss->unit)));
     json_object_object_add(res, "accept", acpt);
 
     ws_send_res(wsi, res);
     json_object_put(res);
 }
 
-// file_infos: Vec<struct file_info>
-void remove_ws_from_file(vec_t *file_infos, struct lws *wsi) {
+// file_infos: HashMap<uint64_t file id, struct file_info>
+void remove_ws_from_file(hmap_t *file_infos, struct lws *wsi) {
     struct my_per_session_data *pss = lws_wsi_user(wsi);
     if (!pss->file) return;
 
-    struct file_info fi = {
-        .file = &(db_file_t){.id = pss->file->id},
-        .wsis = NULL,
-    };
-    struct file_info *pfi = vec_get(file_infos, vec_index_of(file_infos, &fi));
+    uint64_t          file_id = pss->file->id;
+    struct file_info *pfi     = hmap_get_r(uint64_t, file_infos, file_id);
     if (!pfi || pfi->wsis == NULL) return;
 
     struct json_object *res = json_object_new_object();
@@ -199,10 +961,36 @@ void remove_ws_from_file(vec_t *file_infos, struct lws *wsi) {
     ws_broadcast_res_with_file(pfi->wsis, wsi, res);
     json_object_put(res);
 
-    vec_remove_by(pfi->wsis, &wsi);
+    vec_swap_remove_by_r(struct lws *, pfi->wsis, wsi);
+    ot_log_forget(pfi->ot, (uint64_t)wsi);
     if (pfi->wsis->len == 0) {
-        vec_remove_by(file_infos, &fi);
+        pss->file = NULL;
+        file_run_end(pfi->run);
+        hmap_remove_r(uint64_t, file_infos, file_id);
+    }
+}
+
+// edits also subscribe to files other than pss->file, leave all of them
+void remove_ws_from_files(hmap_t *file_infos, struct lws *wsi) {
+    remove_ws_from_file(file_infos, wsi);
+
+    vec_t            *emptied = vec_new_r(uint64_t, NULL, NULL, NULL);
+    uint64_t         *pid;
+    struct file_info *pfi;
+
+    hmap_foreach(file_infos, pid, pfi) {
+        if (!vec_swap_remove_by_r(struct lws *, pfi->wsis, wsi)) continue;
+
+        ot_log_forget(pfi->ot, (uint64_t)wsi);
+        if (pfi->wsis->len == 0) vec_push_r(uint64_t, emptied, *pid);
     }
+
+    for (size_t i = 0; i < emptied->len; ++i) {
+        pfi = hmap_get(file_infos, vec_get(emptied, i));
+        file_run_end(pfi->run);
+        hmap_remove(file_infos, vec_get(emptied, i));
+    }
+    vec_drop(emptied);
 }
 
 void onclose(struct lws *wsi) {
@@ -210,25 +998,132 @@ void onclose(struct lws *wsi) {
     struct my_per_vhost_data   *vhd =
         lws_protocol_vh_priv_get(lws_get_vhost(wsi), lws_get_protocol(wsi));
 
-    lwsl_warn("connection closed: %p: user: %s", wsi,
-        pss->user ? pss->user->username : NULL);
+    log_emit(LOG_INFO, "ws_close", "user",
+        pss->user ? pss->user->username : NULL, 1, "wsi", (uint64_t)wsi);
 
-    remove_ws_from_file(vhd->files, wsi);
+    remove_ws_from_files(vhd->files, wsi);
     db_user_drop(pss->user);
 }
 
+// write the pending runs of edits before the open files are dropped
+void ondestroy(struct my_per_vhost_data *vhd) {
+    uint64_t         *pid;
+    struct file_info *pfi;
+    hmap_foreach(vhd->files, pid, pfi) file_run_end(pfi->run);
+}
+
+// binary protocol frames, see proto.h
+void onmessage_bin(struct lws *wsi, const void *msg, size_t len) {
+    struct my_per_session_data *pss = lws_wsi_user(wsi);
+    struct my_per_vhost_data   *vhd =
+        lws_protocol_vh_priv_get(lws_get_vhost(wsi), lws_get_protocol(wsi));
+
+    uint64_t start = metrics_now_ns();
+    trace_t *trace = NULL;
+
+    struct json_object *res  = json_object_new_object();
+    const char         *type = "proto";
+    proto_op_t          op;
+
+    if (!proto_decode(msg, len, &op)) {
+        goto __onmsg_bin_error;
+    }
+
+    if (op.op == PROTO_OP_CURSOR) {
+        type = CMD_SET_USER_POINTER;
+
+        struct file_info *pfi = hmap_get_r(uint64_t, vhd->files, op.file_id);
+
+        if (!pfi || vec_find_r(struct lws *, pfi->wsis, wsi) == -1lu) {
+            raise_error(402, "%s: file not open", __func__);
+            goto __onmsg_bin_error;
+        }
+
+        ws_broadcast_cursor(pfi, wsi, res, op.from, op.to);
+        goto __onmsg_bin_drops;
+    }
+
+    type = op.op == PROTO_OP_INSERT ? CMD_INSERT : CMD_REMOVE;
+
+    struct file_edit edit = {
+        .user_id = op.user_id,
+        .base    = op.rev,
+        .from    = op.from,
+        .to      = op.to,
+    };
+
+    trace = trace_begin(
+        NULL, 0, pss->recv_ns, cmd_type_index(type), op.file_id);
+
+    if (edit.from < 0 || (edit.to > 0 && edit.to < edit.from)) {
+        raise_error(400, "%s: invalid offset", __func__);
+        goto __onmsg_bin_error;
+    }
+    trace_mark(trace, TRACE_VALIDATE);
+
+    if (op.op == PROTO_OP_INSERT) {
+        edit.string = arena_strndup(arena_msg(), op.string, op.string_len);
+    }
+    json_object_object_add(res, "event", NULL);
+
+    struct file_info *pfi = get_file_info(vhd->files, op.file_id);
+    if (!pfi) {
+        goto __onmsg_bin_error;
+    }
+    file_info_subscribe(pfi, wsi);
+
+    if (!file_apply_edit(pfi, wsi, &edit)) {
+        goto __onmsg_bin_error;
+    }
+    trace_mark(trace, TRACE_DB);
+
+    trace_set_current(trace);
+    if (!edit.absorbed) ws_broadcast_edit(pfi, wsi, res, type, &edit);
+    if (edit.base) ws_ack_edit(pfi, wsi, res, &edit);
+    trace_mark(trace, TRACE_ENQUEUE);
+
+    goto __onmsg_bin_drops;
+
+__onmsg_bin_error:;
+    error_t *err = get_error();
+
+    struct json_object *res_err = json_object_new_object();
+    json_object_object_add(
+        res_err, "error", json_object_new_string(err->message));
+    json_object_object_add(res, type, res_err);
+
+    ws_send_res(wsi, res);
+    destroy_error(err);
+
+__onmsg_bin_drops:
+    trace_end(trace);
+    metrics_cmd_observe(cmd_type_index(type), metrics_now_ns() - start);
+
+    json_object_put(res);
+}
+
 void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
     struct my_per_session_data *pss = lws_wsi_user(wsi);
     struct my_per_vhost_data   *vhd =
         lws_protocol_vh_priv_get(lws_get_vhost(wsi), lws_get_protocol(wsi));
 
-    lwsl_err("got %ld, bin: %d: user: %s", len, is_bin,
-        pss->user ? pss->user->username : NULL);
+    // one per keystroke, sampled
+    if (log_on(LOG_DEBUG) && log_sampled()) {
+        log_emit(LOG_DEBUG, "ws_msg", "user",
+            pss->user ? pss->user->username : NULL, 3, "wsi", (uint64_t)wsi,
+            "len", (uint64_t)len, "bin", (uint64_t)is_bin);
+    }
+
+    if (is_bin) {
+        onmessage_bin(wsi, msg, len);
+        return;
+    }
 
-    if (is_bin) return;
+    uint64_t start   = metrics_now_ns();
+    int      cmd_idx = -1;
+    trace_t *trace   = NULL;
 
-    char *msg_s = malloc(len + 1);
-    strncpy(msg_s, msg, len);
+    char *msg_s = arena_strndup(arena_msg(), msg, len);
 
     struct json_object *res = json_object_new_object();
 
@@ -242,8 +1137,8 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
         goto __onmsg_drops;
     }
 
-    cmd_show(cmd);
     const char *type = json_object_get_string(cmd->type);
+    cmd_idx          = cmd_type_index(type);
     if (CMD_IS_TYPE_OF(type, CMD_LOGIN)) {
         const char *token =
             json_object_get_string(json_object_array_get_idx(cmd->args, 0));
@@ -251,7 +1146,7 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
         uint64_t uid = 0;
         if (jwt_decode(token, secret_key, &uid)) {
             db_user_drop(pss->user);
-            pss->user = db_user_get(conn, uid, NULL);
+            pss->user = db_user_get(db, uid, NULL);
         } else {
             pss->user = NULL;
         }
@@ -287,19 +1182,16 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
         struct json_object *arr = json_object_new_array();
         struct json_object *arr_elm;
 
-        PGresult *db_res = db_get_file_types(conn);
-        int       rows   = PQntuples(db_res);
-        for (int i = 0; i < rows; ++i) {
+        db_named_t *db_res = db_get_file_types(db);
+        for (db_named_t *row = db_res; row; row = row->next) {
             arr_elm = json_object_new_array();
 
-            json_object_array_add(
-                arr_elm, json_object_new_int(atoi(PQgetvalue(db_res, i, 0))));
-            json_object_array_add(
-                arr_elm, json_object_new_string(PQgetvalue(db_res, i, 1)));
+            json_object_array_add(arr_elm, json_object_new_int(row->id));
+            json_object_array_add(arr_elm, json_object_new_string(row->name));
 
             json_object_array_add(arr, arr_elm);
         }
-        PQclear(db_res);
+        db_named_drop(db_res);
 
         json_object_object_add(res, CMD_GET_FILE_TYPES, arr);
         ws_send_res(wsi, res);
@@ -307,19 +1199,16 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
         struct json_object *arr = json_object_new_array();
         struct json_object *arr_elm;
 
-        PGresult *db_res = db_get_permissions(conn);
-        int       rows   = PQntuples(db_res);
-        for (int i = 0; i < rows; ++i) {
+        db_named_t *db_res = db_get_permissions(db);
+        for (db_named_t *row = db_res; row; row = row->next) {
             arr_elm = json_object_new_array();
 
-            json_object_array_add(
-                arr_elm, json_object_new_int(atoi(PQgetvalue(db_res, i, 0))));
-            json_object_array_add(
-                arr_elm, json_object_new_string(PQgetvalue(db_res, i, 1)));
+            json_object_array_add(arr_elm, json_object_new_int(row->id));
+            json_object_array_add(arr_elm, json_object_new_string(row->name));
 
             json_object_array_add(arr, arr_elm);
         }
-        PQclear(db_res);
+        db_named_drop(db_res);
 
         json_object_object_add(res, CMD_GET_PER_TYPES, arr);
         ws_send_res(wsi, res);
@@ -329,31 +1218,26 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
         bool get_all =
             json_object_get_boolean(json_object_array_get_idx(cmd->args, 1));
 
-        struct file_info fi = {
-            .file = &(db_file_t){.id = file_id},
-            .wsis = NULL,
-        };
-        struct file_info *pfi =
-            vec_get(vhd->files, vec_index_of(vhd->files, &fi));
+        // leave the file opened before, dropped with its last subscriber
+        if (pss->file && pss->file->id != file_id) {
+            remove_ws_from_file(vhd->files, wsi);
+            pss->file = NULL;
+        }
 
+        struct file_info *pfi = get_file_info(vhd->files, file_id);
         if (!pfi) {
-            fi.file = db_file_get(conn, file_id, false);
-            if (!fi.file) {
-                goto __onmsg_error;
-            }
-
-            fi.wsis = vec_new_r(struct lws *, NULL, NULL, NULL);
-            vec_add(vhd->files, &fi);
-            pfi = vec_get(vhd->files, vec_index_of(vhd->files, &fi));
+            goto __onmsg_error;
         }
 
-        vec_add(pfi->wsis, &wsi);
-        remove_ws_from_file(vhd->files, wsi);
+        file_info_subscribe(pfi, wsi);
         pss->file = pfi->file;
 
+        // the content and its version id include the edits not written yet
+        file_run_end(pfi->run);
+
         db_file_t *file = pfi->file;
         if (get_all) {
-            file = db_file_get(conn, file_id, true);
+            file = db_file_get(db, file_id, true);
             if (!file) {
                 goto __onmsg_error;
             }
@@ -382,47 +1266,170 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
             json_object_array_add(contents, version);
         }
 
-        json_object_object_add(
-            file_res, "file_id", json_object_new_string(fid));
-        json_object_object_add(
-            file_res, "everyone_can", json_object_new_int(file->everyone_can));
-        json_object_object_add(
-            file_res, "file_type", json_object_new_int(file->type_id));
-        json_object_object_add(file_res, "contents", contents);
+        json_object_object_add(
+            file_res, "file_id", json_object_new_string(fid));
+        json_object_object_add(
+            file_res, "everyone_can", json_object_new_int(file->everyone_can));
+        json_object_object_add(
+            file_res, "file_type", json_object_new_int(file->type_id));
+        json_object_object_add(file_res, "contents", contents);
+        json_object_object_add(
+            file_res, "rev", json_object_new_int64(pfi->ot->rev));
+
+        json_object_object_add(res, CMD_GET, file_res);
+        ws_send_res(wsi, res);
+
+        if (get_all) {
+            db_file_drop(file);
+        }
+    } else if (CMD_IS_TYPE_OF(type, CMD_GET_HISTORY)) {
+        uint64_t file_id = atol(
+            json_object_get_string(json_object_array_get_idx(cmd->args, 0)));
+        uint64_t before = atol(
+            json_object_get_string(json_object_array_get_idx(cmd->args, 1)));
+        int64_t limit =
+            json_object_get_int64(json_object_array_get_idx(cmd->args, 2));
+
+        if (limit <= 0 || limit > DB_HISTORY_PAGE_MAX) {
+            limit = DB_HISTORY_PAGE_MAX;
+        }
+
+        // listing doesn't open the file, only its metadata is needed
+        struct file_info *pfi = hmap_get_r(uint64_t, vhd->files, file_id);
+        db_file_t *file = pfi ? pfi->file : db_file_get(db, file_id, false);
+        if (!file) {
+            goto __onmsg_error;
+        }
+
+        bool can_read = ws_can_read(wsi, file);
+        if (!pfi) db_file_drop(file);
+        if (!can_read) {
+            goto __onmsg_error;
+        }
+
+        // the newest page includes the edits not written yet
+        if (pfi && !before) file_run_end(pfi->run);
+
+        db_content_version_t *history = NULL;
+        if (!db_file_history(db, file_id, before, limit, &history)) {
+            goto __onmsg_error;
+        }
+
+        json_object_object_add(
+            res, CMD_GET_HISTORY, history_json(file_id, history, limit));
+        ws_send_res(wsi, res);
+
+        db_content_version_drop(history);
+    } else if (CMD_IS_TYPE_OF(type, CMD_GET_VERSION)) {
+        uint64_t file_id = atol(
+            json_object_get_string(json_object_array_get_idx(cmd->args, 0)));
+        uint64_t ver_id = atol(
+            json_object_get_string(json_object_array_get_idx(cmd->args, 1)));
+
+        struct file_info *pfi = hmap_get_r(uint64_t, vhd->files, file_id);
+        db_file_t *file = pfi ? pfi->file : db_file_get(db, file_id, false);
+        if (!file) {
+            goto __onmsg_error;
+        }
+
+        const db_content_version_t *ver    = NULL;
+        db_content_version_t       *loaded = NULL;
+        if (ws_can_read(wsi, file)) {
+            ver = file_version(pfi, file, ver_id, &loaded);
+        }
+        if (!ver) {
+            if (!pfi) db_file_drop(file);
+            goto __onmsg_error;
+        }
+
+        char fid[21];
+        sprintf(fid, "%lu", file_id);
+
+        struct json_object *version = version_meta_json(ver);
+        json_object_object_add(version, "file_id", json_object_new_string(fid));
+        json_object_object_add(
+            version, "content", json_object_new_string(ver->content));
+
+        json_object_object_add(res, CMD_GET_VERSION, version);
+        ws_send_res(wsi, res);
+
+        db_content_version_drop(loaded);
+        if (!pfi) db_file_drop(file);
+    } else if (CMD_IS_TYPE_OF(type, CMD_DIFF)) {
+        uint64_t file_id = atol(
+            json_object_get_string(json_object_array_get_idx(cmd->args, 0)));
+        uint64_t from_id = atol(
+            json_object_get_string(json_object_array_get_idx(cmd->args, 1)));
+        uint64_t to_id = atol(
+            json_object_get_string(json_object_array_get_idx(cmd->args, 2)));
+
+        struct file_info *pfi = hmap_get_r(uint64_t, vhd->files, file_id);
+        db_file_t *file = pfi ? pfi->file : db_file_get(db, file_id, false);
+        if (!file) {
+            goto __onmsg_error;
+        }
+
+        // 0: up to the current version, with the edits not written yet
+        if (!to_id && pfi) file_run_end(pfi->run);
+        if (!to_id) to_id = file->contents->id;
+
+        const db_content_version_t *from = NULL, *to = NULL;
+        db_content_version_t       *from_loaded = NULL, *to_loaded = NULL;
+        if (ws_can_read(wsi, file) &&
+            (from = file_version(pfi, file, from_id, &from_loaded))) {
+            to = file_version(pfi, file, to_id, &to_loaded);
+        }
+        if (!to) {
+            db_content_version_drop(from_loaded);
+            if (!pfi) db_file_drop(file);
+            goto __onmsg_error;
+        }
+
+        vec_t *hunks = diff_hunks(from->content, strlen(from->content),
+            to->content, strlen(to->content));
 
-        json_object_object_add(res, CMD_GET, file_res);
+        char fid[21], from_s[21], to_s[21];
+        sprintf(fid, "%lu", file_id);
+        sprintf(from_s, "%lu", from_id);
+        sprintf(to_s, "%lu", to_id);
+
+        struct json_object *diff = json_object_new_object();
+        json_object_object_add(diff, "file_id", json_object_new_string(fid));
+        json_object_object_add(diff, "from", json_object_new_string(from_s));
+        json_object_object_add(diff, "to", json_object_new_string(to_s));
+        json_object_object_add(diff, "ops",
+            diff_ops_json(from->content, to->content, hunks, pss->unit));
+        if (pfi && to == file->contents) {
+            json_object_object_add(
+                diff, "rev", json_object_new_int64(pfi->ot->rev));
+        }
+
+        json_object_object_add(res, CMD_DIFF, diff);
         ws_send_res(wsi, res);
 
-        if (get_all) {
-            db_file_drop(file);
-        }
+        vec_drop(hunks);
+        db_content_version_drop(from_loaded);
+        db_content_version_drop(to_loaded);
+        if (!pfi) db_file_drop(file);
     } else if (CMD_IS_TYPE_OF(type, CMD_GET_FILE_PERS)) {
         uint64_t file_id = atol(
             json_object_get_string(json_object_array_get_idx(cmd->args, 0)));
 
-        struct file_info fi = {
-            .file = &(db_file_t){.id = file_id},
-            .wsis = NULL,
-        };
-        struct file_info *pfi =
-            vec_get(vhd->files, vec_index_of(vhd->files, &fi));
+        // leave the file opened before, dropped with its last subscriber
+        if (pss->file && pss->file->id != file_id) {
+            remove_ws_from_file(vhd->files, wsi);
+            pss->file = NULL;
+        }
 
+        struct file_info *pfi = get_file_info(vhd->files, file_id);
         if (!pfi) {
-            fi.file = db_file_get(conn, file_id, false);
-            if (!fi.file) {
-                goto __onmsg_error;
-            }
-
-            fi.wsis = vec_new_r(struct lws *, NULL, NULL, NULL);
-            vec_add(vhd->files, &fi);
-            pfi = vec_get(vhd->files, vec_index_of(vhd->files, &fi));
+            goto __onmsg_error;
         }
 
-        vec_add(pfi->wsis, &wsi);
-        remove_ws_from_file(vhd->files, wsi);
+        file_info_subscribe(pfi, wsi);
         pss->file = pfi->file;
 
-        db_file_pers_t *file_pers = db_file_get_pers(conn, file_id);
+        db_file_pers_t *file_pers = db_file_get_pers(db, file_id);
 
         char                uid[21];
         struct json_object *file_pers_res = json_object_new_object();
@@ -459,7 +1466,7 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
             raise_error(401, "%s: user not login", __func__);
             goto __onmsg_error;
         } else {
-            current_user_pers = db_file_get_user_per(conn, current_user->id);
+            current_user_pers = db_file_get_user_per(db, current_user->id);
         }
 
         char fid[21];
@@ -491,26 +1498,13 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
         uint64_t per_id =
             json_object_get_int64(json_object_array_get_idx(cmd->args, 1));
 
-        struct file_info fi = {
-            .file = &(db_file_t){.id = file_id},
-            .wsis = NULL,
-        };
-        struct file_info *pfi =
-            vec_get(vhd->files, vec_index_of(vhd->files, &fi));
-
+        struct file_info *pfi = get_file_info(vhd->files, file_id);
         if (!pfi) {
-            fi.file = db_file_get(conn, file_id, false);
-            if (!fi.file) {
-                goto __onmsg_error;
-            }
-
-            fi.wsis = vec_new_r(struct lws *, NULL, NULL, NULL);
-            vec_add(vhd->files, &fi);
-            pfi = vec_get(vhd->files, vec_index_of(vhd->files, &fi));
+            goto __onmsg_error;
         }
-        vec_add(pfi->wsis, &wsi);
+        file_info_subscribe(pfi, wsi);
 
-        bool result = db_file_set_per(conn, file_id, per_id);
+        bool result = db_file_set_per(db, file_id, per_id);
         if (!result) {
             goto __onmsg_error;
         }
@@ -526,26 +1520,13 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
         uint64_t per_id =
             json_object_get_int64(json_object_array_get_idx(cmd->args, 2));
 
-        struct file_info fi = {
-            .file = &(db_file_t){.id = file_id},
-            .wsis = NULL,
-        };
-        struct file_info *pfi =
-            vec_get(vhd->files, vec_index_of(vhd->files, &fi));
-
+        struct file_info *pfi = get_file_info(vhd->files, file_id);
         if (!pfi) {
-            fi.file = db_file_get(conn, file_id, false);
-            if (!fi.file) {
-                goto __onmsg_error;
-            }
-
-            fi.wsis = vec_new_r(struct lws *, NULL, NULL, NULL);
-            vec_add(vhd->files, &fi);
-            pfi = vec_get(vhd->files, vec_index_of(vhd->files, &fi));
+            goto __onmsg_error;
         }
-        vec_add(pfi->wsis, &wsi);
+        file_info_subscribe(pfi, wsi);
 
-        bool result = db_file_set_user_per(conn, file_id, user_id, per_id);
+        bool result = db_file_set_user_per(db, file_id, user_id, per_id);
         if (!result) {
             goto __onmsg_error;
         }
@@ -560,32 +1541,14 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
         int column =
             json_object_get_int(json_object_array_get_idx(cmd->args, 2));
 
-        struct file_info fi = {
-            .file = &(db_file_t){.id = file_id},
-            .wsis = NULL,
-        };
-        struct file_info *pfi =
-            vec_get(vhd->files, vec_index_of(vhd->files, &fi));
+        struct file_info *pfi = hmap_get_r(uint64_t, vhd->files, file_id);
 
-        if (!pfi || vec_index_of(pfi->wsis, &wsi) == -1lu) {
+        if (!pfi || vec_find_r(struct lws *, pfi->wsis, wsi) == -1lu) {
             raise_error(402, "%s: file not open", __func__);
             goto __onmsg_error;
         }
 
-        char wid[21];
-        sprintf(wid, "%lu", (uint64_t)wsi);
-
-        json_object *user_pointer = json_object_new_object();
-        json_object_object_add(user_pointer, "username",
-            pss->user ? json_object_new_string(pss->user->username) : NULL);
-        json_object_object_add(
-            user_pointer, "ws_id", json_object_new_string(wid));
-        json_object_object_add(user_pointer, "row", json_object_new_int(row));
-        json_object_object_add(
-            user_pointer, "column", json_object_new_int(column));
-
-        json_object_object_add(res, type, user_pointer);
-        ws_broadcast_res_with_file(pfi->wsis, wsi, res);
+        ws_broadcast_cursor(pfi, wsi, res, row, column);
     } else if (CMD_IS_TYPE_OF(type, CMD_FILE_CREATE)) {
         uint64_t owner = atol(
             json_object_get_string(json_object_array_get_idx(cmd->args, 0)));
@@ -597,19 +1560,13 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
             json_object_get_string(json_object_array_get_idx(cmd->args, 3));
 
         db_file_t *file =
-            db_file_create(conn, owner, everyone_can, content, file_type);
+            db_file_create(db, owner, everyone_can, content, file_type);
         if (!file) {
             goto __onmsg_error;
         }
 
-        struct file_info fi = {
-            .file = file,
-            .wsis = vec_new_r(struct lws *, NULL, NULL, NULL),
-        };
-        vec_add(vhd->files, &fi);
-        struct file_info *pfi =
-            vec_get(vhd->files, vec_index_of(vhd->files, &fi));
-        vec_add(pfi->wsis, &wsi);
+        struct file_info *pfi = file_info_new(vhd->files, file);
+        file_info_subscribe(pfi, wsi);
 
         struct json_object *new_file = json_object_new_object();
         char                fid[21], uid[21], vid[21];
@@ -650,16 +1607,22 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
 
         json_object_object_add(res, type, new_file);
         ws_send_res(wsi, res);
-        db_file_drop(file);
     } else if (CMD_IS_TYPE_OF(type, CMD_FILE_DELETE)) {
         uint64_t file_id = atol(
             json_object_get_string(json_object_array_get_idx(cmd->args, 0)));
 
-        bool result = db_file_delete(conn, file_id);
+        bool result = db_file_delete(db, file_id);
         if (!result) {
             goto __onmsg_error;
         }
 
+        // nothing left to write the pending edits to
+        struct file_info *pfi = hmap_get_r(uint64_t, vhd->files, file_id);
+        if (pfi) {
+            lws_sul_cancel(&pfi->run->sul);
+            pfi->run->edits = 0;
+        }
+
         json_object_object_add(res, type, json_object_new_boolean(result));
         ws_send_res(wsi, res);
     } else if (CMD_IS_TYPE_OF(type, CMD_SAVE)) {
@@ -670,30 +1633,48 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
         const char *content =
             json_object_get_string(json_object_array_get_idx(cmd->args, 2));
 
-        struct file_info fi = {
-            .file = &(db_file_t){.id = file_id},
-            .wsis = NULL,
-        };
-        struct file_info *pfi =
-            vec_get(vhd->files, vec_index_of(vhd->files, &fi));
+        if (!utf8_valid(content, strlen(content))) {
+            raise_error(400, "%s: content is not valid utf-8", __func__);
+            goto __onmsg_error;
+        }
 
+        struct file_info *pfi = get_file_info(vhd->files, file_id);
         if (!pfi) {
-            fi.file = db_file_get(conn, file_id, false);
-            if (!fi.file) {
-                goto __onmsg_error;
-            }
-
-            fi.wsis = vec_new_r(struct lws *, NULL, NULL, NULL);
-            vec_add(vhd->files, &fi);
-            pfi = vec_get(vhd->files, vec_index_of(vhd->files, &fi));
+            goto __onmsg_error;
         }
-        vec_add(pfi->wsis, &wsi);
+        file_info_subscribe(pfi, wsi);
+
+        // the run being typed stays a version of its own
+        file_run_end(pfi->run);
 
-        uint64_t ver_id = db_file_save(conn, file_id, user_id, content);
+        uint64_t ver_id = db_file_save(db, file_id, user_id, content);
         if (!ver_id) {
             goto __onmsg_error;
         }
 
+        pfi->file->contents->id        = ver_id;
+        pfi->file->current_version     = ver_id;
+        pfi->file->contents->update_by = user_id;
+
+        // the cached content is what later edits apply to. a few changes
+        // are applied and broadcast as edits, which those in flight are
+        // rebased over
+        if (file_save_delta(pfi, wsi, res, user_id, content)) {
+            goto __onmsg_drops;
+        }
+
+        // the whole content replaces the cached one, edits made before the
+        // save can't be rebased over it
+        free(pfi->file->contents->content);
+        pfi->file->contents->content = malloc(strlen(content) + 1);
+        strcpy(pfi->file->contents->content, content);
+        lines_drop(pfi->lines);
+        utf8_index_drop(pfi->utf8);
+        pfi->lines = lines_new(content, strlen(content));
+        pfi->utf8  = utf8_index_new(content, strlen(content));
+
+        uint64_t rev = ot_log_reset(pfi->ot);
+
         struct json_object *new_version = json_object_new_object();
         char                fid[21], uid[21], vid[21];
 
@@ -709,119 +1690,98 @@ void onmessage(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
             new_version, "update_by", json_object_new_string(uid));
         json_object_object_add(
             new_version, "content", json_object_new_string(content));
+        json_object_object_add(new_version, "rev", json_object_new_int64(rev));
 
         json_object_object_add(res, type, new_version);
 
         ws_broadcast_res_with_file(pfi->wsis, wsi, res);
     } else {
-        // type: insert, remove
+        // type: insert, remove, insert-at, remove-at
+        bool at = CMD_IS_TYPE_OF(type, CMD_INSERT_AT) ||
+                  CMD_IS_TYPE_OF(type, CMD_REMOVE_AT);
+        bool insert = CMD_IS_TYPE_OF(type, CMD_INSERT) ||
+                      CMD_IS_TYPE_OF(type, CMD_INSERT_AT);
+
         uint64_t file_id = atol(
             json_object_get_string(json_object_array_get_idx(cmd->args, 0)));
-        uint64_t user_id = atol(
-            json_object_get_string(json_object_array_get_idx(cmd->args, 1)));
-        int from = json_object_get_int(json_object_array_get_idx(cmd->args, 2));
-        int to   = json_object_get_int(json_object_array_get_idx(cmd->args, 3));
-        struct json_object *event  = NULL;
-        const char         *string = NULL;
+        struct file_edit edit = {
+            .user_id = atol(json_object_get_string(
+                json_object_array_get_idx(cmd->args, 1))),
+            .from =
+                json_object_get_int(json_object_array_get_idx(cmd->args, 2)),
+            .to = json_object_get_int(json_object_array_get_idx(cmd->args, 3)),
+        };
+        struct json_object *event = NULL;
+        size_t              argc  = 5;
 
-        if (from < 0 || (to > 0 && to < from)) {
-            raise_error(400, "%s: invalid offset", __func__);
-            goto __onmsg_error;
-        }
+        // the -at variants: from/to hold the row and column of the start,
+        // a removal ends at the row and column that follow
+        int end_row = 0, end_col = 0;
 
-        if (CMD_IS_TYPE_OF(type, CMD_INSERT)) {
-            string =
+        if (insert) {
+            edit.string =
                 json_object_get_string(json_object_array_get_idx(cmd->args, 4));
-            json_object_deep_copy(json_object_array_get_idx(cmd->args, 5),
-                &event, json_c_shallow_copy_default);
-        } else {
-            json_object_deep_copy(json_object_array_get_idx(cmd->args, 4),
-                &event, json_c_shallow_copy_default);
+            argc += 1;
+        } else if (at) {
+            end_row =
+                json_object_get_int(json_object_array_get_idx(cmd->args, 4));
+            end_col =
+                json_object_get_int(json_object_array_get_idx(cmd->args, 5));
+            argc += 2;
         }
+        json_object_deep_copy(json_object_array_get_idx(cmd->args, argc - 1),
+            &event, json_c_shallow_copy_default);
         json_object_object_add(res, "event", event);
 
-        struct file_info fi = {
-            .file = &(db_file_t){.id = file_id},
-            .wsis = NULL,
-        };
-        struct file_info *pfi =
-            vec_get(vhd->files, vec_index_of(vhd->files, &fi));
-
-        if (!pfi) {
-            fi.file = db_file_get(conn, file_id, false);
-            if (!fi.file) {
-                goto __onmsg_error;
-            }
-
-            fi.wsis = vec_new_r(struct lws *, NULL, NULL, NULL);
-            vec_add(vhd->files, &fi);
-            pfi = vec_get(vhd->files, vec_index_of(vhd->files, &fi));
+        // optional trailing {"rev": base revision, "id": "...", "ts": client
+        // msec}, the revision the op was made at and the fields to trace it
+        struct json_object *jtrace = json_object_array_get_idx(cmd->args, argc);
+        struct json_object *jtrace_id = NULL, *jtrace_ts = NULL, *jrev = NULL;
+        json_object_object_get_ex(jtrace, "id", &jtrace_id);
+        json_object_object_get_ex(jtrace, "ts", &jtrace_ts);
+        json_object_object_get_ex(jtrace, "rev", &jrev);
+        edit.base = json_object_get_int64(jrev);
+
+        trace = trace_begin(json_object_get_string(jtrace_id),
+            json_object_get_int64(jtrace_ts), pss->recv_ns, cmd_idx, file_id);
+
+        if (at && (edit.from < 0 || edit.to < 0 || end_row < 0 ||
+                      end_col < 0)) {
+            raise_error(400, "%s: invalid position", __func__);
+            goto __onmsg_error;
         }
-        vec_add(pfi->wsis, &wsi);
-
-        uint64_t ver_id =
-            db_file_update(conn, file_id, user_id, from, to, string);
-        if (!ver_id) {
+        if (!at && (edit.from < 0 || (edit.to > 0 && edit.to < edit.from))) {
+            raise_error(400, "%s: invalid offset", __func__);
             goto __onmsg_error;
         }
+        trace_mark(trace, TRACE_VALIDATE);
 
-        pfi->file->contents->id        = ver_id;
-        pfi->file->current_version     = ver_id;
-        pfi->file->contents->update_by = user_id;
-
-        char *old_content = pfi->file->contents->content;
-
-        size_t old_len = strlen(old_content);
-        size_t new_len = strlen(old_content) + 1;
-        if (string) new_len += strlen(string);
-
-        // insert/remove old content
-        if ((size_t)from > old_len) {
-            from = old_len;
-            to   = from;
+        struct file_info *pfi = get_file_info(vhd->files, file_id);
+        if (!pfi) {
+            goto __onmsg_error;
         }
+        file_info_subscribe(pfi, wsi);
 
-        if ((size_t)to > old_len - 1) {
-            to = old_len;
+        if (at &&
+            !file_edit_at(pfi, wsi, &edit, edit.from, edit.to, end_row,
+                end_col)) {
+            goto __onmsg_error;
         }
 
-        char *new_content = malloc(new_len);
-        strcpy(new_content, pfi->file->contents->content);
-        new_content[from] = '\0';
-
-        if (string) { // insert
-            strcat(new_content, string);
-            strcat(new_content, old_content + from);
-        } else { // remove
-            strcat(new_content, old_content + to + 1);
+        if (!file_apply_edit(pfi, wsi, &edit)) {
+            goto __onmsg_error;
         }
-
-        free(pfi->file->contents->content);
-        pfi->file->contents->content = new_content;
-
-        struct json_object *new_version = json_object_new_object();
-        char                fid[21], uid[21], vid[21];
-
-        sprintf(fid, "%lu", file_id);
-        sprintf(vid, "%lu", ver_id);
-        sprintf(uid, "%lu", user_id);
-
-        json_object_object_add(
-            new_version, "file_id", json_object_new_string(fid));
-        json_object_object_add(
-            new_version, "ver_id", json_object_new_string(vid));
-        json_object_object_add(new_version, "update_by",
-            user_id == 0 ? NULL : json_object_new_string(uid));
-        json_object_object_add(new_version, "from", json_object_new_int(from));
-        json_object_object_add(new_version, "to", json_object_new_int(to));
-        if (CMD_IS_TYPE_OF(type, CMD_INSERT)) {
-            json_object_object_add(
-                new_version, "string", json_object_new_string(string));
+        trace_mark(trace, TRACE_DB);
+
+        // row/column clients get the byte offsets too, the others need
+        // nothing new to follow them
+        trace_set_current(trace);
+        if (!edit.absorbed) {
+            ws_broadcast_edit(
+                pfi, wsi, res, insert ? CMD_INSERT : CMD_REMOVE, &edit);
         }
-
-        json_object_object_add(res, type, new_version);
-
-        ws_broadcast_res_with_file(pfi->wsis, wsi, res);
+        if (edit.base) ws_ack_edit(pfi, wsi, res, &edit);
+        trace_mark(trace, TRACE_ENQUEUE);
     }
 
     goto __onmsg_drops;
@@ -838,175 +1798,537 @@ __onmsg_error:;
     destroy_error(err);
 
 __onmsg_drops:
-    free(msg_s);
+    trace_end(trace);
+    metrics_cmd_observe(cmd_idx, metrics_now_ns() - start);
+
     cmd_destroy(cmd);
     json_object_put(res);
 }
 
-void onrequest(
-    struct lws *wsi, const char *path, const char *body, size_t len) {
+struct route_res {
+    int                 code;
+    char               *stt;
+    char                message[2048];
+    struct json_object *data;
+    char                headers[256]; // extra response headers
+    bool                sent;         // the handler already responded
+};
+
+typedef void (*route_handler_t)(struct lws *wsi, const route_params_t *params,
+    struct json_object *body, struct route_res *res);
 
-    lwsl_warn("new request: %p: %lu bytes, %s", wsi, len, path);
+void route_users_login(struct lws *wsi, const route_params_t *params,
+    struct json_object *jbody, struct route_res *res) {
+    (void)wsi;
+    (void)params;
 
-    body && (*(char *)&body[len] = '\0');
+    struct json_object *username, *passwd;
+    json_object_object_get_ex(jbody, "username", &username);
+    json_object_object_get_ex(jbody, "passwd", &passwd);
 
-    int   code = 0;
-    char *stt, message[2048];
-    message[0] = '\0';
+    if (!username || json_object_get_type(username) != json_type_string) {
+        res->code = 422;
+        res->stt  = "error";
+        sprintf(res->message, "missing username");
+        return;
+    }
 
-    struct json_object *obj   = json_object_new_object();
-    struct json_object *jbody = body ? json_tokener_parse(body) : NULL;
-    struct json_object *data  = NULL;
-
-    if (body) {
-        if (!jbody) {
-            code = 422;
-            stt  = "error";
-            sprintf(message, "the body is not json");
-        } else if (strcmp(path, "/users/login") == 0) {
-            do {
-                struct json_object *username, *passwd;
-                json_object_object_get_ex(jbody, "username", &username);
-                json_object_object_get_ex(jbody, "passwd", &passwd);
-
-                if (!username ||
-                    json_object_get_type(username) != json_type_string) {
-                    code = 422;
-                    stt  = "error";
-                    sprintf(message, "missing username");
-                    break;
-                }
-
-                if (!passwd ||
-                    json_object_get_type(passwd) != json_type_string) {
-                    code = 422;
-                    stt  = "error";
-                    sprintf(message, "missing passwd");
-                    break;
-                }
-
-                db_user_t *user =
-                    db_user_login(conn, json_object_get_string(username),
-                        json_object_get_string(passwd));
-
-                if (!user) {
-                    code = 401;
-                    stt  = "error";
-                    sprintf(message, "username and password not matched");
-                    break;
-                }
-
-                char *token = jwt_encode(user->id, secret_key);
-
-                code = 200;
-                stt  = "ok";
-                data = json_object_new_string(token);
-
-                free(token);
-                db_user_drop(user);
-            } while (false);
-        } else if (strcmp(path, "/users/signin") == 0) {
-            do {
-                struct json_object *username, *passwd, *email, *avatar_url;
-                json_object_object_get_ex(jbody, "username", &username);
-                json_object_object_get_ex(jbody, "passwd", &passwd);
-                json_object_object_get_ex(jbody, "email", &email);
-                json_object_object_get_ex(jbody, "avatar_url", &avatar_url);
-
-                if (!username ||
-                    json_object_get_type(username) != json_type_string) {
-                    code = 422;
-                    stt  = "error";
-                    sprintf(message, "missing username");
-                    break;
-                }
-
-                if (!passwd ||
-                    json_object_get_type(passwd) != json_type_string) {
-                    code = 422;
-                    stt  = "error";
-                    sprintf(message, "missing passwd");
-                    break;
-                }
-
-                if (email && json_object_get_type(email) != json_type_string) {
-                    code = 422;
-                    stt  = "error";
-                    sprintf(message, "email is not string");
-                    break;
-                }
-
-                if (avatar_url &&
-                    json_object_get_type(avatar_url) != json_type_string) {
-                    code = 422;
-                    stt  = "error";
-                    sprintf(message, "avatar_url is not string");
-                    break;
-                }
-
-                db_user_t *user =
-                    db_user_add(conn, json_object_get_string(username),
-                        json_object_get_string(passwd),
-                        email ? json_object_get_string(email) : NULL,
-                        avatar_url ? json_object_get_string(avatar_url) : NULL);
-
-                if (!user) {
-                    error_t *err = get_error();
-
-                    code = 422;
-                    stt  = "error";
-                    sprintf(message, "%s", err->message);
-                    destroy_error(err);
-                    break;
-                }
-
-                char *token = jwt_encode(user->id, secret_key);
-
-                code = 200;
-                stt  = "ok";
-                data = json_object_new_string(token);
-
-                free(token);
-                db_user_drop(user);
-            } while (false);
+    if (!passwd || json_object_get_type(passwd) != json_type_string) {
+        res->code = 422;
+        res->stt  = "error";
+        sprintf(res->message, "missing passwd");
+        return;
+    }
+
+    db_user_t *user = db_user_login(db, json_object_get_string(username),
+        json_object_get_string(passwd));
+
+    if (!user) {
+        res->code = 401;
+        res->stt  = "error";
+        sprintf(res->message, "username and password not matched");
+        return;
+    }
+
+    char *token = jwt_encode(user->id, secret_key);
+
+    res->code = 200;
+    res->stt  = "ok";
+    res->data = json_object_new_string(token);
+
+    free(token);
+    db_user_drop(user);
+}
+
+void route_users_signin(struct lws *wsi, const route_params_t *params,
+    struct json_object *jbody, struct route_res *res) {
+    (void)wsi;
+    (void)params;
+
+    struct json_object *username, *passwd, *email, *avatar_url;
+    json_object_object_get_ex(jbody, "username", &username);
+    json_object_object_get_ex(jbody, "passwd", &passwd);
+    json_object_object_get_ex(jbody, "email", &email);
+    json_object_object_get_ex(jbody, "avatar_url", &avatar_url);
+
+    if (!username || json_object_get_type(username) != json_type_string) {
+        res->code = 422;
+        res->stt  = "error";
+        sprintf(res->message, "missing username");
+        return;
+    }
+
+    if (!passwd || json_object_get_type(passwd) != json_type_string) {
+        res->code = 422;
+        res->stt  = "error";
+        sprintf(res->message, "missing passwd");
+        return;
+    }
+
+    if (email && json_object_get_type(email) != json_type_string) {
+        res->code = 422;
+        res->stt  = "error";
+        sprintf(res->message, "email is not string");
+        return;
+    }
+
+    if (avatar_url && json_object_get_type(avatar_url) != json_type_string) {
+        res->code = 422;
+        res->stt  = "error";
+        sprintf(res->message, "avatar_url is not string");
+        return;
+    }
+
+    db_user_t *user = db_user_add(db, json_object_get_string(username),
+        json_object_get_string(passwd),
+        email ? json_object_get_string(email) : NULL,
+        avatar_url ? json_object_get_string(avatar_url) : NULL);
+
+    if (!user) {
+        error_t *err = get_error();
+
+        res->code = 422;
+        res->stt  = "error";
+        sprintf(res->message, "%s", err->message);
+        destroy_error(err);
+        return;
+    }
+
+    char *token = jwt_encode(user->id, secret_key);
+
+    res->code = 200;
+    res->stt  = "ok";
+    res->data = json_object_new_string(token);
+
+    free(token);
+    db_user_drop(user);
+}
+
+void route_users_getinfo(struct lws *wsi, const route_params_t *params,
+    struct json_object *jbody, struct route_res *res) {
+    (void)params;
+    (void)jbody;
+
+    char auth[1024];
+    lws_hdr_copy(wsi, auth, 1023, WSI_TOKEN_HTTP_AUTHORIZATION);
+
+    uint64_t uid;
+    if (!jwt_decode(auth, secret_key, &uid)) {
+        res->code = 401;
+        res->stt  = "error";
+        sprintf(res->message, "unauthorized");
+        return;
+    }
+
+    log_emit(LOG_DEBUG, "getinfo", NULL, NULL, 1, "uid", uid);
+    res->code = 200;
+    res->stt  = "ok";
+    sprintf(res->message, "%lu", uid);
+}
+
+// true if the request may read the file, public files skip the db
+bool route_can_read(struct lws *wsi, const db_file_t *file) {
+    if (file->everyone_can >= 1) return true;
+
+    char auth[1024];
+    auth[0] = '\0';
+    lws_hdr_copy(wsi, auth, 1023, WSI_TOKEN_HTTP_AUTHORIZATION);
+
+    uint64_t uid = 0;
+    if (!jwt_decode(auth, secret_key, &uid)) return false;
+
+    return db_user_has_per_on_file(db, uid, file->id, 1);
+}
+
+// true if the client already holds version `ver_id` (If-None-Match)
+bool route_not_modified(struct lws *wsi, uint64_t ver_id) {
+    char inm[256], etag[24];
+    inm[0] = '\0';
+    lws_hdr_copy(wsi, inm, 255, WSI_TOKEN_HTTP_IF_NONE_MATCH);
+    sprintf(etag, "\"%lu\"", ver_id);
+
+    return strcmp(inm, "*") == 0 || strstr(inm, etag) != NULL;
+}
+
+// respond with a file version, 304 if the client already holds it
+void route_res_version(struct lws *wsi, struct route_res *res,
+    const db_file_t *file, const db_content_version_t *ver,
+    const char *cache_control) {
+
+    snprintf(res->headers, sizeof(res->headers),
+        "ETag: \"%lu\"\r\n"
+        "Cache-Control: %s\r\n",
+        ver->id, cache_control);
+
+    if (route_not_modified(wsi, ver->id)) {
+        res->code = 304;
+        return;
+    }
+
+    char fid[21], vid[21], uid[21];
+    sprintf(fid, "%lu", file->id);
+    sprintf(vid, "%lu", ver->id);
+    sprintf(uid, "%lu", ver->update_by);
+
+    struct json_object *data = json_object_new_object();
+    json_object_object_add(data, "file_id", json_object_new_string(fid));
+    json_object_object_add(data, "version_id", json_object_new_string(vid));
+    json_object_object_add(data, "update_by",
+        ver->update_by != 0 ? json_object_new_string(uid) : NULL);
+    json_object_object_add(
+        data, "file_type", json_object_new_int(file->type_id));
+    json_object_object_add(
+        data, "content", json_object_new_string(ver->content));
+
+    res->code = 200;
+    res->stt  = "ok";
+    res->data = data;
+}
+
+void route_files_get(struct lws *wsi, const route_params_t *params,
+    struct json_object *jbody, struct route_res *res) {
+    (void)jbody;
+
+    struct my_per_vhost_data *vhd = my_ws_vhd(wsi);
+
+    uint64_t file_id;
+    if (!route_param_u64(params, "id", &file_id)) {
+        res->code = 404;
+        res->stt  = "error";
+        sprintf(res->message, "resource not found");
+        return;
+    }
+
+    struct file_info *pfi =
+        vhd ? hmap_get_r(uint64_t, vhd->files, file_id) : NULL;
+
+    db_file_t *file = pfi ? pfi->file : db_file_get(db, file_id, false);
+    if (!file) {
+        error_t *err = get_error();
+        res->code    = 404;
+        res->stt     = "error";
+        sprintf(res->message, "%s", err->message);
+        destroy_error(err);
+        return;
+    }
+
+    if (!route_can_read(wsi, file)) {
+        res->code = 403;
+        res->stt  = "error";
+        sprintf(res->message, "permission denied");
+    } else if (pfi && !file_run_flush(pfi->run)) {
+        // the cached content is past its version id until the run is written,
+        // its etag would answer 304 to a client holding the older content
+        error_t *err = get_error();
+        res->code    = 500;
+        res->stt     = "error";
+        sprintf(res->message, "%s", err->message);
+        destroy_error(err);
+    } else {
+        route_res_version(wsi, res, file, file->contents, "no-cache");
+    }
+
+    if (!pfi) db_file_drop(file);
+}
+
+void route_files_version_get(struct lws *wsi, const route_params_t *params,
+    struct json_object *jbody, struct route_res *res) {
+    (void)jbody;
+
+    struct my_per_vhost_data *vhd = my_ws_vhd(wsi);
+
+    uint64_t file_id, ver_id;
+    if (!route_param_u64(params, "id", &file_id) ||
+        !route_param_u64(params, "vid", &ver_id)) {
+        res->code = 404;
+        res->stt  = "error";
+        sprintf(res->message, "resource not found");
+        return;
+    }
+
+    struct file_info *pfi =
+        vhd ? hmap_get_r(uint64_t, vhd->files, file_id) : NULL;
+
+    db_file_t *file = pfi ? pfi->file : db_file_get(db, file_id, false);
+    db_content_version_t *ver = NULL;
+
+    if (!file) {
+        error_t *err = get_error();
+        res->code    = 404;
+        res->stt     = "error";
+        sprintf(res->message, "%s", err->message);
+        destroy_error(err);
+        return;
+    }
+
+    // versions never change, route_res_version answers 304 once the version
+    // is known to be one of this file
+    const char *cache_control = "max-age=31536000, immutable";
+
+    if (!route_can_read(wsi, file)) {
+        res->code = 403;
+        res->stt  = "error";
+        sprintf(res->message, "permission denied");
+    } else if (file->contents && file->contents->id == ver_id &&
+               !(pfi && pfi->run->edits)) {
+        // unless a pending run has moved the cached content past it
+        route_res_version(wsi, res, file, file->contents, cache_control);
+    } else if ((ver = db_content_version_get(db, file_id, ver_id))) {
+        route_res_version(wsi, res, file, ver, cache_control);
+        db_content_version_drop(ver);
+    } else {
+        error_t *err = get_error();
+        res->code    = 404;
+        res->stt     = "error";
+        sprintf(res->message, "%s", err->message);
+        destroy_error(err);
+    }
+
+    if (!pfi) db_file_drop(file);
+}
+
+void route_files_versions_list(struct lws *wsi, const route_params_t *params,
+    struct json_object *jbody, struct route_res *res) {
+    (void)jbody;
+
+    struct my_per_vhost_data *vhd = my_ws_vhd(wsi);
+
+    uint64_t file_id;
+    if (!route_param_u64(params, "id", &file_id)) {
+        res->code = 404;
+        res->stt  = "error";
+        sprintf(res->message, "resource not found");
+        return;
+    }
+
+    // ?before=<version id>&limit=<n>, the newest page by default
+    char before_s[24], limit_s[8];
+    before_s[0] = limit_s[0] = '\0';
+    lws_get_urlarg_by_name(wsi, "before", before_s, sizeof(before_s) - 1);
+    lws_get_urlarg_by_name(wsi, "limit", limit_s, sizeof(limit_s) - 1);
+
+    uint64_t before = strtoull(before_s, NULL, 10);
+    long     limit  = atol(limit_s);
+    if (limit <= 0 || limit > DB_HISTORY_PAGE_MAX) limit = DB_HISTORY_PAGE_MAX;
+
+    struct file_info *pfi =
+        vhd ? hmap_get_r(uint64_t, vhd->files, file_id) : NULL;
+
+    db_file_t *file = pfi ? pfi->file : db_file_get(db, file_id, false);
+    if (!file) {
+        error_t *err = get_error();
+        res->code    = 404;
+        res->stt     = "error";
+        sprintf(res->message, "%s", err->message);
+        destroy_error(err);
+        return;
+    }
+
+    db_content_version_t *history = NULL;
+
+    if (!route_can_read(wsi, file)) {
+        res->code = 403;
+        res->stt  = "error";
+        sprintf(res->message, "permission denied");
+    } else {
+        // the newest page includes the edits not written yet
+        if (pfi && !before) file_run_end(pfi->run);
+
+        if (db_file_history(db, file_id, before, limit, &history)) {
+            snprintf(res->headers, sizeof(res->headers),
+                "Cache-Control: no-cache\r\n");
+            res->code = 200;
+            res->stt  = "ok";
+            res->data = history_json(file_id, history, limit);
         } else {
-            code = 404;
-            stt  = "error";
-            sprintf(message, "resource not found");
+            error_t *err = get_error();
+            res->code    = 500;
+            res->stt     = "error";
+            sprintf(res->message, "%s", err->message);
+            destroy_error(err);
+        }
+    }
+
+    db_content_version_drop(history);
+    if (!pfi) db_file_drop(file);
+}
+
+void route_metrics(struct lws *wsi, const route_params_t *params,
+    struct json_object *jbody, struct route_res *res) {
+    (void)params;
+    (void)jbody;
+
+    struct my_per_vhost_data *vhd = my_ws_vhd(wsi);
+
+    char  *body     = NULL;
+    size_t body_len = 0;
+    FILE  *fp       = open_memstream(&body, &body_len);
+
+    metrics_render(fp);
+    pool_render(fp);
+
+    if (vhd) {
+        size_t subscribers = 0, queue_msgs = 0, queue_bytes = 0;
+
+        uint64_t         *pid;
+        struct file_info *pfi;
+        hmap_foreach(vhd->files, pid, pfi) subscribers += pfi->wsis->len;
+
+        for (size_t i = 0; i < vhd->pss_list->len; ++i) {
+            struct my_per_session_data *pss =
+                vec_get_r(struct my_per_session_data *, vhd->pss_list, i);
+
+            queue_msgs += pss->v_write->len;
+            for (size_t j = 0; j < pss->v_write->len; ++j) {
+                const struct my_msg *pmsg = vec_get(pss->v_write, j);
+                queue_bytes += pmsg->len - pmsg->sent;
+            }
         }
+
+        metrics_render_gauge(fp, "nps_open_files", "files in the open cache",
+            vhd->files->len);
+        metrics_render_gauge(fp, "nps_ws_sessions", "open websocket sessions",
+            vhd->pss_list->len);
+        metrics_render_gauge(fp, "nps_file_subscribers",
+            "sessions subscribed to open files", subscribers);
+        metrics_render_gauge(fp, "nps_ws_write_queue_messages",
+            "messages waiting to be written", queue_msgs);
+        metrics_render_gauge(fp, "nps_ws_write_queue_bytes",
+            "bytes waiting to be written", queue_bytes);
+    }
+
+    fclose(fp);
+
+    my_http_send(wsi, 200, "Content-Type: text/plain; version=0.0.4\r\n", body);
+    free(body);
+
+    res->sent = true;
+}
+
+// recent edit traces, only served when the request carries ADMIN_TOKEN
+void route_admin_traces(struct lws *wsi, const route_params_t *params,
+    struct json_object *jbody, struct route_res *res) {
+    (void)params;
+    (void)jbody;
+
+    const char *admin_token = getenv("ADMIN_TOKEN");
+
+    char auth[1024];
+    auth[0] = '\0';
+    lws_hdr_copy(wsi, auth, 1023, WSI_TOKEN_HTTP_AUTHORIZATION);
+
+    if (!admin_token || !admin_token[0] || strcmp(auth, admin_token)) {
+        res->code = 403;
+        res->stt  = "error";
+        sprintf(res->message, "forbidden");
+        return;
+    }
+
+    char  *body     = NULL;
+    size_t body_len = 0;
+    FILE  *fp       = open_memstream(&body, &body_len);
+
+    trace_dump(fp);
+    fclose(fp);
+
+    my_http_send(wsi, 200, "Content-Type: application/json\r\n", body);
+    free(body);
+
+    res->sent = true;
+}
+
+struct route {
+    const char     *method;
+    const char     *pattern;
+    route_handler_t handler;
+};
+
+static const struct route routes[] = {
+    {"POST", "/users/login",               route_users_login        },
+    {"POST", "/users/signin",              route_users_signin       },
+    {"GET",  "/users/getinfo",             route_users_getinfo      },
+    {"GET",  "/files/{id}",                route_files_get          },
+    {"GET",  "/files/{id}/versions",       route_files_versions_list},
+    {"GET",  "/files/{id}/versions/{vid}", route_files_version_get  },
+    {"GET",  "/metrics",                   route_metrics            },
+    {"GET",  "/admin/traces",              route_admin_traces       },
+};
+
+void onrequest(struct lws *wsi, const char *method, const char *path,
+    const char *body, size_t len) {
+
+    log_emit(LOG_INFO, "http_request", "path", path, 2, "wsi", (uint64_t)wsi,
+        "len", (uint64_t)len);
+    metrics_inc(METRICS_HTTP_REQUESTS, 1);
+
+    body && len && (*(char *)&body[len] = '\0');
+
+    struct route_res res = {
+        .code       = 404,
+        .stt        = "error",
+        .message    = "resource not found",
+        .data       = NULL,
+        .headers[0] = '\0',
+        .sent       = false,
+    };
+
+    struct json_object *obj   = json_object_new_object();
+    struct json_object *jbody = len ? json_tokener_parse(body) : NULL;
+
+    route_params_t params;
+    int            routes_len = sizeof(routes) / sizeof(routes[0]);
+
+    if (len && !jbody) {
+        res.code = 422;
+        sprintf(res.message, "the body is not json");
     } else {
-        if (strcmp(path, "/users/getinfo") == 0) {
-            do {
-                char auth[1024];
-                lws_hdr_copy(wsi, auth, 1023, WSI_TOKEN_HTTP_AUTHORIZATION);
-
-                uint64_t uid;
-                if (!jwt_decode(auth, secret_key, &uid)) {
-                    code = 401;
-                    stt  = "error";
-                    sprintf(message, "unauthorized");
-                    break;
-                }
-
-                lwsl_err("%lu\n", uid);
-                code = 200;
-                stt  = "ok";
-                sprintf(message, "%lu", uid);
-            } while (false);
-        } else {
-            code = 404;
-            stt  = "error";
-            sprintf(message, "resource not found");
+        for (int i = 0; i < routes_len; ++i) {
+            if (strcmp(routes[i].method, method) != 0) continue;
+            if (!route_match(routes[i].pattern, path, &params)) continue;
+
+            res.message[0] = '\0';
+            routes[i].handler(wsi, &params, jbody, &res);
+            break;
         }
     }
 
-    json_object_object_add(obj, "stt", json_object_new_string(stt));
-    if (message[0]) {
-        json_object_object_add(obj, "message", json_object_new_string(message));
-    } else if (data) {
-        json_object_object_add(obj, "data", data);
+    if (res.sent || res.code == 304) {
+        if (!res.sent) my_http_send(wsi, 304, res.headers, "");
+        json_object_put(res.data);
+        json_object_put(obj);
+        json_object_put(jbody);
+        return;
+    }
+
+    json_object_object_add(obj, "stt", json_object_new_string(res.stt));
+    if (res.message[0]) {
+        json_object_object_add(
+            obj, "message", json_object_new_string(res.message));
+        json_object_put(res.data);
+    } else if (res.data) {
+        json_object_object_add(obj, "data", res.data);
     }
-    my_http_send_json(wsi, code, obj);
+    my_http_send_json(wsi, res.code, res.headers, obj);
     json_object_put(obj);
     json_object_put(jbody);
 }
@@ -0,0 +1,266 @@
+#include <metrics.h>
+
+struct metrics_db_slot {
+    const char    *stmt;
+    metrics_hist_t hist;
+};
+
+struct metrics_thread {
+    uint64_t               counters[METRICS_COUNTER_MAX];
+    metrics_hist_t         cmds[METRICS_CMD_MAX];
+    struct metrics_db_slot dbs[METRICS_DB_MAX];
+    metrics_hist_t         loop_lag;
+
+    struct metrics_thread *next;
+};
+
+static const char *metrics_counter_names[][2] = {
+    {"nps_ws_connections_opened_total", "websocket connections opened"},
+    {"nps_ws_connections_closed_total", "websocket connections closed"},
+    {"nps_ws_messages_total",           "websocket messages received"  },
+    {"nps_ws_received_bytes_total",     "websocket bytes received"     },
+    {"nps_http_requests_total",         "http requests served"         },
+    {"nps_log_dropped_total",           "log records dropped"          },
+    {"nps_ot_rebased_total",            "edits transformed over others"},
+    {"nps_ot_stale_total",              "edits with a too old revision"},
+    {"nps_edits_coalesced_total",       "edit writes saved by merging" },
+    {"nps_ws_batched_messages_total",   "messages sent in batch frames"},
+    {"nps_saves_delta_total",           "saves broadcast as edits"     },
+};
+
+static pthread_mutex_t        __mt_mut  = PTHREAD_MUTEX_INITIALIZER;
+static struct metrics_thread *__mt_list = NULL;
+
+static __thread struct metrics_thread *__mt = NULL;
+
+// only the owning thread writes, so a relaxed load + store is enough and
+// compiles to a plain add
+#define METRICS_ADD(field, val)                                                \
+    __atomic_store_n(&(field),                                                 \
+        __atomic_load_n(&(field), __ATOMIC_RELAXED) + (val), __ATOMIC_RELAXED)
+
+#define METRICS_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+static struct metrics_thread *metrics_thread() {
+    if (__mt) return __mt;
+
+    __mt = calloc(1, sizeof(struct metrics_thread));
+
+    pthread_mutex_lock(&__mt_mut);
+    __mt->next = __mt_list;
+    __atomic_store_n(&__mt_list, __mt, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&__mt_mut);
+
+    return __mt;
+}
+
+static size_t metrics_bucket(uint64_t nsec) {
+    if (nsec < (1lu << METRICS_MIN_EXP)) return 0;
+
+    int msb = 63 - __builtin_clzl(nsec);
+    if (msb >= METRICS_MAX_EXP) return METRICS_BUCKETS - 1;
+
+    size_t sub = (nsec >> (msb - METRICS_SUB_BITS)) & (METRICS_SUB_BUCKETS - 1);
+    return 1 + (msb - METRICS_MIN_EXP) * METRICS_SUB_BUCKETS + sub;
+}
+
+// upper bound of a bucket in ns, the last bucket has none
+static uint64_t metrics_bucket_le(size_t idx) {
+    if (idx == 0) return 1lu << METRICS_MIN_EXP;
+
+    size_t k   = idx - 1;
+    int    msb = METRICS_MIN_EXP + k / METRICS_SUB_BUCKETS;
+    size_t sub = k % METRICS_SUB_BUCKETS;
+
+    return (METRICS_SUB_BUCKETS + sub + 1) << (msb - METRICS_SUB_BITS);
+}
+
+static void metrics_hist_observe(metrics_hist_t *hist, uint64_t nsec) {
+    METRICS_ADD(hist->buckets[metrics_bucket(nsec)], 1);
+    METRICS_ADD(hist->count, 1);
+    METRICS_ADD(hist->sum, nsec);
+}
+
+static void metrics_hist_merge(metrics_hist_t *dst, metrics_hist_t *src) {
+    for (size_t i = 0; i < METRICS_BUCKETS; ++i) {
+        dst->buckets[i] += METRICS_LOAD(src->buckets[i]);
+    }
+    dst->count += METRICS_LOAD(src->count);
+    dst->sum += METRICS_LOAD(src->sum);
+}
+
+uint64_t metrics_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void metrics_inc(metrics_counter_t counter, uint64_t val) {
+    METRICS_ADD(metrics_thread()->counters[counter], val);
+}
+
+void metrics_cmd_observe(int cmd_idx, uint64_t nsec) {
+    if (cmd_idx < 0 || cmd_idx >= (int)METRICS_CMD_MAX) {
+        cmd_idx = METRICS_CMD_INVALID;
+    }
+    metrics_hist_observe(&metrics_thread()->cmds[cmd_idx], nsec);
+}
+
+void metrics_db_observe(const char *stmt, uint64_t nsec) {
+    struct metrics_thread *mt = metrics_thread();
+
+    for (size_t i = 0; i < METRICS_DB_MAX; ++i) {
+        struct metrics_db_slot *slot = &mt->dbs[i];
+
+        if (!slot->stmt) {
+            __atomic_store_n(&slot->stmt, stmt, __ATOMIC_RELEASE);
+        } else if (slot->stmt != stmt) {
+            continue;
+        }
+
+        metrics_hist_observe(&slot->hist, nsec);
+        return;
+    }
+}
+
+void metrics_loop_lag_observe(uint64_t nsec) {
+    metrics_hist_observe(&metrics_thread()->loop_lag, nsec);
+}
+
+void metrics_render_gauge(
+    FILE *fp, const char *name, const char *help, double val) {
+    fprintf(fp,
+        "# HELP %s %s\n"
+        "# TYPE %s gauge\n"
+        "%s %.17g\n",
+        name, help, name, name, val);
+}
+
+// prometheus label value: escape \, " and newlines
+static void metrics_render_label(FILE *fp, const char *val) {
+    for (; *val; ++val) {
+        if (*val == '\\' || *val == '"') {
+            fputc('\\', fp);
+            fputc(*val, fp);
+        } else if (*val == '\n') {
+            fputs("\\n", fp);
+        } else {
+            fputc(*val, fp);
+        }
+    }
+}
+
+static void metrics_render_hist(FILE *fp, const char *name,
+    const char *label_name, const char *label_val, metrics_hist_t *hist) {
+    uint64_t cumulative = 0;
+
+    char labels[1024];
+    labels[0] = '\0';
+
+    FILE *lfp = fmemopen(labels, sizeof(labels), "w");
+    if (label_name) {
+        fprintf(lfp, "%s=\"", label_name);
+        metrics_render_label(lfp, label_val);
+        fprintf(lfp, "\",");
+    }
+    fclose(lfp);
+
+    for (size_t i = 0; i < METRICS_BUCKETS - 1; ++i) {
+        cumulative += hist->buckets[i];
+        fprintf(fp, "%s_bucket{%sle=\"%g\"} %lu\n", name, labels,
+            metrics_bucket_le(i) / 1e9, cumulative);
+    }
+    fprintf(fp, "%s_bucket{%sle=\"+Inf\"} %lu\n", name, labels, hist->count);
+
+    // drop the trailing comma for sum/count
+    size_t len = strlen(labels);
+    if (len) labels[len - 1] = '\0';
+
+    fprintf(fp, "%s_sum{%s} %.9f\n", name, labels, hist->sum / 1e9);
+    fprintf(fp, "%s_count{%s} %lu\n", name, labels, hist->count);
+}
+
+void metrics_render(FILE *fp) {
+    struct metrics_thread *list =
+        __atomic_load_n(&__mt_list, __ATOMIC_ACQUIRE);
+
+    for (int c = 0; c < METRICS_COUNTER_MAX; ++c) {
+        uint64_t total = 0;
+        for (struct metrics_thread *mt = list; mt; mt = mt->next) {
+            total += METRICS_LOAD(mt->counters[c]);
+        }
+
+        fprintf(fp,
+            "# HELP %s %s\n"
+            "# TYPE %s counter\n"
+            "%s %lu\n",
+            metrics_counter_names[c][0], metrics_counter_names[c][1],
+            metrics_counter_names[c][0], metrics_counter_names[c][0], total);
+    }
+
+    metrics_hist_t *hist = malloc(sizeof(metrics_hist_t));
+    char            name[50];
+
+    fprintf(fp, "# HELP nps_command_duration_seconds time spent in onmessage "
+                "per command\n"
+                "# TYPE nps_command_duration_seconds histogram\n");
+    for (size_t c = 0; c < METRICS_CMD_MAX; ++c) {
+        memset(hist, 0, sizeof(metrics_hist_t));
+        for (struct metrics_thread *mt = list; mt; mt = mt->next) {
+            metrics_hist_merge(hist, &mt->cmds[c]);
+        }
+        if (!hist->count) continue;
+
+        if (c == METRICS_CMD_INVALID) {
+            strcpy(name, "invalid");
+        } else {
+            cmd_type_name(c, name);
+        }
+        metrics_render_hist(
+            fp, "nps_command_duration_seconds", "cmd", name, hist);
+    }
+
+    fprintf(fp, "# HELP nps_db_duration_seconds time spent per db statement\n"
+                "# TYPE nps_db_duration_seconds histogram\n");
+    for (struct metrics_thread *mt = list; mt; mt = mt->next) {
+        for (size_t i = 0; i < METRICS_DB_MAX; ++i) {
+            const char *stmt =
+                __atomic_load_n(&mt->dbs[i].stmt, __ATOMIC_ACQUIRE);
+            if (!stmt) break;
+
+            // statements seen by an earlier thread were already rendered
+            bool seen = false;
+            for (struct metrics_thread *prev = list; prev != mt && !seen;
+                 prev                        = prev->next) {
+                for (size_t j = 0; j < METRICS_DB_MAX && prev->dbs[j].stmt;
+                     ++j) {
+                    if (prev->dbs[j].stmt == stmt) seen = true;
+                }
+            }
+            if (seen) continue;
+
+            memset(hist, 0, sizeof(metrics_hist_t));
+            for (struct metrics_thread *other = mt; other;
+                 other                        = other->next) {
+                for (size_t j = 0; j < METRICS_DB_MAX && other->dbs[j].stmt;
+                     ++j) {
+                    if (other->dbs[j].stmt == stmt) {
+                        metrics_hist_merge(hist, &other->dbs[j].hist);
+                    }
+                }
+            }
+            metrics_render_hist(
+                fp, "nps_db_duration_seconds", "stmt", stmt, hist);
+        }
+    }
+
+    fprintf(fp, "# HELP nps_loop_lag_seconds delay of the lws loop timer\n"
+                "# TYPE nps_loop_lag_seconds histogram\n");
+    memset(hist, 0, sizeof(metrics_hist_t));
+    for (struct metrics_thread *mt = list; mt; mt = mt->next) {
+        metrics_hist_merge(hist, &mt->loop_lag);
+    }
+    metrics_render_hist(fp, "nps_loop_lag_seconds", NULL, NULL, hist);
+
+    free(hist);
+}
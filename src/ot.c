@@ -0,0 +1,157 @@
+#include <ot.h>
+
+static void ot_peer_drop(void *peer) {
+    vec_drop(((ot_peer_t *)peer)->queue);
+}
+
+ot_log_t *ot_log_new() {
+    ot_log_t *log = calloc(1, sizeof(ot_log_t));
+    log->rev      = 1;
+    log->floor    = 1;
+    log->peers    = hmap_new_r(uint64_t, ot_peer_t, ot_peer_drop);
+    return log;
+}
+
+void ot_log_drop(ot_log_t *log) {
+    if (!log) return;
+    hmap_drop(log->peers);
+    free(log);
+}
+
+void ot_transform(ot_op_t *op, const ot_op_t *by, bool op_first) {
+    if (!op->len || !by->len) return;
+
+    size_t start = by->pos;
+    size_t end   = by->pos + by->len;
+
+    if (by->insert) {
+        bool tie = op->insert && op->pos == start;
+
+        if (op->pos > start || (op->pos == start && !(tie && op_first))) {
+            op->pos += by->len;
+        } else if (!op->insert && start < op->pos + op->len) {
+            // inserted strictly inside the range, removed with it
+            op->len += by->len;
+        }
+        return;
+    }
+
+    // `by` removed [start, end)
+    if (op->pos >= end) {
+        op->pos -= by->len;
+        return;
+    }
+
+    if (op->insert) {
+        // strictly inside the removed range, removed with it
+        if (op->pos > start) op->len = 0;
+        return;
+    }
+
+    size_t op_end = op->pos + op->len;
+    if (op_end <= start) return;
+
+    // drop the bytes already removed by `by`
+    size_t lo = op->pos > start ? op->pos : start;
+    size_t hi = op_end < end ? op_end : end;
+    op->len -= hi - lo;
+    if (op->pos > start) op->pos = start;
+}
+
+// [E]:
+bool ot_log_rebase(
+    ot_log_t *log, uint64_t base, utf8_unit_t unit, ot_op_t *op) {
+    if (base < log->floor) {
+        raise_error(160, "%s: revision %lu is too old, get the file again",
+            __func__, base);
+        return false;
+    }
+    if (base > log->rev) {
+        raise_error(161, "%s: revision %lu is ahead of %lu", __func__, base,
+            log->rev);
+        return false;
+    }
+
+    bool       found;
+    ot_peer_t *peer = hmap_entry_r(uint64_t, ot_peer_t, log->peers, op->src,
+        &found);
+    if (!found) {
+        peer->seen  = base;
+        peer->queue = vec_new_r(ot_op_t, NULL, NULL, NULL);
+        peer->unit  = unit;
+    }
+
+    // ops the sender had not seen when its last op came and are gone since
+    if (peer->seen < log->floor) {
+        raise_error(160, "%s: revision %lu is too old, get the file again",
+            __func__, peer->seen);
+        hmap_remove_r(uint64_t, log->peers, op->src);
+        return false;
+    }
+
+    // queue the ops of others applied since the last op of the sender, its
+    // own ones are already in its context
+    for (uint64_t rev = peer->seen + 1; rev <= log->rev; ++rev) {
+        ot_op_t *applied = &log->ops[rev & (OT_HISTORY - 1)][peer->unit];
+        if (applied->src != op->src) vec_push_r(ot_op_t, peer->queue, *applied);
+    }
+    peer->seen = log->rev;
+
+    // the sender has seen everything up to its base
+    size_t seen = 0;
+    while (seen < peer->queue->len &&
+           vec_at_r(ot_op_t, peer->queue, seen).rev <= base) {
+        ++seen;
+    }
+    while (seen--) vec_remove(peer->queue, 0);
+
+    // the sender transforms the queued ops over `op` when they reach it
+    for (size_t i = 0; i < peer->queue->len; ++i) {
+        ot_op_t *queued = &vec_at_r(ot_op_t, peer->queue, i);
+        ot_op_t  prev   = *op;
+
+        ot_transform(op, queued, false);
+        ot_transform(queued, &prev, true);
+    }
+
+    return true;
+}
+
+// [E]:
+bool ot_log_synced(ot_log_t *log, uint64_t base, uint64_t src) {
+    if (base < log->floor || base > log->rev) {
+        raise_error(base < log->floor ? 160 : 161,
+            "%s: revision %lu is out of the history", __func__, base);
+        return false;
+    }
+
+    for (uint64_t rev = base + 1; rev <= log->rev; ++rev) {
+        if (log->ops[rev & (OT_HISTORY - 1)][UTF8_BYTES].src != src) {
+            raise_error(162, "%s: revision %lu is behind edits of others",
+                __func__, base);
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t ot_log_push(ot_log_t *log, ot_op_t ops[UTF8_UNITS]) {
+    ++log->rev;
+    for (int unit = 0; unit < UTF8_UNITS; ++unit) {
+        ops[unit].rev                                 = log->rev;
+        log->ops[log->rev & (OT_HISTORY - 1)][unit] = ops[unit];
+    }
+
+    if (log->rev - log->floor > OT_HISTORY) log->floor = log->rev - OT_HISTORY;
+    return log->rev;
+}
+
+uint64_t ot_log_reset(ot_log_t *log) {
+    hmap_clear(log->peers);
+    log->floor = ++log->rev;
+    return log->rev;
+}
+
+void ot_log_forget(ot_log_t *log, uint64_t src) {
+    hmap_remove_r(uint64_t, log->peers, src);
+}
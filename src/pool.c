@@ -0,0 +1,191 @@
+#include <pool.h>
+
+#define POOL_BIG  POOL_CLASSES
+#define POOL_VECS (POOL_CLASSES + 1)
+#define POOL_HDR  16 // keeps the payload 16 bytes aligned
+
+struct pool_block {
+    struct pool_block *next;
+};
+
+struct pool_thread {
+    struct pool_block *free[POOL_CLASSES];
+    size_t             free_len[POOL_CLASSES];
+    vec_t             *vecs[POOL_VECS_MAX];
+    size_t             vecs_len;
+
+    pool_stats_t stats[POOL_CLASSES + 2];
+
+    struct pool_thread *next;
+};
+
+static pthread_mutex_t     __pt_mut  = PTHREAD_MUTEX_INITIALIZER;
+static struct pool_thread *__pt_list = NULL;
+
+static __thread struct pool_thread *__pt = NULL;
+
+// only the owning thread writes, see metrics.c
+#define POOL_ADD(field, val)                                                   \
+    __atomic_store_n(&(field),                                                 \
+        __atomic_load_n(&(field), __ATOMIC_RELAXED) + (val), __ATOMIC_RELAXED)
+
+#define POOL_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+static struct pool_thread *pool_thread() {
+    if (__pt) return __pt;
+
+    __pt = calloc(1, sizeof(struct pool_thread));
+
+    pthread_mutex_lock(&__pt_mut);
+    __pt->next = __pt_list;
+    __atomic_store_n(&__pt_list, __pt, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&__pt_mut);
+
+    return __pt;
+}
+
+static size_t pool_class(size_t size) {
+    if (size <= POOL_MIN_SIZE) return 0;
+
+    size_t cls = 64 - __builtin_clzl(size - 1) - POOL_MIN_SHIFT;
+    return cls < POOL_CLASSES ? cls : POOL_BIG;
+}
+
+static size_t pool_keep(size_t cls) {
+    size_t keep = POOL_KEEP_BYTES / (POOL_MIN_SIZE << cls);
+    return keep > 4 ? keep : 4;
+}
+
+void *pool_alloc(size_t size) {
+    struct pool_thread *pt  = pool_thread();
+    size_t              cls = pool_class(size);
+    uint8_t            *blk = NULL;
+
+    if (cls != POOL_BIG && pt->free[cls]) {
+        struct pool_block *b = pt->free[cls];
+        pt->free[cls]        = b->next;
+        --pt->free_len[cls];
+
+        POOL_ADD(pt->stats[cls].hits, 1);
+        blk = (uint8_t *)b - POOL_HDR;
+    } else {
+        size_t cap = cls == POOL_BIG ? size : POOL_MIN_SIZE << cls;
+
+        POOL_ADD(pt->stats[cls].misses, 1);
+        blk = malloc(POOL_HDR + cap);
+        if (!blk) return NULL;
+        *(uint32_t *)blk = cls;
+    }
+
+    return blk + POOL_HDR;
+}
+
+void pool_free(void *ptr) {
+    if (!ptr) return;
+
+    struct pool_thread *pt  = pool_thread();
+    uint8_t            *blk = (uint8_t *)ptr - POOL_HDR;
+    size_t              cls = *(uint32_t *)blk;
+
+    if (cls == POOL_BIG || pt->free_len[cls] >= pool_keep(cls)) {
+        POOL_ADD(pt->stats[cls].releases, 1);
+        free(blk);
+        return;
+    }
+
+    struct pool_block *b = ptr;
+    b->next              = pt->free[cls];
+    pt->free[cls]        = b;
+    ++pt->free_len[cls];
+}
+
+vec_t *pool_vec_new(size_t elm_size, vec_elm_drop_t drop) {
+    struct pool_thread *pt = pool_thread();
+
+    while (pt->vecs_len) {
+        vec_t *vec = pt->vecs[--pt->vecs_len];
+        if (vec->elm_size != elm_size) {
+            vec_drop(vec);
+            continue;
+        }
+
+        POOL_ADD(pt->stats[POOL_VECS].hits, 1);
+        vec->elm_cpy  = NULL;
+        vec->elm_cmp  = NULL;
+        vec->elm_drop = drop;
+        return vec;
+    }
+
+    POOL_ADD(pt->stats[POOL_VECS].misses, 1);
+    return vec_new(elm_size, NULL, NULL, drop);
+}
+
+void pool_vec_free(vec_t *vec) {
+    if (!vec) return;
+
+    struct pool_thread *pt = pool_thread();
+    vec_clear(vec);
+
+    if (pt->vecs_len == POOL_VECS_MAX) {
+        POOL_ADD(pt->stats[POOL_VECS].releases, 1);
+        vec_drop(vec);
+        return;
+    }
+    pt->vecs[pt->vecs_len++] = vec;
+}
+
+void pool_stats(size_t cls, pool_stats_t *stats) {
+    memset(stats, 0, sizeof(pool_stats_t));
+
+    struct pool_thread *list = __atomic_load_n(&__pt_list, __ATOMIC_ACQUIRE);
+    for (struct pool_thread *pt = list; pt; pt = pt->next) {
+        stats->hits += POOL_LOAD(pt->stats[cls].hits);
+        stats->misses += POOL_LOAD(pt->stats[cls].misses);
+        stats->releases += POOL_LOAD(pt->stats[cls].releases);
+    }
+}
+
+static void pool_class_name(size_t cls, char *name) {
+    if (cls == POOL_BIG) {
+        sprintf(name, "big");
+    } else if (cls == POOL_VECS) {
+        sprintf(name, "vec");
+    } else {
+        sprintf(name, "%lu", POOL_MIN_SIZE << cls);
+    }
+}
+
+void pool_render(FILE *fp) {
+    static const char *results[] = {"hit", "miss"};
+
+    fprintf(fp, "# HELP nps_pool_allocs_total pool allocations by size "
+                "class, hit: served from a free list\n"
+                "# TYPE nps_pool_allocs_total counter\n");
+    for (size_t cls = 0; cls < POOL_CLASSES + 2; ++cls) {
+        pool_stats_t stats;
+        pool_stats(cls, &stats);
+
+        char name[16];
+        pool_class_name(cls, name);
+
+        uint64_t vals[] = {stats.hits, stats.misses};
+        for (int r = 0; r < 2; ++r) {
+            fprintf(fp,
+                "nps_pool_allocs_total{class=\"%s\",result=\"%s\"} %lu\n",
+                name, results[r], vals[r]);
+        }
+    }
+
+    fprintf(fp, "# HELP nps_pool_releases_total blocks freed to malloc, "
+                "the free list was full\n"
+                "# TYPE nps_pool_releases_total counter\n");
+    for (size_t cls = 0; cls < POOL_CLASSES + 2; ++cls) {
+        pool_stats_t stats;
+        pool_stats(cls, &stats);
+
+        char name[16];
+        pool_class_name(cls, name);
+        fprintf(fp, "nps_pool_releases_total{class=\"%s\"} %lu\n", name,
+            stats.releases);
+    }
+}
@@ -0,0 +1,211 @@
+#include <proto.h>
+
+size_t proto_varint_encode(uint64_t val, uint8_t *out) {
+    size_t n = 0;
+    while (val >= 0x80) {
+        out[n++] = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    out[n++] = (uint8_t)val;
+    return n;
+}
+
+size_t proto_varint_decode(const uint8_t *in, size_t len, uint64_t *val) {
+    uint64_t res = 0;
+
+    for (size_t i = 0; i < len && i < PROTO_VARINT_MAX; ++i) {
+        // only the low bit of the last byte fits in 64 bits
+        if (i == PROTO_VARINT_MAX - 1 && in[i] > 1) return 0;
+
+        res |= (uint64_t)(in[i] & 0x7f) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *val = res;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+size_t proto_encoded_len(const proto_op_t *op) {
+    size_t len = 7 * PROTO_VARINT_MAX;
+    if (op->op == PROTO_OP_INSERT) len += PROTO_VARINT_MAX + op->string_len;
+    return len;
+}
+
+size_t proto_encode(const proto_op_t *op, uint8_t *out, size_t cap) {
+    if (cap < proto_encoded_len(op)) return 0;
+
+    size_t n = proto_varint_encode(op->op, out);
+    n += proto_varint_encode(op->file_id, out + n);
+
+    switch (op->op) {
+        case PROTO_OP_INSERT:
+        case PROTO_OP_REMOVE:
+            n += proto_varint_encode(op->ver_id, out + n);
+            n += proto_varint_encode(op->user_id, out + n);
+            n += proto_varint_encode(op->from, out + n);
+            n += proto_varint_encode(op->to, out + n);
+            break;
+
+        case PROTO_OP_CURSOR:
+            n += proto_varint_encode(op->user_id, out + n);
+            n += proto_varint_encode(op->ws_id, out + n);
+            n += proto_varint_encode(op->from, out + n);
+            n += proto_varint_encode(op->to, out + n);
+            break;
+
+        case PROTO_OP_ACK:
+            n += proto_varint_encode(op->ver_id, out + n);
+            n += proto_varint_encode(op->rev, out + n);
+            return n;
+
+        default:
+            return 0;
+    }
+
+    if (op->op == PROTO_OP_INSERT) {
+        n += proto_varint_encode(op->string_len, out + n);
+        memcpy(out + n, op->string, op->string_len);
+        n += op->string_len;
+    }
+
+    if (op->op != PROTO_OP_CURSOR && op->rev) {
+        n += proto_varint_encode(op->rev, out + n);
+    }
+
+    return n;
+}
+
+// [E]: decode a frame, op->string points into `in`
+bool proto_decode(const uint8_t *in, size_t len, proto_op_t *op) {
+    uint64_t fields[6] = {0};
+    size_t   pos = 0, n;
+
+    memset(op, 0, sizeof(proto_op_t));
+
+    // an ack has 4 fields, the other ops 6 before their optional parts. op
+    // codes are checked before they are narrowed to a byte
+    int count = 6;
+    if (proto_varint_decode(in, len, &fields[0])) {
+        if (fields[0] > UINT8_MAX) {
+            raise_error(131, "%s: unknown op %lu", __func__, fields[0]);
+            return false;
+        }
+        if (fields[0] == PROTO_OP_ACK) count = 4;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        n = proto_varint_decode(in + pos, len - pos, &fields[i]);
+        if (!n) {
+            raise_error(130, "%s: truncated frame at field %d", __func__, i);
+            return false;
+        }
+        pos += n;
+    }
+
+    op->op      = fields[0];
+    op->file_id = fields[1];
+
+    switch (op->op) {
+        case PROTO_OP_INSERT:
+        case PROTO_OP_REMOVE:
+            op->ver_id  = fields[2];
+            op->user_id = fields[3];
+            op->from    = fields[4];
+            op->to      = fields[5];
+            break;
+
+        case PROTO_OP_CURSOR:
+            op->user_id = fields[2];
+            op->ws_id   = fields[3];
+            op->from    = fields[4];
+            op->to      = fields[5];
+            break;
+
+        case PROTO_OP_ACK:
+            op->ver_id = fields[2];
+            op->rev    = fields[3];
+            break;
+
+        default:
+            raise_error(131, "%s: unknown op %u", __func__, op->op);
+            return false;
+    }
+
+    if (op->op == PROTO_OP_INSERT) {
+        uint64_t slen = 0;
+
+        n = proto_varint_decode(in + pos, len - pos, &slen);
+        if (!n || slen > len - pos - n) {
+            raise_error(130, "%s: truncated string", __func__);
+            return false;
+        }
+        pos += n;
+
+        if (memchr(in + pos, '\0', slen)) {
+            raise_error(132, "%s: string contains null byte", __func__);
+            return false;
+        }
+
+        op->string     = (const char *)in + pos;
+        op->string_len = slen;
+        pos += slen;
+    }
+
+    // optional revision of an edit
+    if (pos < len && (op->op == PROTO_OP_INSERT || op->op == PROTO_OP_REMOVE)) {
+        n = proto_varint_decode(in + pos, len - pos, &op->rev);
+        if (!n) {
+            raise_error(130, "%s: truncated revision", __func__);
+            return false;
+        }
+        pos += n;
+    }
+
+    if (pos != len) {
+        raise_error(133, "%s: %lu trailing bytes", __func__, len - pos);
+        return false;
+    }
+
+    return true;
+}
+
+size_t proto_batch_header(uint64_t count, uint8_t *out) {
+    size_t n = proto_varint_encode(PROTO_OP_BATCH, out);
+    return n + proto_varint_encode(count, out + n);
+}
+
+size_t proto_batch_begin(const uint8_t *in, size_t len, uint64_t *pcount) {
+    uint64_t op;
+    size_t   n = proto_varint_decode(in, len, &op), m;
+
+    if (!n || op != PROTO_OP_BATCH) {
+        raise_error(131, "%s: not a batch", __func__);
+        return 0;
+    }
+    if (!(m = proto_varint_decode(in + n, len - n, pcount))) {
+        raise_error(130, "%s: truncated frame count", __func__);
+        return 0;
+    }
+
+    return n + m;
+}
+
+bool proto_batch_next(const uint8_t *in, size_t len, size_t *ppos,
+    const uint8_t **pframe, size_t *pframe_len) {
+    uint64_t flen = 0;
+    size_t   pos  = *ppos;
+    size_t   n    = pos < len ? proto_varint_decode(in + pos, len - pos, &flen)
+                              : 0;
+
+    if (!n || flen > len - pos - n) {
+        raise_error(130, "%s: truncated frame", __func__);
+        return false;
+    }
+
+    *pframe     = in + pos + n;
+    *pframe_len = flen;
+    *ppos       = pos + n + flen;
+    return true;
+}
@@ -0,0 +1,53 @@
+#include <route.h>
+
+bool route_match(
+    const char *pattern, const char *path, route_params_t *params) {
+    const char *p = pattern;
+    const char *s = path;
+
+    params->len = 0;
+
+    while (*p && *s) {
+        if (*p != '{') {
+            if (*p++ != *s++) return false;
+            continue;
+        }
+
+        const char *end = strchr(p, '}');
+        if (!end || params->len >= ROUTE_MAX_PARAMS) return false;
+
+        size_t name_len = end - p - 1;
+        size_t val_len  = strcspn(s, "/");
+        if (val_len == 0 || name_len >= ROUTE_NAME_MAX ||
+            val_len >= ROUTE_VALUE_MAX)
+            return false;
+
+        memcpy(params->names[params->len], p + 1, name_len);
+        params->names[params->len][name_len] = '\0';
+        memcpy(params->values[params->len], s, val_len);
+        params->values[params->len][val_len] = '\0';
+        params->len += 1;
+
+        p = end + 1;
+        s += val_len;
+    }
+
+    return *p == '\0' && *s == '\0';
+}
+
+const char *route_param(const route_params_t *params, const char *name) {
+    for (int i = 0; i < params->len; ++i) {
+        if (strcmp(params->names[i], name) == 0) return params->values[i];
+    }
+    return NULL;
+}
+
+bool route_param_u64(
+    const route_params_t *params, const char *name, uint64_t *val) {
+    const char *s = route_param(params, name);
+    if (!s || *s < '0' || *s > '9') return false;
+
+    char *end;
+    *val = strtoull(s, &end, 10);
+    return *end == '\0';
+}
@@ -0,0 +1,169 @@
+#include <trace.h>
+
+static trace_t  __active[TRACE_ACTIVE_MAX];
+static uint32_t __active_next = 0;
+
+static trace_t __ring[TRACE_RING_MAX];
+static size_t  __ring_len  = 0;
+static size_t  __ring_head = 0;
+
+static trace_t *__current        = NULL;
+static unsigned __sample         = 0;
+static unsigned __sample_counter = 0;
+static FILE    *__trace_fp       = NULL;
+
+static void trace_write_json(FILE *fp, const trace_t *trace) {
+    static const char *phases[] = {
+        "recv", "validate", "db", "enqueue", "write"};
+    char name[50];
+
+    fprintf(fp,
+        "{\"id\":\"%s\",\"cmd\":\"%s\",\"file_id\":\"%lu\","
+        "\"client_ts\":%lu,\"server_ts\":%lu",
+        trace->id, trace->cmd >= 0 ? cmd_type_name(trace->cmd, name) : "",
+        trace->file_id, trace->client_ts, trace->server_ts);
+
+    // phases are microseconds since recv, null if never reached
+    for (int p = TRACE_VALIDATE; p < TRACE_PHASES; ++p) {
+        if (trace->ts[p]) {
+            fprintf(fp, ",\"%s_us\":%.1f", phases[p],
+                (trace->ts[p] - trace->ts[TRACE_RECV]) / 1e3);
+        } else {
+            fprintf(fp, ",\"%s_us\":null", phases[p]);
+        }
+    }
+
+    if (trace->writes) {
+        fprintf(fp, ",\"write_last_us\":%.1f",
+            (trace->write_last - trace->ts[TRACE_RECV]) / 1e3);
+    } else {
+        fprintf(fp, ",\"write_last_us\":null");
+    }
+
+    fprintf(fp, ",\"writes\":%u,\"dropped\":%u}", trace->writes,
+        trace->pending);
+}
+
+static void trace_emit(trace_t *trace) {
+    trace->active = false;
+
+    __ring[__ring_head] = *trace;
+    __ring_head         = (__ring_head + 1) % TRACE_RING_MAX;
+    if (__ring_len < TRACE_RING_MAX) __ring_len += 1;
+
+    if (__trace_fp) {
+        trace_write_json(__trace_fp, trace);
+        fputc('\n', __trace_fp);
+    }
+}
+
+void trace_init(unsigned sample, const char *path) {
+    __sample = sample;
+
+    if (path) {
+        __trace_fp = fopen(path, "a");
+        if (__trace_fp) setvbuf(__trace_fp, NULL, _IOLBF, 0);
+    }
+}
+
+trace_t *trace_begin(const char *id, uint64_t client_ts, uint64_t recv_ns,
+    int cmd, uint64_t file_id) {
+
+    if (!id || !id[0]) {
+        if (!__sample || ++__sample_counter % __sample) return NULL;
+    }
+
+    trace_t *trace = &__active[__active_next];
+    __active_next  = (__active_next + 1) % TRACE_ACTIVE_MAX;
+
+    // the oldest trace still waits for frames that never went out
+    if (trace->active) trace_emit(trace);
+
+    uint32_t gen = trace->gen + 1;
+    memset(trace, 0, sizeof(trace_t));
+    trace->gen    = gen;
+    trace->active = true;
+
+    if (id && id[0]) {
+        // the id ends up in json output unescaped, keep it to a safe charset
+        size_t n = 0;
+        for (; *id && n < TRACE_ID_MAX - 1; ++id) {
+            if (isalnum(*id) || strchr("-_.:", *id)) trace->id[n++] = *id;
+        }
+        trace->id[n] = '\0';
+    } else {
+        snprintf(trace->id, TRACE_ID_MAX, "s%u-%u",
+            (unsigned)(trace - __active), gen);
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    uint64_t now = metrics_now_ns();
+
+    trace->cmd            = cmd;
+    trace->file_id        = file_id;
+    trace->client_ts      = client_ts;
+    trace->ts[TRACE_RECV] = recv_ns ? recv_ns : now;
+    trace->server_ts      = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 -
+                       (now - trace->ts[TRACE_RECV]) / 1000000;
+
+    return trace;
+}
+
+void trace_mark(trace_t *trace, trace_phase_t phase) {
+    if (!trace) return;
+    trace->ts[phase] = metrics_now_ns();
+}
+
+void trace_set_current(trace_t *trace) {
+    __current = trace;
+}
+
+void trace_end(trace_t *trace) {
+    if (!trace) return;
+
+    if (__current == trace) __current = NULL;
+
+    trace->ended = true;
+    if (trace->pending == 0) trace_emit(trace);
+}
+
+uint64_t trace_ref() {
+    if (!__current) return 0;
+
+    __current->pending += 1;
+    return (uint64_t)__current->gen << 32 | (__current - __active + 1);
+}
+
+void trace_release(uint64_t ref, bool written) {
+    if (!ref) return;
+
+    size_t   slot = (ref & 0xffffffff) - 1;
+    uint32_t gen  = ref >> 32;
+    if (slot >= TRACE_ACTIVE_MAX) return;
+
+    trace_t *trace = &__active[slot];
+    if (!trace->active || trace->gen != gen) return;
+
+    if (written) {
+        uint64_t now = metrics_now_ns();
+        if (!trace->writes) trace->ts[TRACE_WRITE] = now;
+        trace->write_last = now;
+        trace->writes += 1;
+    }
+
+    trace->pending -= 1;
+    if (trace->pending == 0 && trace->ended) trace_emit(trace);
+}
+
+void trace_dump(FILE *fp) {
+    size_t start = (__ring_head + TRACE_RING_MAX - __ring_len) % TRACE_RING_MAX;
+
+    fputc('[', fp);
+    for (size_t i = 0; i < __ring_len; ++i) {
+        if (i) fputc(',', fp);
+        trace_write_json(fp, &__ring[(start + i) % TRACE_RING_MAX]);
+    }
+    fputc(']', fp);
+}
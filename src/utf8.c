@@ -0,0 +1,257 @@
+#include <utf8.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define UTF8_IS_CONT(c) (((uint8_t)(c) & 0xc0) == 0x80)
+
+typedef struct {
+    size_t cont;  // continuation bytes, code points = bytes - cont
+    size_t lead4; // leads of 4 byte sequences, 2 UTF-16 units each
+    size_t wide;  // bytes >= 0x80
+} utf8_counts_t;
+
+static inline void utf8_scalar_add(utf8_counts_t *counts, uint8_t c) {
+    counts->cont += UTF8_IS_CONT(c);
+    counts->lead4 += c >= 0xf0;
+    counts->wide += c >= 0x80;
+}
+
+static utf8_counts_t utf8_scan(const char *data, size_t len) {
+    utf8_counts_t counts = {0, 0, 0};
+    size_t        i      = 0;
+
+#ifdef __SSE2__
+    // matches are -1 per byte lane, subtracted into 8-bit counters that are
+    // summed every 255 chunks before they can wrap
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cont = _mm_set1_epi8((char)0xc0);
+    const __m128i f0   = _mm_set1_epi8((char)0xf0);
+    while (i + 16 <= len) {
+        __m128i n_cont = zero, n_lead4 = zero, n_wide = zero;
+        size_t  end    = len - i < 255 * 16 ? len - 15 : i + 255 * 16;
+
+        for (; i < end; i += 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+            // signed: 0x80..0xbf is below 0xc0, 0x80..0xff below 0
+            n_cont  = _mm_sub_epi8(n_cont, _mm_cmplt_epi8(chunk, cont));
+            n_wide  = _mm_sub_epi8(n_wide, _mm_cmplt_epi8(chunk, zero));
+            n_lead4 = _mm_sub_epi8(n_lead4,
+                _mm_cmpeq_epi8(_mm_max_epu8(chunk, f0), chunk));
+        }
+
+        __m128i s_cont  = _mm_sad_epu8(n_cont, zero);
+        __m128i s_lead4 = _mm_sad_epu8(n_lead4, zero);
+        __m128i s_wide  = _mm_sad_epu8(n_wide, zero);
+        counts.cont += _mm_cvtsi128_si32(s_cont) +
+                       _mm_cvtsi128_si32(_mm_unpackhi_epi64(s_cont, s_cont));
+        counts.lead4 +=
+            _mm_cvtsi128_si32(s_lead4) +
+            _mm_cvtsi128_si32(_mm_unpackhi_epi64(s_lead4, s_lead4));
+        counts.wide += _mm_cvtsi128_si32(s_wide) +
+                       _mm_cvtsi128_si32(_mm_unpackhi_epi64(s_wide, s_wide));
+    }
+#endif
+    for (; i < len; ++i) utf8_scalar_add(&counts, data[i]);
+
+    return counts;
+}
+
+static inline size_t utf8_units(
+    const utf8_counts_t *counts, size_t len, utf8_unit_t unit) {
+    switch (unit) {
+    case UTF8_CODE_POINTS: return len - counts->cont;
+    case UTF8_UTF16: return len - counts->cont + counts->lead4;
+    default: return len;
+    }
+}
+
+bool utf8_valid(const char *s, size_t len) {
+    const uint8_t *p = (const uint8_t *)s;
+    size_t         i = 0;
+
+    while (i < len) {
+#ifdef __SSE2__
+        // most text is ASCII, skip it 16 bytes at a time up to the first
+        // byte that is not
+        while (i + 16 <= len) {
+            uint32_t m =
+                _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i)));
+            if (m) {
+                i += __builtin_ctz(m);
+                break;
+            }
+            i += 16;
+        }
+        if (i >= len) break;
+#endif
+        uint8_t c = p[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+
+        size_t   n;
+        uint32_t cp;
+        if (c >= 0xc2 && c <= 0xdf) {
+            n  = 1;
+            cp = c & 0x1f;
+        } else if ((c & 0xf0) == 0xe0) {
+            n  = 2;
+            cp = c & 0x0f;
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            n  = 3;
+            cp = c & 0x07;
+        } else {
+            return false;
+        }
+
+        if (len - i <= n) return false;
+        for (size_t j = 1; j <= n; ++j) {
+            if (!UTF8_IS_CONT(p[i + j])) return false;
+            cp = cp << 6 | (p[i + j] & 0x3f);
+        }
+
+        if (n == 2 && (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff))) {
+            return false;
+        }
+        if (n == 3 && (cp < 0x10000 || cp > 0x10ffff)) return false;
+
+        i += n + 1;
+    }
+
+    return true;
+}
+
+bool utf8_boundary(const char *s, size_t len, size_t offset) {
+    return offset >= len || !UTF8_IS_CONT(s[offset]);
+}
+
+size_t utf8_count(const char *data, size_t len, utf8_unit_t unit) {
+    if (unit == UTF8_BYTES) return len;
+
+    utf8_counts_t counts = utf8_scan(data, len);
+    return utf8_units(&counts, len, unit);
+}
+
+static const char *utf8_unit_names[UTF8_UNITS] = {"bytes", "cp", "utf16"};
+
+utf8_unit_t utf8_unit_parse(const char *s, utf8_unit_t def) {
+    if (!s) return def;
+    for (int i = 0; i < UTF8_UNITS; ++i) {
+        if (strcmp(s, utf8_unit_names[i]) == 0) return i;
+    }
+    return def;
+}
+
+const char *utf8_unit_name(utf8_unit_t unit) {
+    return utf8_unit_names[unit];
+}
+
+static void utf8_index_reserve(utf8_index_t *idx, size_t blocks) {
+    if (blocks <= idx->cap) return;
+
+    size_t cap = idx->cap ? idx->cap : 16;
+    while (cap < blocks) cap *= 2;
+
+    idx->cps  = realloc(idx->cps, cap * sizeof(size_t));
+    idx->u16s = realloc(idx->u16s, cap * sizeof(size_t));
+    idx->cap  = cap;
+}
+
+utf8_index_t *utf8_index_new(const char *content, size_t len) {
+    utf8_index_t *idx = calloc(1, sizeof(utf8_index_t));
+    idx->len          = len;
+    idx->wide         = utf8_scan(content, len).wide;
+    idx->valid        = 1;
+
+    utf8_index_reserve(idx, 1);
+    idx->cps[0]  = 0;
+    idx->u16s[0] = 0;
+    return idx;
+}
+
+void utf8_index_drop(utf8_index_t *idx) {
+    if (!idx) return;
+    free(idx->cps);
+    free(idx->u16s);
+    free(idx);
+}
+
+// count the blocks before block `k`, k <= len / UTF8_BLOCK
+static void utf8_index_fill(utf8_index_t *idx, const char *content, size_t k) {
+    if (k < idx->valid) return;
+
+    utf8_index_reserve(idx, k + 1);
+    for (size_t b = idx->valid; b <= k; ++b) {
+        utf8_counts_t counts =
+            utf8_scan(content + (b - 1) * UTF8_BLOCK, UTF8_BLOCK);
+
+        idx->cps[b] = idx->cps[b - 1] + UTF8_BLOCK - counts.cont;
+        idx->u16s[b] =
+            idx->u16s[b - 1] + UTF8_BLOCK - counts.cont + counts.lead4;
+    }
+    idx->valid = k + 1;
+}
+
+size_t utf8_index_to_byte(
+    utf8_index_t *idx, const char *content, utf8_unit_t unit, size_t n) {
+    if (unit == UTF8_BYTES || !idx->wide) return n < idx->len ? n : idx->len;
+
+    // count blocks until one starts past the `n`th unit
+    size_t last = idx->len / UTF8_BLOCK;
+    while (idx->valid - 1 < last &&
+           (unit == UTF8_UTF16 ? idx->u16s : idx->cps)[idx->valid - 1] <= n) {
+        utf8_index_fill(idx, content, idx->valid);
+    }
+    const size_t *prefix = unit == UTF8_UTF16 ? idx->u16s : idx->cps;
+
+    // last block starting at or before it
+    size_t lo = 0, hi = idx->valid;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (prefix[mid] <= n) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // units are counted at the first byte of their character
+    size_t count = prefix[lo];
+    for (size_t i = lo * UTF8_BLOCK; i < idx->len; ++i) {
+        uint8_t c = content[i];
+        if (UTF8_IS_CONT(c)) continue;
+        if (count == n) return i;
+
+        count += unit == UTF8_UTF16 && c >= 0xf0 ? 2 : 1;
+        if (count > n) return i;
+    }
+    return idx->len;
+}
+
+size_t utf8_index_from_byte(
+    utf8_index_t *idx, const char *content, utf8_unit_t unit, size_t offset) {
+    if (offset > idx->len) offset = idx->len;
+    if (unit == UTF8_BYTES || !idx->wide) return offset;
+
+    size_t k = offset / UTF8_BLOCK;
+    utf8_index_fill(idx, content, k);
+
+    size_t        start  = k * UTF8_BLOCK;
+    utf8_counts_t counts = utf8_scan(content + start, offset - start);
+    size_t        before = unit == UTF8_UTF16 ? idx->u16s[k] : idx->cps[k];
+    return before + utf8_units(&counts, offset - start, unit);
+}
+
+void utf8_index_splice(utf8_index_t *idx, size_t pos, const char *removed,
+    size_t removed_len, const char *string, size_t string_len) {
+    if (removed_len) idx->wide -= utf8_scan(removed, removed_len).wide;
+    if (string_len) idx->wide += utf8_scan(string, string_len).wide;
+    idx->len = idx->len - removed_len + string_len;
+
+    // the counts before the block holding `pos` are unchanged
+    size_t valid = pos / UTF8_BLOCK + 1;
+    if (valid < idx->valid) idx->valid = valid;
+}
@@ -1,6 +1,10 @@
 // clang-format off
+#include <stdint.h>
+
 #include "vec.h"
 
+#define VEC_MIN_CAP 4
+
 static void vec_elm_cpy(vec_t *vec, void *dst, const void *src) {
     if (vec->elm_cpy) {
         vec->elm_cpy(dst, src);
@@ -14,13 +18,28 @@ static int vec_elm_cmp(vec_t *vec, const void *a, const void *b) {
         return vec->elm_cmp(a, b);
     }
 
-    for (size_t i = 0; i < vec->elm_size; ++i) {
-        const char *ca = a + i;
-        const char *cb = b + i;
-        if (*ca != *cb) return *ca - *cb;
+    return memcmp(a, b, vec->elm_size);
+}
+
+static void vec_elm_drop(vec_t *vec, void *elm) {
+    if (vec->elm_drop) {
+        vec->elm_drop(elm);
     }
+}
 
-    return 0;
+// make room for `cap` elements, amortized doubling
+static int vec_grow(vec_t *vec, size_t cap) {
+    if (cap <= vec->cap) return 1;
+
+    size_t new_cap = vec->cap ? vec->cap * 2 : VEC_MIN_CAP;
+    if (new_cap < cap) new_cap = cap;
+
+    void *arr = realloc(vec->arr, vec->elm_size * new_cap);
+    if (!arr) return 0;
+
+    vec->arr = arr;
+    vec->cap = new_cap;
+    return 1;
 }
 
 vec_t *vec_new(
@@ -44,47 +63,79 @@ vec_t *vec_new(
 }
 
 int vec_add(vec_t *vec, void *elm) {
-    if (!vec) return 0;
+    if (!vec || !vec_grow(vec, vec->len + 1)) return 0;
 
-    if (vec->len == -2lu) {
-        return 0;
-    } else if (vec->len <= 0) {
-        vec->len = 0;
-        vec->cap = 1;
-        vec->arr = malloc(vec->elm_size);
-    } else if (vec->len >= vec->cap) {
-        vec->cap *= 2;
-        void *old_arr = vec->arr;
-        vec->arr      = malloc(vec->elm_size * vec->cap);
-        memcpy(vec->arr, old_arr, vec->elm_size * vec->len);
-        free(old_arr);
-    }
+    vec_elm_cpy(vec, vec->arr + vec->len * vec->elm_size, elm);
+    vec->len += 1;
+    return 1;
+}
 
-    void *new_elm = vec->arr + vec->len * vec->elm_size;
-    vec_elm_cpy(vec, new_elm, elm);
+int vec_extend(vec_t *vec, const void *elms, size_t n) {
+    if (!vec || !vec_grow(vec, vec->len + n)) return 0;
 
-    vec->len += 1;
+    void *dst = vec->arr + vec->len * vec->elm_size;
+    if (vec->elm_cpy) {
+        for (size_t i = 0; i < n; ++i) {
+            vec->elm_cpy(dst + i * vec->elm_size, elms + i * vec->elm_size);
+        }
+    } else {
+        memcpy(dst, elms, n * vec->elm_size);
+    }
+
+    vec->len += n;
     return 1;
 }
 
+int vec_reserve(vec_t *vec, size_t n) {
+    if (!vec) return 0;
+    return vec_grow(vec, vec->len + n);
+}
+
 int vec_remove(vec_t *vec, size_t idx) {
-    if (!vec || !vec->arr || vec->len == -1lu || idx == -1lu || vec->len <= idx)
-        return 0;
+    if (!vec || idx >= vec->len) return 0;
 
-    if (vec->elm_drop) {
-        vec->elm_drop(vec_get(vec, idx));
-    }
+    void *elm = vec->arr + idx * vec->elm_size;
+    vec_elm_drop(vec, elm);
 
-    for (size_t i = idx; i < vec->len - 1; ++i) {
-        vec_elm_cpy(vec, vec->arr + i * vec->elm_size,
-            vec->arr + (i + 1) * vec->elm_size);
+    if (vec->elm_cpy) {
+        for (size_t i = idx; i < vec->len - 1; ++i) {
+            vec->elm_cpy(vec->arr + i * vec->elm_size,
+                vec->arr + (i + 1) * vec->elm_size);
+        }
+    } else {
+        memmove(elm, elm + vec->elm_size,
+            (vec->len - idx - 1) * vec->elm_size);
     }
 
     vec->len -= 1;
+    return 1;
+}
+
+int vec_swap_remove(vec_t *vec, size_t idx) {
+    if (!vec || idx >= vec->len) return 0;
+
+    void *elm = vec->arr + idx * vec->elm_size;
+    vec_elm_drop(vec, elm);
+
+    vec->len -= 1;
+    if (idx != vec->len) {
+        vec_elm_cpy(vec, elm, vec->arr + vec->len * vec->elm_size);
+    }
 
     return 1;
 }
 
+void vec_clear(vec_t *vec) {
+    if (!vec) return;
+
+    if (vec->elm_drop) {
+        for (size_t i = 0; i < vec->len; ++i) {
+            vec->elm_drop(vec->arr + i * vec->elm_size);
+        }
+    }
+    vec->len = 0;
+}
+
 void *vec_get(vec_t *vec, size_t idx) {
     if (!vec) return NULL;
     if (idx >= vec->len) return NULL;
@@ -92,12 +143,20 @@ void *vec_get(vec_t *vec, size_t idx) {
 }
 
 size_t vec_index_of(vec_t *vec, void *elm) {
-    if (!vec || !vec->arr || vec->len == -1lu) return -1lu;
+    if (!vec) return -1lu;
+
+    // pointers and ids, compared as one word instead of a memcmp call
+    if (!vec->elm_cmp && vec->elm_size == sizeof(uint64_t)) {
+        uint64_t key;
+        memcpy(&key, elm, sizeof(key));
+        for (size_t i = 0; i < vec->len; ++i) {
+            if (((uint64_t *)vec->arr)[i] == key) return i;
+        }
+        return -1lu;
+    }
 
-    void *cur;
     for (size_t i = 0; i < vec->len; ++i) {
-        cur = vec->arr + i * vec->elm_size;
-        if (!vec_elm_cmp(vec, cur, elm)) return i;
+        if (!vec_elm_cmp(vec, vec->arr + i * vec->elm_size, elm)) return i;
     }
 
     return -1lu;
@@ -105,14 +164,8 @@ size_t vec_index_of(vec_t *vec, void *elm) {
 
 void vec_drop(vec_t *vec) {
     if (!vec) return;
-    if (vec->arr) {
-        if (vec->elm_drop) {
-            for (size_t i = 0; i < vec->len; ++i) {
-                vec->elm_drop(vec_get(vec, i));
-            }
-        }
-        free(vec->arr);
-    }
+    vec_clear(vec);
+    free(vec->arr);
     free(vec);
 }
 // clang-format on
@@ -1,26 +1,162 @@
-#include <ws.h>
-
-int file_info_cmp(const void *a, const void *b) {
-    const struct file_info *fa = a;
-    const struct file_info *fb = b;
+#include <sys/socket.h>
 
-    return fa->file->id - fb->file->id;
-}
+#include <ws.h>
+#include <proto.h>
+#include <metrics.h>
+#include <trace.h>
+#include <capture.h>
+#include <arena.h>
+#include <pool.h>
 
 void file_info_drop(void *a) {
     struct file_info *f = a;
     db_file_drop(f->file);
     vec_drop(f->wsis);
+    ot_log_drop(f->ot);
+    lines_drop(f->lines);
+    utf8_index_drop(f->utf8);
+
+    if (f->run) lws_sul_cancel(&f->run->sul);
+    free(f->run);
 }
 
 void msg_drop(void *msg) {
     struct my_msg *m = msg;
-    free(m->payload);
+    trace_release(m->trace, false);
+    pool_free(m->payload);
     m->payload = NULL;
     m->len     = 0;
 }
 
-void *get_all_payload(vec_t *vec, size_t *len_o, int *type_o) {
+// fragment size for one lws_write, tuned from the socket send buffer so a
+// fragment normally goes out in one send() without being truncated
+size_t my_frag_size(struct lws *wsi) {
+    int       sndbuf = 0;
+    socklen_t optlen = sizeof(sndbuf);
+
+    if (getsockopt(lws_get_socket_fd(wsi), SOL_SOCKET, SO_SNDBUF, &sndbuf,
+            &optlen) < 0) {
+        return MY_PSS_SIZE;
+    }
+
+    // linux reports twice the usable size, the other half is bookkeeping
+    size_t size = sndbuf / 2;
+    if (size < MY_PSS_SIZE) size = MY_PSS_SIZE;
+    if (size > MY_FRAG_MAX) size = MY_FRAG_MAX;
+    return size;
+}
+
+// request uri with its query args joined back, for captures
+static void my_ws_uri(struct lws *wsi, char *out, int cap) {
+    int len = lws_hdr_copy(wsi, out, cap, WSI_TOKEN_GET_URI);
+    if (len < 0) len = 0;
+
+    for (int i = 0; len + 2 < cap; ++i) {
+        int n = lws_hdr_copy_fragment(wsi, out + len + 1, cap - len - 1,
+            WSI_TOKEN_HTTP_URI_ARGS, i);
+        if (n <= 0) break;
+
+        out[len] = i ? '&' : '?';
+        len += n + 1;
+    }
+    out[len] = '\0';
+}
+
+// write the next fragment of the head of `v_write`, return -1 if failed
+int my_write_next(
+    struct lws *wsi, vec_t *v_write, size_t frag_size, bool is_http) {
+    struct my_msg *pmsg = vec_get(v_write, 0);
+    if (!pmsg) return 0;
+
+    size_t frag    = pmsg->len - pmsg->sent;
+    bool   is_last = true;
+    if (frag > frag_size) {
+        frag    = frag_size;
+        is_last = false;
+    }
+
+    int flags;
+    if (is_http) {
+        flags = is_last ? LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP;
+    } else {
+        flags = lws_write_ws_flags(
+            pmsg->is_bin ? LWS_WRITE_BINARY : LWS_WRITE_TEXT,
+            pmsg->sent == 0, is_last);
+    }
+
+    // lws keeps whatever the kernel did not take and flushes it before the
+    // next writeable callback, so a short send is not an error here
+    int n = lws_write(wsi, pmsg->payload + LWS_PRE + pmsg->sent, frag, flags);
+    if (n < 0) return -1;
+
+    pmsg->sent += frag;
+    if (is_last) {
+        trace_release(pmsg->trace, true);
+        pmsg->trace = 0;
+        vec_remove(v_write, 0);
+    }
+
+    return 0;
+}
+
+// merge the whole messages at the head of `v_write` into one frame, a json
+// array of text messages or a PROTO_OP_BATCH frame of binary ones. they
+// were queued since the last write, mostly broadcasts of the same tick
+static void my_batch_queued(vec_t *v_write) {
+    struct my_msg *head = vec_get(v_write, 0);
+    if (!head || head->sent) return;
+
+    size_t count = 1, len = head->len;
+    for (; count < v_write->len; ++count) {
+        struct my_msg *pmsg = vec_get(v_write, count);
+        if (pmsg->is_bin != head->is_bin || len + pmsg->len > MY_BATCH_MAX) {
+            break;
+        }
+        len += pmsg->len;
+    }
+    if (count < 2) return;
+
+    size_t   cap     = len + (count + 2) * PROTO_VARINT_MAX;
+    uint8_t *payload = pool_alloc(LWS_PRE + cap);
+    uint8_t *out     = payload + LWS_PRE;
+    size_t   pos     = 0;
+
+    if (head->is_bin) {
+        pos += proto_batch_header(count, out);
+    } else {
+        out[pos++] = '[';
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        struct my_msg *pmsg = vec_get(v_write, i);
+
+        if (head->is_bin) {
+            pos += proto_varint_encode(pmsg->len, out + pos);
+        } else if (i) {
+            out[pos++] = ',';
+        }
+        memcpy(out + pos, pmsg->payload + LWS_PRE, pmsg->len);
+        pos += pmsg->len;
+
+        // the batch is written right away, the head keeps its trace
+        if (i) {
+            trace_release(pmsg->trace, true);
+            pmsg->trace = 0;
+        }
+    }
+    if (!head->is_bin) out[pos++] = ']';
+
+    pool_free(head->payload);
+    head->payload = payload;
+    head->len     = pos;
+
+    for (size_t i = 1; i < count; ++i) vec_remove(v_write, 1);
+    metrics_inc(METRICS_WS_BATCHED, count);
+}
+
+// join the fragments of `vec` into one buffer allocated from `arena`
+void *get_all_payload(
+    arena_t *arena, vec_t *vec, size_t *len_o, int *type_o) {
     void  *payload = NULL;
     size_t len     = 0;
 
@@ -37,7 +173,7 @@ void *get_all_payload(vec_t *vec, size_t *len_o, int *type_o) {
         len += pmsg->len;
     }
 
-    payload = malloc(len + 1);
+    payload = arena_alloc(arena, len + 1);
     *len_o  = len;
 
     len = 0;
@@ -58,14 +194,12 @@ int my_ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
     struct my_per_vhost_data   *vhd =
         lws_protocol_vh_priv_get(lws_get_vhost(wsi), prl);
 
-    const struct my_msg *pmsg;
-    struct my_msg        msg;
-    void                *all_payload;
-    size_t               all_payload_len;
-    int                  all_payload_type;
+    struct my_msg msg;
+    void         *all_payload;
+    size_t        all_payload_len;
+    int           all_payload_type;
 
-    int    flags;
-    size_t n;
+    char arg[16];
 
     switch (reason) {
         case LWS_CALLBACK_PROTOCOL_INIT:
@@ -73,20 +207,57 @@ int my_ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
                 lws_get_vhost(wsi), prl, sizeof(struct my_per_vhost_data));
             vhd->pss_list =
                 vec_new_r(struct my_per_session_data *, NULL, NULL, NULL);
-            vhd->files = vec_new_r(
-                struct file_info, NULL, file_info_cmp, file_info_drop);
+            vhd->files = hmap_new_r(uint64_t, struct file_info, file_info_drop);
             break;
 
         case LWS_CALLBACK_PROTOCOL_DESTROY:
-            vec_drop(vhd->files);
+            if (mws && mws->ondestroy) {
+                mws->ondestroy(vhd);
+            }
+            hmap_drop(vhd->files);
             vec_drop(vhd->pss_list);
             break;
 
+        case LWS_CALLBACK_CONFIRM_EXTENSION_OKAY:
+            // deflate costs cpu for every frame sent to every session and a
+            // zlib context per session, most frames being keystrokes. a
+            // client short of bandwidth asks for it with `?deflate=1`
+            if (!mws) break;
+
+            arg[0] = '\0';
+            lws_get_urlarg_by_name(wsi, "deflate", arg, sizeof(arg) - 1);
+            if (strcmp(arg, "1") == 0) break;
+
+            arg[0] = '\0';
+            lws_get_urlarg_by_name(wsi, "proto", arg, sizeof(arg) - 1);
+            if (strcmp(arg, PROTO_NAME) == 0 ? !mws->deflate_bin
+                                             : !mws->deflate_json) {
+                return 1;
+            }
+            break;
+
         case LWS_CALLBACK_ESTABLISHED:
+            if (mws && mws->deflate_level >= 0) {
+                sprintf(arg, "%d", mws->deflate_level);
+                lws_set_extension_option(
+                    wsi, "permessage-deflate", "compression_level", arg);
+            }
+
+            metrics_inc(METRICS_WS_OPENED, 1);
+
             vec_add(vhd->pss_list, &pss);
-            pss->wsi     = wsi;
-            pss->v_read  = vec_new_r(struct my_msg, NULL, NULL, msg_drop);
-            pss->v_write = vec_new_r(struct my_msg, NULL, NULL, msg_drop);
+            pss->wsi       = wsi;
+            pss->v_read    = pool_vec_new(sizeof(struct my_msg), msg_drop);
+            pss->v_write   = pool_vec_new(sizeof(struct my_msg), msg_drop);
+            pss->frag_size = my_frag_size(wsi);
+
+            arg[0] = '\0';
+            lws_get_urlarg_by_name(wsi, "batch", arg, sizeof(arg) - 1);
+            pss->batch = strcmp(arg, "1") == 0;
+
+            char uri[1024];
+            my_ws_uri(wsi, uri, sizeof(uri));
+            pss->capture_id = capture_session_open(uri);
 
             if (mws && mws->onopen) {
                 mws->onopen(wsi);
@@ -94,9 +265,13 @@ int my_ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
             break;
 
         case LWS_CALLBACK_CLOSED:
-            vec_drop(pss->v_read);
-            vec_drop(pss->v_write);
-            vec_remove_by(vhd->pss_list, &pss);
+            metrics_inc(METRICS_WS_CLOSED, 1);
+            capture_session_close(pss->capture_id);
+
+            pool_vec_free(pss->v_read);
+            pool_vec_free(pss->v_write);
+            vec_swap_remove_by_r(
+                struct my_per_session_data *, vhd->pss_list, pss);
 
             if (mws && mws->onclose) {
                 mws->onclose(wsi);
@@ -104,40 +279,61 @@ int my_ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
             break;
 
         case LWS_CALLBACK_SERVER_WRITEABLE:
-            pmsg = vec_get(pss->v_write, 0);
-            if (!pmsg) break;
+            if (pss->batch) my_batch_queued(pss->v_write);
 
-            flags = lws_write_ws_flags(
-                pmsg->is_bin ? LWS_WRITE_BINARY : LWS_WRITE_TEXT,
-                pmsg->is_first, pmsg->is_last);
-            n = lws_write(wsi, pmsg->payload + LWS_PRE, pmsg->len, flags);
-            if (n < pmsg->len) return 1;
+            if (my_write_next(wsi, pss->v_write, pss->frag_size, false) < 0)
+                return 1;
 
-            vec_remove(pss->v_write, 0);
             if (pss->v_write->len > 0) lws_callback_on_writable(wsi);
             break;
 
         case LWS_CALLBACK_RECEIVE:
+            metrics_inc(METRICS_WS_BYTES_IN, len);
+
+            // unfragmented message, no need to copy it out of lws
+            if (lws_is_first_fragment(wsi) && lws_is_final_fragment(wsi)) {
+                bool is_bin = lws_frame_is_binary(wsi);
+
+                pss->recv_ns = metrics_now_ns();
+                metrics_inc(METRICS_WS_MESSAGES, 1);
+
+                capture_frame(pss->capture_id, is_bin, in, len);
+                if (mws && mws->onmessage) {
+                    mws->onmessage(wsi, in, len, is_bin);
+                }
+
+                arena_reset(arena_msg());
+                break;
+            }
+
             msg.len      = len;
+            msg.sent     = 0;
+            msg.trace    = 0;
             msg.is_first = (bool)lws_is_first_fragment(wsi);
             msg.is_last  = (bool)lws_is_final_fragment(wsi);
             msg.is_bin   = (bool)lws_frame_is_binary(wsi);
-            msg.payload  = malloc(LWS_PRE + len);
+            msg.payload  = pool_alloc(LWS_PRE + len);
             memcpy(msg.payload + LWS_PRE, in, len);
             vec_add(pss->v_read, &msg);
 
+            if (msg.is_first) pss->recv_ns = metrics_now_ns();
+
             if (msg.is_last) {
-                all_payload = get_all_payload(
-                    pss->v_read, &all_payload_len, &all_payload_type);
+                metrics_inc(METRICS_WS_MESSAGES, 1);
+
+                all_payload = get_all_payload(arena_msg(), pss->v_read,
+                    &all_payload_len, &all_payload_type);
+
+                capture_frame(pss->capture_id, all_payload_type, all_payload,
+                    all_payload_len);
 
                 if (mws && mws->onmessage) {
                     mws->onmessage(
                         wsi, all_payload, all_payload_len, all_payload_type);
                 }
 
-                free(all_payload);
-                vec_drop(pss->v_read);
-                pss->v_read = vec_new_r(struct my_msg, NULL, NULL, msg_drop);
+                arena_reset(arena_msg());
+                vec_clear(pss->v_read);
             }
 
             break;
@@ -155,45 +351,19 @@ size_t my_ws_send(struct lws *wsi, const void *msg, size_t len, bool is_bin) {
 
     if (!pss) return -1;
 
-    struct my_msg amsg;
-
-    if (len <= MY_PSS_SIZE) {
-        amsg.is_first = true;
-        amsg.is_last  = true;
-        amsg.is_bin   = is_bin;
-        amsg.len      = len;
-        amsg.payload  = malloc(len + LWS_PRE);
-        memcpy(amsg.payload + LWS_PRE, msg, len);
-        vec_add(pss->v_write, &amsg);
-        lws_callback_on_writable(wsi);
-        return len;
-    }
-
-    size_t index;
-
-    amsg.is_first = true;
-    amsg.is_last  = false;
-    amsg.is_bin   = is_bin;
-    amsg.len      = MY_PSS_SIZE;
-    amsg.payload  = malloc(MY_PSS_SIZE + LWS_PRE);
-    memcpy(amsg.payload + LWS_PRE, msg, MY_PSS_SIZE);
-    vec_add(pss->v_write, &amsg);
-
-    amsg.is_first = false;
-    for (index = MY_PSS_SIZE; index < len - MY_PSS_SIZE; index += MY_PSS_SIZE) {
-        amsg.payload = malloc(MY_PSS_SIZE + LWS_PRE);
-        memcpy(amsg.payload + LWS_PRE, msg + index, MY_PSS_SIZE);
-        vec_add(pss->v_write, &amsg);
-    }
-
-    amsg.is_last = true;
-    amsg.len     = len - index;
-    amsg.payload = malloc(len - index + LWS_PRE);
-    memcpy(amsg.payload + LWS_PRE, msg + index, len - index);
+    struct my_msg amsg = {
+        .len      = len,
+        .sent     = 0,
+        .trace    = trace_ref(),
+        .is_first = true,
+        .is_last  = true,
+        .is_bin   = is_bin,
+    };
+    amsg.payload = pool_alloc(LWS_PRE + len);
+    memcpy(amsg.payload + LWS_PRE, msg, len);
     vec_add(pss->v_write, &amsg);
 
     lws_callback_on_writable(wsi);
-
     return len;
 }
 
@@ -214,78 +384,112 @@ size_t my_ws_send_all(struct lws *wsi, struct lws *except, const void *msg,
     return len;
 }
 
+// drop the per-request state, v_write is kept for the next request
+void my_http_reset(struct my_http_ss *pss) {
+    free(pss->path);
+    pss->path   = NULL;
+    pss->method = NULL;
+    if (pss->v_read) {
+        vec_clear(pss->v_read);
+    } else {
+        pss->v_read = pool_vec_new(sizeof(struct my_msg), msg_drop);
+    }
+}
+
 int my_http_callback(struct lws *wsi, enum lws_callback_reasons reason,
     void *user, void *in, size_t len) {
     const struct lws_protocols *prl = lws_get_protocol(wsi);
 
     onrequest_t onrequest = prl ? prl->user : NULL;
 
-    struct my_http_ss   *pss = user;
-    struct my_msg        msg;
-    const struct my_msg *pmsg;
+    struct my_http_ss *pss = user;
+    struct my_msg      msg;
 
     void  *body;
     size_t body_len;
     int    body_type;
 
-    int    flags;
-    size_t n;
+    char content_len[24];
 
     switch (reason) {
         case LWS_CALLBACK_HTTP:
+            // a kept-alive connection reuses pss for the next transaction
+            my_http_reset(pss);
+
             pss->path = malloc(len + 1);
             memcpy(pss->path, in, len);
             pss->path[len] = '\0';
-            pss->v_read    = vec_new_r(struct my_msg, NULL, NULL, msg_drop);
-            pss->v_write   = vec_new_r(struct my_msg, NULL, NULL, msg_drop);
+
+            if (!pss->v_write) {
+                pss->v_write   = pool_vec_new(sizeof(struct my_msg), msg_drop);
+                pss->frag_size = my_frag_size(wsi);
+            }
 
             if (!onrequest) break;
             if (lws_hdr_total_length(wsi, WSI_TOKEN_GET_URI)) {
-                onrequest(wsi, pss->path, NULL, 0);
+                onrequest(wsi, "GET", pss->path, NULL, 0);
+            } else if (lws_hdr_total_length(wsi, WSI_TOKEN_POST_URI)) {
+                // the body comes with HTTP_BODY_COMPLETION, lws sends none
+                // for an empty one
+                content_len[0] = '\0';
+                lws_hdr_copy(wsi, content_len, sizeof(content_len),
+                    WSI_TOKEN_HTTP_CONTENT_LENGTH);
+                if (atol(content_len) > 0) {
+                    pss->method = "POST";
+                } else {
+                    onrequest(wsi, "POST", pss->path, "", 0);
+                }
             } else if (lws_hdr_total_length(wsi, WSI_TOKEN_OPTIONS_URI)) {
                 my_http_send(wsi, 200,
                     "Access-Control-Allow-Origin: *\r\n"
                     "Access-Control-Allow-Headers: content-type\r\n",
                     "");
+            } else {
+                my_http_send(wsi, 405, "Allow: GET, POST, OPTIONS\r\n", "");
             }
             break;
 
         case LWS_CALLBACK_HTTP_BODY:
             msg.len     = len;
-            msg.payload = malloc(LWS_PRE + len);
+            msg.sent    = 0;
+            msg.trace   = 0;
+            msg.payload = pool_alloc(LWS_PRE + len);
             memcpy(msg.payload + LWS_PRE, in, len);
             vec_add(pss->v_read, &msg);
             break;
 
         case LWS_CALLBACK_HTTP_BODY_COMPLETION:
-            if (onrequest) {
-                body = get_all_payload(pss->v_read, &body_len, &body_type);
-                onrequest(wsi, pss->path, body, body_len);
-                free(body);
+            if (onrequest && pss->method) {
+                body = get_all_payload(
+                    arena_msg(), pss->v_read, &body_len, &body_type);
+                onrequest(wsi, pss->method, pss->path, body, body_len);
+                pss->method = NULL;
+                arena_reset(arena_msg());
             }
             break;
 
         case LWS_CALLBACK_CLOSED_HTTP:
             free(pss->path);
-            vec_drop(pss->v_read);
-            vec_drop(pss->v_write);
+            pool_vec_free(pss->v_read);
+            pool_vec_free(pss->v_write);
+            pss->path    = NULL;
+            pss->v_read  = NULL;
+            pss->v_write = NULL;
             break;
 
         case LWS_CALLBACK_HTTP_WRITEABLE:
-            pmsg = vec_get(pss->v_write, 0);
-            if (!pmsg) break;
-
-            flags = lws_write_ws_flags(
-                LWS_WRITE_HTTP, pmsg->is_first, pmsg->is_last);
-            n = lws_write(wsi, pmsg->payload + LWS_PRE, pmsg->len, flags);
-            if (n < pmsg->len) return 1;
+            if (my_write_next(wsi, pss->v_write, pss->frag_size, true) < 0)
+                return 1;
 
-            vec_remove(pss->v_write, 0);
             if (pss->v_write->len > 0) {
                 lws_callback_on_writable(wsi);
-            } else {
-                lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NORMAL, NULL);
+                break;
             }
+
+            // response done, keep the connection for the next request unless
+            // the client asked to close it
+            my_http_reset(pss);
+            if (lws_http_transaction_completed(wsi)) return -1;
             break;
 
         default:
@@ -308,90 +512,52 @@ size_t my_http_send(
         lws_callback_on_writable(wsi);
         return 0;
     }
-    sprintf(p,
+    p += sprintf(p,
         "%s"
         "Content-Length: %ld\r\n"
         "\r\n",
         headers ? headers : "", body_len);
 
-    struct my_msg amsg;
-    amsg.is_first = true;
-    amsg.is_last  = false;
-    amsg.is_bin   = false;
-    amsg.len      = strlen(headers_);
-    amsg.payload  = malloc(LWS_PRE + amsg.len);
-    memcpy(amsg.payload + LWS_PRE, headers_, amsg.len);
-    vec_add(pss->v_write, &amsg);
-
-    size_t index = 0;
-
-    amsg.is_first = false;
-    amsg.len      = MY_PSS_SIZE;
-    for (index = 0; body_len > MY_PSS_SIZE && index < body_len - MY_PSS_SIZE;
-         index += MY_PSS_SIZE) {
-        amsg.payload = malloc(MY_PSS_SIZE + LWS_PRE);
-        memcpy(amsg.payload + LWS_PRE, body + index, MY_PSS_SIZE);
-        vec_add(pss->v_write, &amsg);
-    }
-
-    amsg.is_last = true;
-    amsg.len     = body_len - index;
-    amsg.payload = malloc(body_len - index + LWS_PRE);
-    memcpy(amsg.payload + LWS_PRE, body + index, body_len - index);
+    size_t headers_len = p - headers_;
+
+    // headers and body go out of the same buffer
+    struct my_msg amsg = {
+        .len      = headers_len + body_len,
+        .sent     = 0,
+        .trace    = 0,
+        .is_first = true,
+        .is_last  = true,
+        .is_bin   = false,
+    };
+    amsg.payload = pool_alloc(LWS_PRE + amsg.len);
+    memcpy(amsg.payload + LWS_PRE, headers_, headers_len);
+    memcpy(amsg.payload + LWS_PRE + headers_len, body, body_len);
     vec_add(pss->v_write, &amsg);
 
     lws_callback_on_writable(wsi);
-    return strlen(headers_) + body_len;
+    return amsg.len;
 }
 
-size_t my_http_send_json(struct lws *wsi, int stt, struct json_object *json) {
-    struct my_http_ss *pss = lws_wsi_user(wsi);
-
+size_t my_http_send_json(
+    struct lws *wsi, int stt, const char *headers, struct json_object *json) {
     const char *body =
         json_object_to_json_string_ext(json, JSON_C_TO_STRING_PLAIN);
-    size_t body_len = strlen(body);
-
-    char headers[1024], *p = headers;
 
-    if (lws_add_http_header_status(
-            wsi, stt, (unsigned char **)&p, (unsigned char *)headers + 1024)) {
-
-        lws_callback_on_writable(wsi);
-        return 0;
-    }
-    sprintf(p,
+    char headers_[512];
+    snprintf(headers_, sizeof(headers_),
         "Access-Control-Allow-Origin: *\r\n"
         "Content-Type: application/json\r\n"
-        "Content-Length: %ld\r\n"
-        "\r\n",
-        body_len);
-
-    struct my_msg amsg;
-    amsg.is_first = true;
-    amsg.is_last  = false;
-    amsg.is_bin   = false;
-    amsg.len      = strlen(headers);
-    amsg.payload  = malloc(LWS_PRE + amsg.len);
-    memcpy(amsg.payload + LWS_PRE, headers, amsg.len);
-    vec_add(pss->v_write, &amsg);
+        "%s",
+        headers ? headers : "");
 
-    size_t index = 0;
+    size_t n = my_http_send(wsi, stt, headers_, body);
 
-    amsg.is_first = false;
-    amsg.len      = MY_PSS_SIZE;
-    for (index = 0; body_len > MY_PSS_SIZE && index < body_len - MY_PSS_SIZE;
-         index += MY_PSS_SIZE) {
-        amsg.payload = malloc(MY_PSS_SIZE + LWS_PRE);
-        memcpy(amsg.payload + LWS_PRE, body + index, MY_PSS_SIZE);
-        vec_add(pss->v_write, &amsg);
-    }
+    return n ? strlen(body) : 0;
+}
 
-    amsg.is_last = true;
-    amsg.len     = body_len - index;
-    amsg.payload = malloc(body_len - index + LWS_PRE);
-    memcpy(amsg.payload + LWS_PRE, body + index, body_len - index);
-    vec_add(pss->v_write, &amsg);
+struct my_per_vhost_data *my_ws_vhd(struct lws *wsi) {
+    struct lws_vhost *vhost = lws_get_vhost(wsi);
 
-    lws_callback_on_writable(wsi);
-    return body_len;
+    return lws_protocol_vh_priv_get(
+        vhost, lws_vhost_name_to_protocol(vhost, MY_WS_PROTOCOL_NAME));
 }
@@ -0,0 +1,249 @@
+// nps_test_proto: round trips and malformed frames of the binary protocol,
+// see proto.h. prints the failed checks, exits with 1 if any
+//
+//   ctest --test-dir build -R proto
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <bool.h>
+#include <error.h>
+#include <proto.h>
+
+static int failed = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);         \
+            ++failed;                                                          \
+        }                                                                      \
+    } while (0)
+
+// code of the error raised by the last failed call
+static int error_code() {
+    error_t *err  = get_error();
+    int      code = err ? err->code : 0;
+    destroy_error(err);
+    return code;
+}
+
+static size_t encode(const proto_op_t *op, uint8_t *out) {
+    size_t len = proto_encode(op, out, proto_encoded_len(op));
+    CHECK(len > 0);
+    return len;
+}
+
+static bool same_op(const proto_op_t *a, const proto_op_t *b) {
+    return a->op == b->op && a->file_id == b->file_id &&
+           a->ver_id == b->ver_id && a->user_id == b->user_id &&
+           a->ws_id == b->ws_id && a->from == b->from && a->to == b->to &&
+           a->rev == b->rev && a->string_len == b->string_len &&
+           (!a->string_len ||
+               memcmp(a->string, b->string, a->string_len) == 0);
+}
+
+static const proto_op_t ops[] = {
+    {.op = PROTO_OP_INSERT, .file_id = 359874126549811200lu, .ver_id = 7,
+        .user_id = 359874126549811201lu, .from = 120, .to = 120,
+        .string = "h\xc3\xa9llo", .string_len = 6},
+    {.op = PROTO_OP_INSERT, .file_id = 1, .user_id = 2, .from = 0, .to = 0,
+        .rev = 300, .string = "", .string_len = 0},
+    {.op = PROTO_OP_REMOVE, .file_id = 1, .ver_id = 9, .user_id = 2,
+        .from = 3, .to = 70000},
+    {.op = PROTO_OP_REMOVE, .file_id = 1, .user_id = 2, .from = 3, .to = 4,
+        .rev = UINT64_MAX},
+    {.op = PROTO_OP_CURSOR, .file_id = 1, .user_id = 2,
+        .ws_id = 0x7ffd12345678lu, .from = 12, .to = 4},
+    {.op = PROTO_OP_ACK, .file_id = 1, .ver_id = 9, .rev = 513},
+};
+
+#define OPS_LEN (sizeof(ops) / sizeof(ops[0]))
+
+static void test_round_trip() {
+    uint8_t    buf[256];
+    proto_op_t op;
+
+    for (size_t i = 0; i < OPS_LEN; ++i) {
+        size_t len = encode(&ops[i], buf);
+        CHECK(proto_decode(buf, len, &op));
+        CHECK(same_op(&ops[i], &op));
+    }
+
+    // too small a buffer writes nothing
+    CHECK(proto_encode(&ops[0], buf, proto_encoded_len(&ops[0]) - 1) == 0);
+}
+
+static void test_varint() {
+    uint64_t vals[] = {0, 1, 127, 128, 16383, 16384, UINT32_MAX, UINT64_MAX};
+    uint8_t  buf[PROTO_VARINT_MAX];
+    uint64_t val;
+
+    for (size_t i = 0; i < sizeof(vals) / sizeof(vals[0]); ++i) {
+        size_t len = proto_varint_encode(vals[i], buf);
+        CHECK(len <= PROTO_VARINT_MAX);
+        CHECK(proto_varint_decode(buf, len, &val) == len && val == vals[i]);
+        CHECK(proto_varint_decode(buf, len - 1, &val) == 0);
+    }
+
+    // a continuation on the last allowed byte
+    uint8_t over[PROTO_VARINT_MAX + 1];
+    memset(over, 0x80, sizeof(over));
+    over[PROTO_VARINT_MAX] = 0x01;
+    CHECK(proto_varint_decode(over, sizeof(over), &val) == 0);
+
+    // bits past 64 in the last byte are refused, not shifted out
+    memset(over, 0xff, PROTO_VARINT_MAX - 1);
+    for (int last = 2; last < 0x80; last <<= 1) {
+        over[PROTO_VARINT_MAX - 1] = last;
+        CHECK(proto_varint_decode(over, PROTO_VARINT_MAX, &val) == 0);
+    }
+    over[PROTO_VARINT_MAX - 1] = 0x01;
+    CHECK(proto_varint_decode(over, PROTO_VARINT_MAX, &val) ==
+              PROTO_VARINT_MAX &&
+          val == UINT64_MAX);
+}
+
+// every strict prefix of a frame without a revision is refused
+static void test_truncated() {
+    uint8_t    buf[256];
+    proto_op_t op;
+
+    for (size_t i = 0; i < OPS_LEN; ++i) {
+        if (ops[i].rev && ops[i].op != PROTO_OP_ACK) continue;
+
+        size_t len = encode(&ops[i], buf);
+        for (size_t cut = 0; cut < len; ++cut) {
+            CHECK(!proto_decode(buf, cut, &op));
+            CHECK(error_code() == 130);
+        }
+    }
+
+    // the revision of an edit is optional, a frame cut right before it is
+    // the edit without one
+    uint8_t rev_buf[PROTO_VARINT_MAX];
+    size_t  len = encode(&ops[3], buf);
+    size_t  rev = proto_varint_encode(ops[3].rev, rev_buf);
+    CHECK(proto_decode(buf, len - rev, &op) && op.rev == 0);
+    for (size_t cut = len - rev + 1; cut < len; ++cut) {
+        CHECK(!proto_decode(buf, cut, &op));
+        CHECK(error_code() == 130);
+    }
+
+    // a string longer than the frame
+    len = encode(&ops[0], buf);
+    CHECK(!proto_decode(buf, len - ops[0].string_len + 1, &op));
+    CHECK(error_code() == 130);
+}
+
+static void test_malformed() {
+    uint8_t    buf[256];
+    proto_op_t op;
+    size_t     len;
+
+    // unknown ops, above a byte too: 257 must not pass as an insert
+    uint64_t unknown[] = {0, PROTO_OP_BATCH, 6, 255, 257, 260, UINT64_MAX};
+    for (size_t i = 0; i < sizeof(unknown) / sizeof(unknown[0]); ++i) {
+        len = proto_varint_encode(unknown[i], buf);
+        for (int f = 0; f < 6; ++f) len += proto_varint_encode(1, buf + len);
+        CHECK(!proto_decode(buf, len, &op));
+        CHECK(error_code() == 131);
+    }
+
+    // an oversized varint field
+    len = proto_varint_encode(PROTO_OP_CURSOR, buf);
+    memset(buf + len, 0xff, PROTO_VARINT_MAX);
+    buf[len + PROTO_VARINT_MAX] = 0x01;
+    len += PROTO_VARINT_MAX + 1;
+    for (int f = 0; f < 5; ++f) len += proto_varint_encode(1, buf + len);
+    CHECK(!proto_decode(buf, len, &op));
+    CHECK(error_code() == 130);
+
+    // a position with bits past 64, it would decode as a wrong offset
+    len = proto_varint_encode(PROTO_OP_REMOVE, buf);
+    for (int f = 0; f < 3; ++f) len += proto_varint_encode(1, buf + len);
+    memset(buf + len, 0x80, PROTO_VARINT_MAX - 1);
+    buf[len + PROTO_VARINT_MAX - 1] = 0x02;
+    len += PROTO_VARINT_MAX;
+    len += proto_varint_encode(1, buf + len);
+    CHECK(!proto_decode(buf, len, &op));
+    CHECK(error_code() == 130);
+
+    // trailing bytes, a cursor has no revision
+    len      = encode(&ops[4], buf);
+    buf[len] = 0x01;
+    CHECK(!proto_decode(buf, len + 1, &op));
+    CHECK(error_code() == 133);
+
+    // a null byte in the string
+    proto_op_t nul = ops[0];
+    nul.string     = "a\0b";
+    nul.string_len = 3;
+    len            = encode(&nul, buf);
+    CHECK(!proto_decode(buf, len, &op));
+    CHECK(error_code() == 132);
+}
+
+static void test_batch() {
+    uint8_t    batch[1024], frame[256];
+    proto_op_t op;
+    size_t     len = proto_batch_header(OPS_LEN, batch);
+
+    CHECK(len <= 2 * PROTO_VARINT_MAX);
+    for (size_t i = 0; i < OPS_LEN; ++i) {
+        size_t flen = encode(&ops[i], frame);
+        len += proto_varint_encode(flen, batch + len);
+        memcpy(batch + len, frame, flen);
+        len += flen;
+    }
+
+    uint64_t count = 0;
+    size_t   pos   = proto_batch_begin(batch, len, &count);
+    CHECK(pos > 0 && count == OPS_LEN);
+
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t *f;
+        size_t         flen;
+        CHECK(proto_batch_next(batch, len, &pos, &f, &flen));
+        CHECK(proto_decode(f, flen, &op) && same_op(&ops[i], &op));
+    }
+    CHECK(pos == len);
+
+    // past the end, then cut inside the last frame
+    const uint8_t *f;
+    size_t         flen;
+    CHECK(!proto_batch_next(batch, len, &pos, &f, &flen));
+    CHECK(error_code() == 130);
+
+    pos = proto_batch_begin(batch, len - 1, &count);
+    for (size_t i = 0; i + 1 < count; ++i) {
+        CHECK(proto_batch_next(batch, len - 1, &pos, &f, &flen));
+    }
+    CHECK(!proto_batch_next(batch, len - 1, &pos, &f, &flen));
+    CHECK(error_code() == 130);
+
+    // a plain frame is not a batch, a batch is not a plain frame
+    len = encode(&ops[2], frame);
+    CHECK(proto_batch_begin(frame, len, &count) == 0);
+    CHECK(error_code() == 131);
+    CHECK(proto_batch_begin(batch, 1, &count) == 0);
+    CHECK(error_code() == 130);
+    CHECK(!proto_decode(batch, sizeof(batch), &op));
+    CHECK(error_code() == 131);
+}
+
+int main() {
+    test_round_trip();
+    test_varint();
+    test_truncated();
+    test_malformed();
+    test_batch();
+
+    if (failed) {
+        fprintf(stderr, "%d checks failed\n", failed);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,345 @@
+// nps_test_session: starts the server given as argument with the memory
+// backend and drives one websocket session through it: create a file, edit
+// it by offset and by row/column, move the cursor, then read it back. run
+// once writing every edit and once coalescing them. exits with 1 if a
+// command fails, the content read back differs or the server died
+//
+//   ctest --test-dir build -R session
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <libwebsockets.h>
+#include <json-c/json.h>
+
+#include <bool.h>
+#include <vec.h>
+#include <cmd.h>
+#include <ws.h>
+
+#define TEST_TIMEOUT (10 * LWS_US_PER_SEC)
+#define TEST_RETRY   (100 * LWS_US_PER_MS)
+
+// code points, the session counts in them
+#define TEST_CONTENT "h\xc3\xa9llo\n"
+#define TEST_EXPECT  "llo\nw\xc3\xb6rld!\n"
+
+static struct {
+    struct lws_context    *context;
+    lws_sorted_usec_list_t sul_connect, sul_timeout;
+
+    int         port;
+    struct lws *wsi;
+    vec_t      *v_write; // Vec<char *>, messages waiting for writeable
+
+    char  *rx; // current message, fragments appended
+    size_t rx_len;
+
+    char fid[21];
+    bool done;
+    bool failed;
+} t;
+
+static void test_fail(const char *what, const char *detail) {
+    fprintf(stderr, "%s: %s\n", what, detail ? detail : "");
+    t.failed = true;
+    t.done   = true;
+}
+
+static void test_send(const char *type, struct json_object *args) {
+    struct json_object *msg = json_object_new_object();
+    json_object_object_add(msg, "type", json_object_new_string(type));
+    json_object_object_add(msg, "args", args);
+
+    const char *str =
+        json_object_to_json_string_ext(msg, JSON_C_TO_STRING_PLAIN);
+
+    char *buf = malloc(LWS_PRE + strlen(str) + 1);
+    strcpy(buf + LWS_PRE, str);
+    vec_add(t.v_write, &buf);
+
+    json_object_put(msg);
+    lws_callback_on_writable(t.wsi);
+}
+
+// args of an edit of the file by the anonymous user, the event comes last
+static struct json_object *test_edit(int a, int b) {
+    struct json_object *args = json_object_new_array();
+    json_object_array_add(args, json_object_new_string(t.fid));
+    json_object_array_add(args, json_object_new_string("0"));
+    json_object_array_add(args, json_object_new_int(a));
+    json_object_array_add(args, json_object_new_int(b));
+    return args;
+}
+
+static struct json_object *test_event(struct json_object *args) {
+    json_object_array_add(args, json_object_new_object());
+    return args;
+}
+
+static void test_create() {
+    struct json_object *args = json_object_new_array();
+    json_object_array_add(args, json_object_new_string("0"));
+    json_object_array_add(args, json_object_new_int(3));
+    json_object_array_add(args, json_object_new_int(1));
+    json_object_array_add(args, json_object_new_string(TEST_CONTENT));
+    test_send(CMD_FILE_CREATE, args);
+}
+
+// every edit goes through the line and utf-8 indexes of the new file
+static void test_edits() {
+    struct json_object *args;
+
+    // "héllo\n" -> "héllo\nwörld\n"
+    args = test_edit(6, 6);
+    json_object_array_add(args, json_object_new_string("w\xc3\xb6rld\n"));
+    test_send(CMD_INSERT, test_event(args));
+
+    // -> "héllo\nwörld!\n"
+    args = test_edit(1, 5);
+    json_object_array_add(args, json_object_new_string("!"));
+    test_send(CMD_INSERT_AT, test_event(args));
+
+    args = json_object_new_array();
+    json_object_array_add(args, json_object_new_string(t.fid));
+    json_object_array_add(args, json_object_new_int(1));
+    json_object_array_add(args, json_object_new_int(3));
+    test_send(CMD_SET_USER_POINTER, args);
+
+    // -> "éllo\nwörld!\n"
+    args = test_edit(0, 0);
+    json_object_array_add(args, json_object_new_int(0));
+    json_object_array_add(args, json_object_new_int(1));
+    test_send(CMD_REMOVE_AT, test_event(args));
+
+    // -> "llo\nwörld!\n"
+    test_send(CMD_REMOVE, test_event(test_edit(0, 0)));
+
+    args = json_object_new_array();
+    json_object_array_add(args, json_object_new_string(t.fid));
+    json_object_array_add(args, json_object_new_boolean(false));
+    test_send(CMD_GET, args);
+}
+
+static void test_on_message(const char *str) {
+    struct json_object *msg = json_tokener_parse(str);
+    if (!msg) {
+        test_fail("invalid json", str);
+        return;
+    }
+
+    // a failed command answers {type: {"error": ...}}
+    json_object_object_foreach(msg, key, jval) {
+        struct json_object *err = NULL;
+        if (json_object_is_type(jval, json_type_object) &&
+            json_object_object_get_ex(jval, "error", &err)) {
+            test_fail(key, json_object_get_string(err));
+            goto __test_msg_drop;
+        }
+    }
+
+    struct json_object *val = NULL, *field = NULL;
+
+    if (json_object_object_get_ex(msg, CMD_FILE_CREATE, &val)) {
+        json_object_object_get_ex(val, "file_id", &field);
+        snprintf(t.fid, sizeof(t.fid), "%s", json_object_get_string(field));
+        test_edits();
+    } else if (json_object_object_get_ex(msg, CMD_GET, &val)) {
+        json_object_object_get_ex(val, "contents", &field);
+        json_object_object_get_ex(
+            json_object_array_get_idx(field, 0), "content", &field);
+
+        const char *content = json_object_get_string(field);
+        if (!content || strcmp(content, TEST_EXPECT) != 0) {
+            test_fail("unexpected content", content);
+        }
+        t.done = true;
+    }
+
+__test_msg_drop:
+    json_object_put(msg);
+}
+
+static void test_connect(lws_sorted_usec_list_t *sul) {
+    (void)sul;
+
+    struct lws_client_connect_info ci;
+    memset(&ci, 0, sizeof(ci));
+    ci.context  = t.context;
+    ci.address  = "127.0.0.1";
+    ci.port     = t.port;
+    ci.path     = "/?unit=cp";
+    ci.host     = ci.address;
+    ci.origin   = ci.address;
+    ci.protocol = MY_WS_PROTOCOL_NAME;
+    ci.pwsi     = &t.wsi;
+
+    if (!lws_client_connect_via_info(&ci)) test_fail("connect failed", NULL);
+}
+
+static void test_timeout(lws_sorted_usec_list_t *sul) {
+    (void)sul;
+    test_fail("timed out", NULL);
+}
+
+static int test_callback(struct lws *wsi, enum lws_callback_reasons reason,
+    void *user, void *in, size_t len) {
+    (void)user;
+
+    switch (reason) {
+        case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+            // the server may not listen yet
+            lws_sul_schedule(
+                t.context, 0, &t.sul_connect, test_connect, TEST_RETRY);
+            break;
+
+        case LWS_CALLBACK_CLIENT_ESTABLISHED:
+            test_create();
+            break;
+
+        case LWS_CALLBACK_CLIENT_RECEIVE:
+            t.rx = realloc(t.rx, t.rx_len + len + 1);
+            memcpy(t.rx + t.rx_len, in, len);
+            t.rx_len += len;
+
+            if (lws_is_final_fragment(wsi)) {
+                t.rx[t.rx_len] = '\0';
+                test_on_message(t.rx);
+                t.rx_len = 0;
+            }
+            break;
+
+        case LWS_CALLBACK_CLIENT_WRITEABLE: {
+            if (!t.v_write->len) break;
+
+            char *buf = vec_get_r(char *, t.v_write, 0);
+            int   n   = lws_write(wsi, (unsigned char *)buf + LWS_PRE,
+                  strlen(buf + LWS_PRE), LWS_WRITE_TEXT);
+            free(buf);
+            vec_remove(t.v_write, 0);
+
+            if (n < 0) return -1;
+            if (t.v_write->len) lws_callback_on_writable(wsi);
+            break;
+        }
+
+        case LWS_CALLBACK_CLIENT_CLOSED:
+            if (!t.done) test_fail("closed by server", NULL);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static struct lws_protocols protocols[] = {
+    {MY_WS_PROTOCOL_NAME, test_callback, 0, MY_PSS_SIZE, 0, NULL, 0},
+    LWS_PROTOCOL_LIST_TERM,
+};
+
+// a port nothing listens on, the kernel picks it
+static int test_free_port() {
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    socklen_t          len  = sizeof(addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    int port = -1;
+    if (bind(fd, (struct sockaddr *)&addr, len) == 0 &&
+        getsockname(fd, (struct sockaddr *)&addr, &len) == 0) {
+        port = ntohs(addr.sin_port);
+    }
+    close(fd);
+    return port;
+}
+
+// run the session against `server` started with EDIT_COALESCE_MS=`coalesce`
+static bool test_run(const char *server, const char *coalesce) {
+    char port_s[8];
+
+    memset(&t, 0, sizeof(t));
+    t.port = test_free_port();
+    if (t.port < 0) {
+        perror("socket");
+        return false;
+    }
+    sprintf(port_s, "%d", t.port);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        setenv("DB_BACKEND", "memory", 1);
+        setenv("PORT", port_s, 1);
+        setenv("EDIT_COALESCE_MS", coalesce, 1);
+        setenv("SECRET_KEY", "nps_test_session", 0);
+        execl(server, server, NULL);
+        perror(server);
+        _exit(127);
+    }
+
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof(info));
+    info.port      = CONTEXT_PORT_NO_LISTEN;
+    info.protocols = protocols;
+
+    t.v_write = vec_new_r(char *, NULL, NULL, NULL);
+    t.context = lws_create_context(&info);
+    if (!t.context) {
+        test_fail("lws init failed", NULL);
+    } else {
+        lws_sul_schedule(
+            t.context, 0, &t.sul_timeout, test_timeout, TEST_TIMEOUT);
+        lws_sul_schedule(t.context, 0, &t.sul_connect, test_connect, 1);
+
+        int n = 0;
+        while (n >= 0 && !t.done) n = lws_service(t.context, 0);
+
+        lws_context_destroy(t.context);
+    }
+
+    // a server that crashed is a failure even if the replies came through
+    int status = 0;
+    kill(pid, SIGINT);
+    waitpid(pid, &status, 0);
+    if (WIFSIGNALED(status) && WTERMSIG(status) != SIGINT) {
+        fprintf(stderr, "server killed by signal %d\n", WTERMSIG(status));
+        t.failed = true;
+    }
+
+    for (size_t i = 0; i < t.v_write->len; ++i) {
+        free(vec_get_r(char *, t.v_write, i));
+    }
+    vec_drop(t.v_write);
+    free(t.rx);
+
+    if (t.failed) fprintf(stderr, "EDIT_COALESCE_MS=%s failed\n", coalesce);
+    return !t.failed;
+}
+
+int main(int argc, const char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: nps_test_session <path to nps>\n");
+        return 1;
+    }
+
+    lws_set_log_level(LLL_ERR, NULL);
+
+    bool ok = test_run(argv[1], "0");
+    ok      = test_run(argv[1], "20") && ok;
+
+    if (!ok) return 1;
+    printf("ok\n");
+    return 0;
+}
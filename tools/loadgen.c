@@ -0,0 +1,683 @@
+// nps_loadgen: N websocket sessions editing M files of a running server
+//
+// every session subscribes to one file with `get` then sends a random mix of
+// insert/remove/set-user-pointer/save/get at a poisson rate. edits carry the
+// send time in their `event` arg (save in its content), which the server
+// echoes in the broadcast, so the other subscribers of the file measure the
+// send-to-broadcast latency. all sessions share one process and one
+// monotonic clock.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <libwebsockets.h>
+#include <json-c/json.h>
+
+#include <bool.h>
+#include <vec.h>
+#include <cmd.h>
+#include <ws.h>
+
+#define LG_TICK     (100 * LWS_US_PER_MS)
+#define LG_DRAIN_NS (2000000000lu) // wait for late broadcasts after the run
+#define LG_SAVE_TAG "nps_loadgen"
+
+typedef enum {
+    LG_OP_INSERT,
+    LG_OP_REMOVE,
+    LG_OP_CURSOR,
+    LG_OP_SAVE,
+    LG_OP_GET,
+    LG_OPS,
+} lg_op_t;
+
+static const char *lg_op_names[LG_OPS] = {
+    CMD_INSERT,
+    CMD_REMOVE,
+    CMD_SET_USER_POINTER,
+    CMD_SAVE,
+    CMD_GET,
+};
+
+typedef enum {
+    LG_LAT_EDIT, // insert/remove, seen by the other subscribers
+    LG_LAT_SAVE, // save, seen by the other subscribers
+    LG_LAT_GET,  // get, round trip
+    LG_LATS,
+} lg_lat_t;
+
+static const char *lg_lat_names[LG_LATS] = {"edit", "save", "get"};
+
+typedef enum {
+    LG_CONNECTING,
+    LG_CREATING, // waiting for create-file
+    LG_WAITING,  // waiting for the file to be created by another session
+    LG_OPENING,  // waiting for get
+    LG_RUNNING,
+    LG_CLOSED,
+} lg_state_t;
+
+struct lg_file {
+    uint64_t id; // 0 until created
+    size_t   len;
+};
+
+struct lg_session {
+    struct lws            *wsi;
+    lws_sorted_usec_list_t sul;
+
+    size_t     idx;
+    size_t     file; // index in lg.files
+    lg_state_t state;
+    unsigned   seed;
+
+    vec_t   *v_write;  // Vec<char *>, messages waiting for writeable
+    uint64_t get_sent; // ns of the outstanding get, 0 if none
+
+    char  *rx; // current message, fragments appended
+    size_t rx_len;
+};
+
+static struct {
+    struct lws_context *context;
+    lws_sorted_usec_list_t sul;
+
+    const char *host;
+    int         port;
+    const char *path;
+    const char *user_id;
+
+    size_t   n_sessions;
+    size_t   n_files;
+    double   rate; // ops per second per session
+    uint64_t duration_ns;
+    size_t   insert_len;
+    unsigned mix[LG_OPS]; // cumulative weights
+
+    struct lg_session *sessions;
+    struct lg_file    *files;
+
+    size_t   running;
+    uint64_t start_ns; // 0 until every session is running
+    uint64_t stop_ns;
+
+    uint64_t sent[LG_OPS];
+    uint64_t received; // broadcasts from other sessions
+    uint64_t errors;
+    uint64_t backlog_max; // longest per-session write queue
+    vec_t   *lats[LG_LATS]; // Vec<uint64_t>, ns
+} lg;
+
+static int interrupted = 0;
+
+static void sigint_handler() {
+    interrupted = 1;
+}
+
+static uint64_t lg_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool lg_measuring(uint64_t now) {
+    return lg.start_ns && now >= lg.start_ns && now < lg.stop_ns;
+}
+
+static void lg_lat_add(lg_lat_t lat, uint64_t sent_ns) {
+    uint64_t now = lg_now_ns();
+    if (!lg_measuring(sent_ns) || now < sent_ns) return;
+
+    uint64_t dt = now - sent_ns;
+    vec_add(lg.lats[lat], &dt);
+}
+
+// "insert:60,remove:20" -> cumulative weights, false if malformed
+static bool lg_parse_mix(const char *s, unsigned *mix) {
+    unsigned weights[LG_OPS] = {0};
+    char     buf[256], *save = NULL;
+
+    snprintf(buf, sizeof(buf), "%s", s);
+    for (char *tok = strtok_r(buf, ",", &save); tok;
+         tok       = strtok_r(NULL, ",", &save)) {
+        char *colon = strchr(tok, ':');
+        if (!colon) return false;
+        *colon = '\0';
+
+        int op = 0;
+        while (op < LG_OPS && strcmp(tok, lg_op_names[op])) ++op;
+        if (op == LG_OPS) return false;
+
+        weights[op] = atoi(colon + 1);
+    }
+
+    unsigned total = 0;
+    for (int op = 0; op < LG_OPS; ++op) {
+        total += weights[op];
+        mix[op] = total;
+    }
+    return total > 0;
+}
+
+static lg_op_t lg_pick_op(struct lg_session *s) {
+    unsigned r = rand_r(&s->seed) % lg.mix[LG_OPS - 1];
+
+    int op = 0;
+    while (r >= lg.mix[op]) ++op;
+    return op;
+}
+
+// exponential inter-arrival time for a poisson process of lg.rate
+static lws_usec_t lg_next_delay(struct lg_session *s) {
+    double u = (rand_r(&s->seed) + 1.0) / ((double)RAND_MAX + 2.0);
+    return -log(u) / lg.rate * LWS_US_PER_SEC;
+}
+
+static void lg_send(struct lg_session *s, struct json_object *msg) {
+    const char *str =
+        json_object_to_json_string_ext(msg, JSON_C_TO_STRING_PLAIN);
+
+    char *buf = malloc(LWS_PRE + strlen(str) + 1);
+    strcpy(buf + LWS_PRE, str);
+    vec_add(s->v_write, &buf);
+
+    if (s->v_write->len > lg.backlog_max) lg.backlog_max = s->v_write->len;
+
+    json_object_put(msg);
+    lws_callback_on_writable(s->wsi);
+}
+
+static struct json_object *lg_cmd(const char *type) {
+    struct json_object *msg = json_object_new_object();
+    json_object_object_add(msg, "type", json_object_new_string(type));
+    json_object_object_add(msg, "args", json_object_new_array());
+    return msg;
+}
+
+static struct json_object *lg_args(struct json_object *msg) {
+    struct json_object *args = NULL;
+    json_object_object_get_ex(msg, "args", &args);
+    return args;
+}
+
+static struct json_object *lg_file_id(struct lg_file *f) {
+    char fid[21];
+    sprintf(fid, "%lu", f->id);
+    return json_object_new_string(fid);
+}
+
+static void lg_send_get(struct lg_session *s) {
+    struct json_object *msg  = lg_cmd(CMD_GET);
+    struct json_object *args = lg_args(msg);
+
+    json_object_array_add(args, lg_file_id(&lg.files[s->file]));
+    json_object_array_add(args, json_object_new_boolean(false));
+
+    s->get_sent = lg_now_ns();
+    lg_send(s, msg);
+}
+
+static void lg_send_op(struct lg_session *s, lg_op_t op) {
+    struct lg_file *f   = &lg.files[s->file];
+    uint64_t        now = lg_now_ns();
+
+    if (op == LG_OP_REMOVE && f->len == 0) op = LG_OP_INSERT;
+    if (op == LG_OP_GET && s->get_sent) op = LG_OP_CURSOR;
+
+    ++lg.sent[op];
+    if (op == LG_OP_GET) {
+        lg_send_get(s);
+        return;
+    }
+
+    struct json_object *msg  = lg_cmd(lg_op_names[op]);
+    struct json_object *args = lg_args(msg);
+    json_object_array_add(args, lg_file_id(f));
+
+    if (op == LG_OP_CURSOR) {
+        json_object_array_add(
+            args, json_object_new_int(rand_r(&s->seed) % 100));
+        json_object_array_add(
+            args, json_object_new_int(rand_r(&s->seed) % 80));
+    } else if (op == LG_OP_SAVE) {
+        // keep the document about the same size, the header carries the time
+        char  *content = malloc(f->len + 64);
+        size_t len = sprintf(content, LG_SAVE_TAG " %lu\n", now);
+        for (; len < f->len; ++len) content[len] = 'a' + len % 26;
+        content[len] = '\0';
+
+        json_object_array_add(args, json_object_new_string(lg.user_id));
+        json_object_array_add(args, json_object_new_string(content));
+        f->len = len;
+        free(content);
+    } else {
+        int from = rand_r(&s->seed) % (f->len + (op == LG_OP_INSERT));
+        json_object_array_add(args, json_object_new_string(lg.user_id));
+        json_object_array_add(args, json_object_new_int(from));
+        json_object_array_add(args, json_object_new_int(from));
+
+        if (op == LG_OP_INSERT) {
+            char string[64];
+            for (size_t i = 0; i < lg.insert_len; ++i) {
+                string[i] = 'a' + rand_r(&s->seed) % 26;
+            }
+            string[lg.insert_len] = '\0';
+
+            json_object_array_add(args, json_object_new_string(string));
+            f->len += lg.insert_len;
+        } else {
+            f->len -= 1;
+        }
+
+        struct json_object *event = json_object_new_object();
+        json_object_object_add(event, "s", json_object_new_int(s->idx));
+        json_object_object_add(event, "t", json_object_new_int64(now));
+        json_object_array_add(args, event);
+    }
+
+    lg_send(s, msg);
+}
+
+static void lg_tick(lws_sorted_usec_list_t *sul) {
+    struct lg_session *s   = lws_container_of(sul, struct lg_session, sul);
+    uint64_t           now = lg_now_ns();
+
+    if (s->state == LG_WAITING && lg.files[s->file].id) {
+        s->state = LG_OPENING;
+        lg_send_get(s);
+        return;
+    }
+
+    if (s->state == LG_RUNNING && lg.start_ns && now < lg.stop_ns) {
+        lg_send_op(s, lg_pick_op(s));
+    }
+
+    if (s->state == LG_WAITING || s->state == LG_RUNNING) {
+        lws_usec_t delay = s->state == LG_WAITING ? LG_TICK : lg_next_delay(s);
+        lws_sul_schedule(lg.context, 0, &s->sul, lg_tick, delay);
+    }
+}
+
+static void lg_on_open(struct lg_session *s) {
+    struct lg_file *f = &lg.files[s->file];
+
+    if (f->id) {
+        s->state = LG_OPENING;
+        lg_send_get(s);
+    } else if (s->idx == s->file) {
+        struct json_object *msg  = lg_cmd(CMD_FILE_CREATE);
+        struct json_object *args = lg_args(msg);
+
+        json_object_array_add(args, json_object_new_string(lg.user_id));
+        json_object_array_add(args, json_object_new_int(3));
+        json_object_array_add(args, json_object_new_int(1));
+        json_object_array_add(args, json_object_new_string(""));
+
+        s->state = LG_CREATING;
+        lg_send(s, msg);
+    } else {
+        s->state = LG_WAITING;
+        lg_tick(&s->sul);
+    }
+}
+
+static void lg_on_message(struct lg_session *s, const char *str) {
+    struct json_object *msg = json_tokener_parse(str);
+    if (!msg) {
+        ++lg.errors;
+        return;
+    }
+
+    struct json_object *val = NULL, *err = NULL;
+
+    if (json_object_object_get_ex(msg, "error", NULL)) {
+        ++lg.errors;
+        goto __lg_msg_drop;
+    }
+
+    for (int op = 0; op < LG_OPS; ++op) {
+        if (json_object_object_get_ex(msg, lg_op_names[op], &val)) break;
+        val = NULL;
+    }
+    if (!val && !json_object_object_get_ex(msg, CMD_FILE_CREATE, &val)) {
+        goto __lg_msg_drop;
+    }
+
+    if (json_object_object_get_ex(val, "error", &err)) {
+        fprintf(stderr, "session %lu: %s\n", s->idx,
+            json_object_get_string(err));
+        ++lg.errors;
+        if (s->state != LG_RUNNING) interrupted = 1;
+        goto __lg_msg_drop;
+    }
+
+    struct json_object *field = NULL;
+
+    if (json_object_object_get_ex(msg, CMD_FILE_CREATE, NULL)) {
+        json_object_object_get_ex(val, "file_id", &field);
+        lg.files[s->file].id = atol(json_object_get_string(field));
+
+        s->state = LG_OPENING;
+        lg_send_get(s);
+    } else if (json_object_object_get_ex(msg, CMD_GET, NULL)) {
+        if (s->get_sent) lg_lat_add(LG_LAT_GET, s->get_sent);
+        s->get_sent = 0;
+
+        if (s->state == LG_OPENING) {
+            json_object_object_get_ex(val, "contents", &field);
+            json_object_object_get_ex(
+                json_object_array_get_idx(field, 0), "content", &field);
+            lg.files[s->file].len = json_object_get_string_len(field);
+
+            s->state = LG_RUNNING;
+            ++lg.running;
+            lg_tick(&s->sul);
+        }
+    } else if (json_object_object_get_ex(msg, CMD_SAVE, NULL)) {
+        ++lg.received;
+
+        uint64_t sent_ns = 0;
+        json_object_object_get_ex(val, "content", &field);
+        if (sscanf(json_object_get_string(field), LG_SAVE_TAG " %lu",
+                &sent_ns) == 1) {
+            lg_lat_add(LG_LAT_SAVE, sent_ns);
+        }
+    } else if (json_object_object_get_ex(msg, CMD_INSERT, NULL) ||
+               json_object_object_get_ex(msg, CMD_REMOVE, NULL)) {
+        ++lg.received;
+
+        struct json_object *event = NULL;
+        json_object_object_get_ex(msg, "event", &event);
+        if (json_object_object_get_ex(event, "t", &field)) {
+            lg_lat_add(LG_LAT_EDIT, json_object_get_int64(field));
+        }
+    } else if (json_object_object_get_ex(msg, CMD_SET_USER_POINTER, NULL)) {
+        ++lg.received;
+    }
+
+__lg_msg_drop:
+    json_object_put(msg);
+}
+
+static int lg_callback(struct lws *wsi, enum lws_callback_reasons reason,
+    void *user, void *in, size_t len) {
+    struct lg_session *s = user;
+
+    switch (reason) {
+        case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+            fprintf(stderr, "session %lu: connection error: %s\n", s->idx,
+                in ? (char *)in : "");
+            s->state = LG_CLOSED;
+            interrupted = 1;
+            break;
+
+        case LWS_CALLBACK_CLIENT_ESTABLISHED:
+            lg_on_open(s);
+            break;
+
+        case LWS_CALLBACK_CLIENT_RECEIVE:
+            s->rx = realloc(s->rx, s->rx_len + len + 1);
+            memcpy(s->rx + s->rx_len, in, len);
+            s->rx_len += len;
+
+            if (lws_is_final_fragment(wsi)) {
+                s->rx[s->rx_len] = '\0';
+                lg_on_message(s, s->rx);
+                s->rx_len = 0;
+            }
+            break;
+
+        case LWS_CALLBACK_CLIENT_WRITEABLE: {
+            if (!s->v_write->len) break;
+
+            char *buf = vec_get_r(char *, s->v_write, 0);
+            int   n   = lws_write(wsi, (unsigned char *)buf + LWS_PRE,
+                  strlen(buf + LWS_PRE), LWS_WRITE_TEXT);
+            free(buf);
+            vec_remove(s->v_write, 0);
+
+            if (n < 0) return -1;
+            if (s->v_write->len) lws_callback_on_writable(wsi);
+            break;
+        }
+
+        case LWS_CALLBACK_CLIENT_CLOSED:
+            if (s->state != LG_CLOSED && lg_now_ns() < lg.stop_ns) {
+                fprintf(stderr, "session %lu: closed by server\n", s->idx);
+                ++lg.errors;
+            }
+            s->state = LG_CLOSED;
+            lws_sul_cancel(&s->sul);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static struct lws_protocols protocols[] = {
+    {MY_WS_PROTOCOL_NAME, lg_callback, 0, MY_PSS_SIZE, 0, NULL, 0},
+    LWS_PROTOCOL_LIST_TERM,
+};
+
+static int lg_u64_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double lg_percentile(vec_t *lats, double p) {
+    if (!lats->len) return 0;
+
+    size_t idx = p * (lats->len - 1) + 0.5;
+    return vec_get_r(uint64_t, lats, idx) / 1e6;
+}
+
+static void lg_report() {
+    double secs = lg.duration_ns / 1e9;
+
+    uint64_t total = 0;
+    for (int op = 0; op < LG_OPS; ++op) total += lg.sent[op];
+
+    printf("sessions %lu, files %lu, %.1fs\n", lg.n_sessions, lg.n_files, secs);
+    printf("sent     %lu ops, %.1f ops/s (", total, total / secs);
+    for (int op = 0; op < LG_OPS; ++op) {
+        printf("%s%s %lu", op ? ", " : "", lg_op_names[op], lg.sent[op]);
+    }
+    printf(")\n");
+    printf("received %lu broadcasts, %.1f msgs/s\n", lg.received,
+        lg.received / secs);
+    printf("errors   %lu, max write queue %lu\n\n", lg.errors, lg.backlog_max);
+
+    printf("%-8s %10s %10s %10s %10s %10s (ms)\n", "latency", "count", "p50",
+        "p99", "p999", "max");
+    for (int l = 0; l < LG_LATS; ++l) {
+        vec_t *lats = lg.lats[l];
+        qsort(lats->arr, lats->len, sizeof(uint64_t), lg_u64_cmp);
+
+        printf("%-8s %10lu %10.3f %10.3f %10.3f %10.3f\n", lg_lat_names[l],
+            lats->len, lg_percentile(lats, 0.5), lg_percentile(lats, 0.99),
+            lg_percentile(lats, 0.999), lg_percentile(lats, 1));
+    }
+}
+
+// start the run once every session is subscribed, stop after the duration
+static void lg_control(lws_sorted_usec_list_t *sul) {
+    uint64_t now = lg_now_ns();
+
+    if (!lg.start_ns && lg.running == lg.n_sessions) {
+        lg.start_ns = now;
+        lg.stop_ns  = now + lg.duration_ns;
+        printf("%lu sessions running\n", lg.running);
+    }
+
+    if (lg.start_ns && now >= lg.stop_ns + LG_DRAIN_NS) {
+        interrupted = 1;
+        return;
+    }
+
+    lws_sul_schedule(lg.context, 0, sul, lg_control, LG_TICK);
+}
+
+static const char *lg_usage =
+    "usage: nps_loadgen [options]\n"
+    "  -h host      server host (localhost)\n"
+    "  -p port      server port (8080)\n"
+    "  -n sessions  websocket sessions (10)\n"
+    "  -m files     files created and shared by the sessions (1)\n"
+    "  -f id,...    use existing files instead of creating them\n"
+    "  -u user_id   user editing the files, owner of created files (0)\n"
+    "  -t token     jwt sent on connect\n"
+    "  -r rate      ops per second per session (5)\n"
+    "  -d seconds   measured duration (30)\n"
+    "  -l bytes     bytes per insert (1)\n"
+    "  -x mix       op weights (insert:60,remove:20,set-user-pointer:15,"
+    "save:3,get:2)\n";
+
+int main(int argc, const char **argv) {
+    const char *opt;
+
+    if (lws_cmdline_option(argc, argv, "--help")) {
+        fputs(lg_usage, stdout);
+        return 0;
+    }
+
+    lg.host        = "localhost";
+    lg.port        = 8080;
+    lg.user_id     = "0";
+    lg.n_sessions  = 10;
+    lg.n_files     = 1;
+    lg.rate        = 5;
+    lg.duration_ns = 30 * 1000000000lu;
+    lg.insert_len  = 1;
+
+    if ((opt = lws_cmdline_option(argc, argv, "-h"))) lg.host = opt;
+    if ((opt = lws_cmdline_option(argc, argv, "-p"))) lg.port = atoi(opt);
+    if ((opt = lws_cmdline_option(argc, argv, "-n"))) lg.n_sessions = atol(opt);
+    if ((opt = lws_cmdline_option(argc, argv, "-m"))) lg.n_files = atol(opt);
+    if ((opt = lws_cmdline_option(argc, argv, "-u"))) lg.user_id = opt;
+    if ((opt = lws_cmdline_option(argc, argv, "-r"))) lg.rate = atof(opt);
+    if ((opt = lws_cmdline_option(argc, argv, "-d"))) {
+        lg.duration_ns = atof(opt) * 1e9;
+    }
+    if ((opt = lws_cmdline_option(argc, argv, "-l"))) {
+        lg.insert_len = atol(opt);
+    }
+
+    opt = lws_cmdline_option(argc, argv, "-x");
+    if (!lg_parse_mix(
+            opt ? opt : "insert:60,remove:20,set-user-pointer:15,save:3,get:2",
+            lg.mix)) {
+        fprintf(stderr, "invalid op mix\n%s", lg_usage);
+        return 1;
+    }
+
+    const char *file_ids = lws_cmdline_option(argc, argv, "-f");
+    if (file_ids) {
+        lg.n_files = 1;
+        for (const char *c = file_ids; *c; ++c) lg.n_files += *c == ',';
+    }
+
+    if (!lg.n_sessions || !lg.n_files || lg.n_files > lg.n_sessions ||
+        lg.rate <= 0 || !lg.insert_len || lg.insert_len >= 64) {
+        fprintf(stderr, "invalid options\n%s", lg_usage);
+        return 1;
+    }
+
+    lg.files    = calloc(lg.n_files, sizeof(struct lg_file));
+    lg.sessions = calloc(lg.n_sessions, sizeof(struct lg_session));
+    for (int l = 0; l < LG_LATS; ++l) {
+        lg.lats[l] = vec_new_r(uint64_t, NULL, NULL, NULL);
+    }
+
+    if (file_ids) {
+        const char *c = file_ids;
+        for (size_t i = 0; i < lg.n_files; ++i) {
+            lg.files[i].id = strtoull(c, (char **)&c, 10);
+            if (*c == ',') ++c;
+        }
+    }
+
+    char path[1100] = "/";
+    if ((opt = lws_cmdline_option(argc, argv, "-t"))) {
+        snprintf(path, sizeof(path), "/?token=%s", opt);
+    }
+    lg.path = path;
+
+    signal(SIGINT, sigint_handler);
+    lws_set_log_level(LLL_ERR | LLL_WARN, NULL);
+
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof(info));
+    info.port      = CONTEXT_PORT_NO_LISTEN;
+    info.protocols = protocols;
+
+    lg.context = lws_create_context(&info);
+    if (!lg.context) {
+        fprintf(stderr, "lws init failed\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < lg.n_sessions; ++i) {
+        struct lg_session *s = &lg.sessions[i];
+
+        s->idx     = i;
+        s->file    = i % lg.n_files;
+        s->seed    = i * 2654435761u ^ time(NULL);
+        s->state   = LG_CONNECTING;
+        s->v_write = vec_new_r(char *, NULL, NULL, NULL);
+
+        struct lws_client_connect_info ci;
+        memset(&ci, 0, sizeof(ci));
+        ci.context  = lg.context;
+        ci.address  = lg.host;
+        ci.port     = lg.port;
+        ci.path     = lg.path;
+        ci.host     = lg.host;
+        ci.origin   = lg.host;
+        ci.protocol = MY_WS_PROTOCOL_NAME;
+        ci.userdata = s;
+        ci.pwsi     = &s->wsi;
+
+        if (!lws_client_connect_via_info(&ci)) {
+            fprintf(stderr, "session %lu: connect failed\n", i);
+            interrupted = 1;
+            break;
+        }
+    }
+
+    lg_control(&lg.sul);
+
+    int n = 0;
+    while (n >= 0 && !interrupted) {
+        n = lws_service(lg.context, 0);
+    }
+
+    if (lg.start_ns) {
+        lg_report();
+    } else {
+        fprintf(stderr, "only %lu of %lu sessions got running\n", lg.running,
+            lg.n_sessions);
+    }
+
+    lws_context_destroy(lg.context);
+
+    for (size_t i = 0; i < lg.n_sessions; ++i) {
+        vec_t *v_write = lg.sessions[i].v_write;
+        for (size_t j = 0; v_write && j < v_write->len; ++j) {
+            free(vec_get_r(char *, v_write, j));
+        }
+        if (v_write) vec_drop(v_write);
+        free(lg.sessions[i].rx);
+    }
+    for (int l = 0; l < LG_LATS; ++l) vec_drop(lg.lats[l]);
+    free(lg.sessions);
+    free(lg.files);
+
+    return lg.start_ns && !lg.errors ? 0 : 1;
+}
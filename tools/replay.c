@@ -0,0 +1,697 @@
+// nps_replay: replay a traffic capture (CAPTURE_FILE) against a server
+//
+// every captured session is reconnected with its recorded uri and sends its
+// recorded frames at the recorded times, scaled by `-s`, or back to back with
+// `-s 0`. the event arg of json insert/remove is replaced by a sequence number
+// so the broadcasts seen by the other sessions give the edit latency; replies
+// to request commands give the round trip latency. the summary can be written
+// as json and compared against a previous one to catch regressions.
+//
+// the server must start from the same storage snapshot as when the capture
+// was taken, ids created during the capture (create-file) are not remapped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <libwebsockets.h>
+#include <json-c/json.h>
+
+#include <bool.h>
+#include <vec.h>
+#include <cmd.h>
+#include <ws.h>
+#include <capture.h>
+
+#define RP_TICK     (100 * LWS_US_PER_MS)
+#define RP_DRAIN_NS (2000000000lu) // wait for late replies after the run
+
+typedef enum {
+    RP_LAT_REPLY, // request commands, round trip
+    RP_LAT_EDIT,  // insert/remove, seen by the other sessions
+    RP_LATS,
+} rp_lat_t;
+
+static const char *rp_lat_names[RP_LATS] = {"reply", "edit"};
+
+// commands answered to the sender only, with their reply key
+static const char *rp_replies[][2] = {
+    {CMD_GET,            CMD_GET           },
+    {CMD_GET_FILE_TYPES, CMD_GET_FILE_TYPES},
+    {CMD_GET_PER_TYPES,  CMD_GET_PER_TYPES },
+    {CMD_GET_USER_PERS,  CMD_GET_USER_PERS },
+    {CMD_GET_FILE_PERS,  CMD_GET_FILE_PERS },
+    {CMD_SET_FILE_PER,   CMD_SET_FILE_PER  },
+    {CMD_SET_USER_PER,   CMD_SET_USER_PER  },
+    {CMD_FILE_CREATE,    CMD_FILE_CREATE   },
+    {CMD_FILE_DELETE,    CMD_FILE_DELETE   },
+    {CMD_LOGIN,          "accept"          },
+};
+
+#define RP_REPLIES (sizeof(rp_replies) / sizeof(rp_replies[0]))
+
+typedef enum {
+    RP_PENDING, // not connected yet
+    RP_CONNECTING,
+    RP_RUNNING,
+    RP_CLOSING, // every frame written
+    RP_CLOSED,
+} rp_state_t;
+
+struct rp_frame {
+    uint64_t ts_us;
+    bool     is_bin;
+    char    *data;
+    size_t   len;
+};
+
+struct rp_pending {
+    const char *key; // expected reply key
+    uint64_t    sent_ns;
+};
+
+struct rp_session {
+    struct lws            *wsi;
+    lws_sorted_usec_list_t sul;
+
+    uint32_t   id; // capture session id
+    rp_state_t state;
+    char      *uri;
+    uint64_t   open_us;
+    uint64_t   close_us; // 0 if the capture ended with the session open
+
+    vec_t *v_frames;  // Vec<struct rp_frame>
+    size_t next;      // next frame to send
+    bool   due;       // frames[next] is due, waiting for writeable
+    vec_t *v_pending; // Vec<struct rp_pending>, fifo of unanswered requests
+
+    char  *rx; // current message, fragments appended
+    size_t rx_len;
+};
+
+static struct {
+    struct lws_context *context;
+    lws_sorted_usec_list_t sul;
+
+    const char *host;
+    int         port;
+    double      speed; // 0: as fast as possible
+
+    vec_t *v_sessions; // Vec<struct rp_session *>, by capture order
+    size_t n_frames;   // captured frames
+
+    size_t   closed;
+    uint64_t start_ns;
+    uint64_t end_ns; // last session closed, 0 until then
+
+    uint64_t sent;
+    uint64_t received;
+    uint64_t errors;
+    vec_t   *v_edits;      // Vec<uint64_t>, send ns by edit sequence
+    vec_t   *lats[RP_LATS]; // Vec<uint64_t>, ns
+} rp;
+
+static int interrupted = 0;
+
+static void sigint_handler() {
+    interrupted = 1;
+}
+
+static uint64_t rp_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// delay until the capture time `ts_us` on the replay clock
+static lws_usec_t rp_delay(uint64_t ts_us) {
+    if (rp.speed <= 0) return 0;
+
+    uint64_t at  = rp.start_ns + ts_us * 1000 / rp.speed;
+    uint64_t now = rp_now_ns();
+    return at > now ? (at - now) / 1000 : 0;
+}
+
+static void rp_lat_add(rp_lat_t lat, uint64_t sent_ns) {
+    uint64_t now = rp_now_ns();
+    if (now < sent_ns) return;
+
+    uint64_t dt = now - sent_ns;
+    vec_add(rp.lats[lat], &dt);
+}
+
+static struct rp_session *rp_session_get(uint32_t id) {
+    for (size_t i = rp.v_sessions->len; i-- > 0;) {
+        struct rp_session *s = vec_get_r(struct rp_session *, rp.v_sessions, i);
+        if (s->id == id) return s;
+    }
+    return NULL;
+}
+
+// [E]: load every session and frame of the capture at `path`
+static bool rp_load(const char *path) {
+    capture_reader_t *reader = capture_reader_open(path);
+    if (!reader) return false;
+
+    capture_record_t   rec;
+    struct rp_session *s = NULL;
+    int                n;
+
+    while ((n = capture_read(reader, &rec)) > 0) {
+        if (rec.type == CAPTURE_OPEN) {
+            s           = calloc(1, sizeof(struct rp_session));
+            s->id       = rec.session;
+            s->state    = RP_PENDING;
+            s->uri      = strdup(rec.data);
+            s->open_us  = rec.ts_us;
+            s->v_frames = vec_new_r(struct rp_frame, NULL, NULL, NULL);
+            s->v_pending = vec_new_r(struct rp_pending, NULL, NULL, NULL);
+            vec_add(rp.v_sessions, &s);
+            continue;
+        }
+
+        // records of sessions opened before the capture started are dropped
+        if (!(s = rp_session_get(rec.session))) continue;
+
+        if (rec.type == CAPTURE_CLOSE) {
+            s->close_us = rec.ts_us;
+        } else if (rec.type == CAPTURE_FRAME) {
+            struct rp_frame f = {
+                .ts_us  = rec.ts_us,
+                .is_bin = rec.is_bin,
+                .data   = malloc(LWS_PRE + rec.len + 1),
+                .len    = rec.len,
+            };
+            memcpy(f.data + LWS_PRE, rec.data, rec.len + 1);
+            vec_add(s->v_frames, &f);
+            ++rp.n_frames;
+        }
+    }
+
+    capture_reader_close(reader);
+    return n == 0;
+}
+
+// rewrite a json frame before sending: tag edits with their sequence number
+// and remember requests waiting for a reply
+static void rp_prepare(struct rp_session *s, struct rp_frame *f) {
+    struct json_object *msg = json_tokener_parse(f->data + LWS_PRE);
+    struct json_object *val = NULL, *args = NULL;
+    if (!msg) return;
+
+    if (!json_object_object_get_ex(msg, "type", &val) ||
+        !json_object_object_get_ex(msg, "args", &args)) {
+        goto __rp_prepare_drop;
+    }
+
+    const char *type = json_object_get_string(val);
+    uint64_t    now  = rp_now_ns();
+
+    for (size_t i = 0; i < RP_REPLIES; ++i) {
+        if (!CMD_IS_TYPE_OF(type, rp_replies[i][0])) continue;
+
+        struct rp_pending p = {rp_replies[i][1], now};
+        vec_add(s->v_pending, &p);
+        goto __rp_prepare_drop;
+    }
+
+    // the event arg follows the fixed args of insert/remove
+    int idx = CMD_IS_TYPE_OF(type, CMD_INSERT)   ? 5
+            : CMD_IS_TYPE_OF(type, CMD_REMOVE) ? 4
+                                               : -1;
+    if (idx < 0 || json_object_array_length(args) < (size_t)idx) {
+        goto __rp_prepare_drop;
+    }
+
+    struct json_object *event = json_object_new_object();
+    json_object_object_add(event, "r", json_object_new_int64(rp.v_edits->len));
+    json_object_array_put_idx(args, idx, event);
+    vec_add(rp.v_edits, &now);
+
+    const char *str =
+        json_object_to_json_string_ext(msg, JSON_C_TO_STRING_PLAIN);
+    f->len  = strlen(str);
+    f->data = realloc(f->data, LWS_PRE + f->len + 1);
+    memcpy(f->data + LWS_PRE, str, f->len + 1);
+
+__rp_prepare_drop:
+    json_object_put(msg);
+}
+
+static void rp_connect(lws_sorted_usec_list_t *sul) {
+    struct rp_session *s = lws_container_of(sul, struct rp_session, sul);
+
+    struct lws_client_connect_info ci;
+    memset(&ci, 0, sizeof(ci));
+    ci.context  = rp.context;
+    ci.address  = rp.host;
+    ci.port     = rp.port;
+    ci.path     = s->uri;
+    ci.host     = rp.host;
+    ci.origin   = rp.host;
+    ci.protocol = MY_WS_PROTOCOL_NAME;
+    ci.userdata = s;
+    ci.pwsi     = &s->wsi;
+
+    s->state = RP_CONNECTING;
+    if (!lws_client_connect_via_info(&ci)) {
+        fprintf(stderr, "session %u: connect failed\n", s->id);
+        s->state = RP_CLOSED;
+        ++rp.closed;
+        ++rp.errors;
+    }
+}
+
+// ask for writeable once the next frame, or the close, is due
+static void rp_tick(lws_sorted_usec_list_t *sul) {
+    struct rp_session *s = lws_container_of(sul, struct rp_session, sul);
+
+    if (s->state != RP_RUNNING && s->state != RP_CLOSING) return;
+
+    uint64_t ts_us;
+    if (s->next < s->v_frames->len) {
+        ts_us = vec_get_r(struct rp_frame, s->v_frames, s->next).ts_us;
+    } else if (s->close_us) {
+        ts_us = s->close_us;
+    } else {
+        return; // left open until the end of the run
+    }
+
+    lws_usec_t delay = rp_delay(ts_us);
+    if (delay) {
+        lws_sul_schedule(rp.context, 0, &s->sul, rp_tick, delay);
+        return;
+    }
+
+    s->due = true;
+    lws_callback_on_writable(s->wsi);
+}
+
+static void rp_on_message(struct rp_session *s, const char *str) {
+    ++rp.received;
+
+    struct json_object *msg = json_tokener_parse(str);
+    if (!msg) {
+        ++rp.errors;
+        return;
+    }
+
+    struct json_object *val = NULL, *field = NULL;
+
+    if (json_object_object_get_ex(msg, "error", NULL)) {
+        ++rp.errors;
+        goto __rp_msg_drop;
+    }
+
+    if (s->v_pending->len) {
+        struct rp_pending *p = vec_get(s->v_pending, 0);
+        if (json_object_object_get_ex(msg, p->key, &val)) {
+            rp_lat_add(RP_LAT_REPLY, p->sent_ns);
+            vec_remove(s->v_pending, 0);
+            if (json_object_object_get_ex(val, "error", NULL)) ++rp.errors;
+            goto __rp_msg_drop;
+        }
+    }
+
+    if (json_object_object_get_ex(msg, CMD_INSERT, &val) ||
+        json_object_object_get_ex(msg, CMD_REMOVE, &val)) {
+        if (json_object_object_get_ex(val, "error", NULL)) {
+            ++rp.errors;
+            goto __rp_msg_drop;
+        }
+
+        struct json_object *event = NULL;
+        json_object_object_get_ex(msg, "event", &event);
+        if (json_object_object_get_ex(event, "r", &field)) {
+            size_t seq = json_object_get_int64(field);
+            if (seq < rp.v_edits->len) {
+                rp_lat_add(RP_LAT_EDIT, vec_get_r(uint64_t, rp.v_edits, seq));
+            }
+        }
+    } else if (json_object_object_get_ex(msg, CMD_SAVE, &val) ||
+               json_object_object_get_ex(msg, CMD_SET_USER_POINTER, &val)) {
+        if (json_object_object_get_ex(val, "error", NULL)) ++rp.errors;
+    }
+
+__rp_msg_drop:
+    json_object_put(msg);
+}
+
+static void rp_on_closed(struct rp_session *s) {
+    if (s->state == RP_CLOSED) return;
+
+    if (s->state != RP_CLOSING) {
+        fprintf(stderr, "session %u: closed by server\n", s->id);
+        ++rp.errors;
+    }
+    s->state = RP_CLOSED;
+    lws_sul_cancel(&s->sul);
+
+    if (++rp.closed == rp.v_sessions->len) rp.end_ns = rp_now_ns();
+}
+
+static int rp_callback(struct lws *wsi, enum lws_callback_reasons reason,
+    void *user, void *in, size_t len) {
+    struct rp_session *s = user;
+
+    switch (reason) {
+        case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+            fprintf(stderr, "session %u: connection error: %s\n", s->id,
+                in ? (char *)in : "");
+            s->state = RP_CLOSING;
+            ++rp.errors;
+            rp_on_closed(s);
+            break;
+
+        case LWS_CALLBACK_CLIENT_ESTABLISHED:
+            s->state = RP_RUNNING;
+            rp_tick(&s->sul);
+            break;
+
+        case LWS_CALLBACK_CLIENT_RECEIVE:
+            if (lws_frame_is_binary(wsi)) {
+                if (lws_is_final_fragment(wsi)) ++rp.received;
+                break;
+            }
+
+            s->rx = realloc(s->rx, s->rx_len + len + 1);
+            memcpy(s->rx + s->rx_len, in, len);
+            s->rx_len += len;
+
+            if (lws_is_final_fragment(wsi)) {
+                s->rx[s->rx_len] = '\0';
+                rp_on_message(s, s->rx);
+                s->rx_len = 0;
+            }
+            break;
+
+        case LWS_CALLBACK_CLIENT_WRITEABLE: {
+            if (!s->due) break;
+            s->due = false;
+
+            if (s->next == s->v_frames->len) {
+                s->state = RP_CLOSING;
+                lws_close_reason(wsi, LWS_CLOSE_STATUS_NORMAL, NULL, 0);
+                return -1;
+            }
+
+            struct rp_frame *f = vec_get(s->v_frames, s->next++);
+            if (!f->is_bin) rp_prepare(s, f);
+
+            int n = lws_write(wsi, (unsigned char *)f->data + LWS_PRE, f->len,
+                f->is_bin ? LWS_WRITE_BINARY : LWS_WRITE_TEXT);
+            if (n < 0) return -1;
+
+            ++rp.sent;
+            rp_tick(&s->sul);
+            break;
+        }
+
+        case LWS_CALLBACK_CLIENT_CLOSED:
+            rp_on_closed(s);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static struct lws_protocols protocols[] = {
+    {MY_WS_PROTOCOL_NAME, rp_callback, 0, MY_PSS_SIZE, 0, NULL, 0},
+    LWS_PROTOCOL_LIST_TERM,
+};
+
+// stop once every session is closed and late replies had time to arrive,
+// or once every frame is sent if some sessions were left open
+static void rp_control(lws_sorted_usec_list_t *sul) {
+    uint64_t now = rp_now_ns();
+
+    if (!rp.end_ns && rp.sent == rp.n_frames) {
+        bool open_left = false;
+        for (size_t i = 0; i < rp.v_sessions->len; ++i) {
+            struct rp_session *s =
+                vec_get_r(struct rp_session *, rp.v_sessions, i);
+            if (s->state != RP_CLOSED && !s->close_us) open_left = true;
+        }
+        if (open_left) rp.end_ns = now;
+    }
+
+    if (rp.end_ns && now >= rp.end_ns + RP_DRAIN_NS) {
+        interrupted = 1;
+        return;
+    }
+
+    lws_sul_schedule(rp.context, 0, sul, rp_control, RP_TICK);
+}
+
+static int rp_u64_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double rp_percentile(vec_t *lats, double p) {
+    if (!lats->len) return 0;
+
+    size_t idx = p * (lats->len - 1) + 0.5;
+    return vec_get_r(uint64_t, lats, idx) / 1e6;
+}
+
+static struct json_object *rp_summary() {
+    uint64_t end  = rp.end_ns ? rp.end_ns : rp_now_ns();
+    double   secs = (end - rp.start_ns) / 1e9;
+
+    struct json_object *sum = json_object_new_object();
+    json_object_object_add(
+        sum, "sessions", json_object_new_int64(rp.v_sessions->len));
+    json_object_object_add(sum, "speed", json_object_new_double(rp.speed));
+    json_object_object_add(sum, "seconds", json_object_new_double(secs));
+    json_object_object_add(sum, "sent", json_object_new_int64(rp.sent));
+    json_object_object_add(
+        sum, "received", json_object_new_int64(rp.received));
+    json_object_object_add(sum, "errors", json_object_new_int64(rp.errors));
+    json_object_object_add(
+        sum, "sent_per_s", json_object_new_double(rp.sent / secs));
+    json_object_object_add(
+        sum, "received_per_s", json_object_new_double(rp.received / secs));
+
+    for (int l = 0; l < RP_LATS; ++l) {
+        vec_t *lats = rp.lats[l];
+        qsort(lats->arr, lats->len, sizeof(uint64_t), rp_u64_cmp);
+
+        struct json_object *lat = json_object_new_object();
+        json_object_object_add(lat, "count", json_object_new_int64(lats->len));
+        json_object_object_add(
+            lat, "p50_ms", json_object_new_double(rp_percentile(lats, 0.5)));
+        json_object_object_add(
+            lat, "p99_ms", json_object_new_double(rp_percentile(lats, 0.99)));
+        json_object_object_add(lat, "p999_ms",
+            json_object_new_double(rp_percentile(lats, 0.999)));
+        json_object_object_add(
+            lat, "max_ms", json_object_new_double(rp_percentile(lats, 1)));
+        json_object_object_add(sum, rp_lat_names[l], lat);
+    }
+
+    return sum;
+}
+
+static double rp_get_double(struct json_object *obj, const char *group,
+    const char *key) {
+    struct json_object *val = NULL;
+    if (group && !json_object_object_get_ex(obj, group, &obj)) return 0;
+    json_object_object_get_ex(obj, key, &val);
+    return json_object_get_double(val);
+}
+
+static void rp_report(struct json_object *sum) {
+    printf("sessions %lu, frames %lu of %lu, %.1fs\n", rp.v_sessions->len,
+        rp.sent, rp.n_frames, rp_get_double(sum, NULL, "seconds"));
+    printf("sent     %.1f frames/s\n", rp_get_double(sum, NULL, "sent_per_s"));
+    printf("received %lu msgs, %.1f msgs/s\n", rp.received,
+        rp_get_double(sum, NULL, "received_per_s"));
+    printf("errors   %lu\n\n", rp.errors);
+
+    printf("%-8s %10s %10s %10s %10s %10s (ms)\n", "latency", "count", "p50",
+        "p99", "p999", "max");
+    for (int l = 0; l < RP_LATS; ++l) {
+        const char *name = rp_lat_names[l];
+        printf("%-8s %10.0f %10.3f %10.3f %10.3f %10.3f\n", name,
+            rp_get_double(sum, name, "count"),
+            rp_get_double(sum, name, "p50_ms"),
+            rp_get_double(sum, name, "p99_ms"),
+            rp_get_double(sum, name, "p999_ms"),
+            rp_get_double(sum, name, "max_ms"));
+    }
+}
+
+// compare with a previous summary, return the number of metrics worse by
+// more than `threshold` percent
+static int rp_compare(struct json_object *sum, struct json_object *base,
+    double threshold) {
+    // higher is worse for latencies, lower is worse for throughput
+    static const struct {
+        const char *group, *key;
+        bool        higher_worse;
+    } metrics[] = {
+        {NULL,    "received_per_s", false},
+        {"reply", "p50_ms",         true },
+        {"reply", "p99_ms",         true },
+        {"edit",  "p50_ms",         true },
+        {"edit",  "p99_ms",         true },
+    };
+
+    int worse = 0;
+
+    printf("\n%-22s %10s %10s %8s\n", "vs baseline", "base", "now", "change");
+    for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); ++i) {
+        double b = rp_get_double(base, metrics[i].group, metrics[i].key);
+        double n = rp_get_double(sum, metrics[i].group, metrics[i].key);
+        if (b <= 0) continue;
+
+        double change  = (n - b) / b * 100;
+        bool   regress = metrics[i].higher_worse ? change > threshold
+                                                 : change < -threshold;
+        worse += regress;
+
+        char name[64];
+        snprintf(name, sizeof(name), "%s%s%s",
+            metrics[i].group ? metrics[i].group : "",
+            metrics[i].group ? "." : "", metrics[i].key);
+        printf("%-22s %10.3f %10.3f %+7.1f%%%s\n", name, b, n, change,
+            regress ? "  REGRESSION" : "");
+    }
+
+    return worse;
+}
+
+static const char *rp_usage =
+    "usage: nps_replay -c capture [options]\n"
+    "  -c path      capture written by the server with CAPTURE_FILE\n"
+    "  -h host      server host (localhost)\n"
+    "  -p port      server port (8080)\n"
+    "  -s speed     time scale, 2 replays twice as fast, 0 back to back (1)\n"
+    "  -o path      write the summary as json\n"
+    "  -b path      compare with a summary written by -o, fail on regression\n"
+    "  -T percent   regression threshold for -b (10)\n";
+
+int main(int argc, const char **argv) {
+    const char *opt;
+
+    if (lws_cmdline_option(argc, argv, "--help")) {
+        fputs(rp_usage, stdout);
+        return 0;
+    }
+
+    const char *capture   = lws_cmdline_option(argc, argv, "-c");
+    const char *out       = lws_cmdline_option(argc, argv, "-o");
+    const char *baseline  = lws_cmdline_option(argc, argv, "-b");
+    double      threshold = 10;
+
+    rp.host  = "localhost";
+    rp.port  = 8080;
+    rp.speed = 1;
+
+    if ((opt = lws_cmdline_option(argc, argv, "-h"))) rp.host = opt;
+    if ((opt = lws_cmdline_option(argc, argv, "-p"))) rp.port = atoi(opt);
+    if ((opt = lws_cmdline_option(argc, argv, "-s"))) rp.speed = atof(opt);
+    if ((opt = lws_cmdline_option(argc, argv, "-T"))) threshold = atof(opt);
+
+    if (!capture || rp.speed < 0 || threshold < 0) {
+        fprintf(stderr, "invalid options\n%s", rp_usage);
+        return 1;
+    }
+
+    rp.v_sessions = vec_new_r(struct rp_session *, NULL, NULL, NULL);
+    rp.v_edits    = vec_new_r(uint64_t, NULL, NULL, NULL);
+    for (int l = 0; l < RP_LATS; ++l) {
+        rp.lats[l] = vec_new_r(uint64_t, NULL, NULL, NULL);
+    }
+
+    int ret = 1;
+
+    if (!rp_load(capture)) {
+        error_t *err = get_error();
+        fprintf(stderr, "%s\n", err->message);
+        destroy_error(err);
+        goto __rp_drop;
+    }
+    if (!rp.v_sessions->len) {
+        fprintf(stderr, "no session in %s\n", capture);
+        goto __rp_drop;
+    }
+
+    signal(SIGINT, sigint_handler);
+    lws_set_log_level(LLL_ERR | LLL_WARN, NULL);
+
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof(info));
+    info.port      = CONTEXT_PORT_NO_LISTEN;
+    info.protocols = protocols;
+
+    rp.context = lws_create_context(&info);
+    if (!rp.context) {
+        fprintf(stderr, "lws init failed\n");
+        goto __rp_drop;
+    }
+
+    printf("replaying %lu sessions, %lu frames\n", rp.v_sessions->len,
+        rp.n_frames);
+
+    rp.start_ns = rp_now_ns();
+    for (size_t i = 0; i < rp.v_sessions->len; ++i) {
+        struct rp_session *s = vec_get_r(struct rp_session *, rp.v_sessions, i);
+        lws_sul_schedule(
+            rp.context, 0, &s->sul, rp_connect, rp_delay(s->open_us));
+    }
+
+    rp_control(&rp.sul);
+
+    int n = 0;
+    while (n >= 0 && !interrupted) {
+        n = lws_service(rp.context, 0);
+    }
+
+    struct json_object *sum = rp_summary();
+    rp_report(sum);
+    ret = rp.errors ? 1 : 0;
+
+    if (out && json_object_to_file_ext(out, sum, JSON_C_TO_STRING_PRETTY)) {
+        fprintf(stderr, "cannot write %s\n", out);
+        ret = 1;
+    }
+
+    if (baseline) {
+        struct json_object *base = json_object_from_file(baseline);
+        if (!base) {
+            fprintf(stderr, "cannot read %s\n", baseline);
+            ret = 1;
+        } else {
+            if (rp_compare(sum, base, threshold)) ret = 2;
+            json_object_put(base);
+        }
+    }
+
+    json_object_put(sum);
+    lws_context_destroy(rp.context);
+
+__rp_drop:
+    for (size_t i = 0; i < rp.v_sessions->len; ++i) {
+        struct rp_session *s = vec_get_r(struct rp_session *, rp.v_sessions, i);
+        for (size_t j = 0; j < s->v_frames->len; ++j) {
+            free(vec_get_r(struct rp_frame, s->v_frames, j).data);
+        }
+        vec_drop(s->v_frames);
+        vec_drop(s->v_pending);
+        free(s->uri);
+        free(s->rx);
+        free(s);
+    }
+    vec_drop(rp.v_sessions);
+    vec_drop(rp.v_edits);
+    for (int l = 0; l < RP_LATS; ++l) vec_drop(rp.lats[l]);
+
+    return ret;
+}